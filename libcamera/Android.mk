@@ -1,15 +1,17 @@
 LOCAL_PATH := $(call my-dir)
-include $(call all-subdir-makefiles)
 
 include $(CLEAR_VARS)
 
 LOCAL_MODULE_TAGS    := optional
 LOCAL_MODULE_PATH    := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_MODULE         := camera.$(TARGET_BOOTLOADER_BOARD_NAME)
-LOCAL_SRC_FILES      := cameraHal.cpp
+LOCAL_SRC_FILES      := cameraHal.cpp yuvConvert.c frameStats.c paramStore.c \
+                        jpegEncode.c lumaStats.c
 
-LOCAL_SHARED_LIBRARIES := liblog libdl libutils libcamera_client libbinder libcutils libhardware libcamera libui
+LOCAL_SHARED_LIBRARIES := liblog libdl libutils libcamera_client libbinder libcutils libhardware libui
 LOCAL_C_INCLUDES       := $(TARGET_SPECIFIC_HEADER_PATH) frameworks/base/services/ frameworks/base/include
 LOCAL_C_INCLUDES       += hardware/libhardware/include/ hardware/libhardware/modules/gralloc/
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-subdir-makefiles)
@@ -25,41 +25,483 @@
 #include <hardware/camera.h>
 #include <binder/IMemory.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
 #include <linux/ioctl.h>
 #include <linux/msm_mdp.h>
 #include <gralloc_priv.h>
 #include <ui/GraphicBufferMapper.h>
 #include <dlfcn.h>
 #include <utils/Vector.h>
+#include <utils/threads.h>
+#include <utils/RWLock.h>
+#include <cutils/atomic.h>
+#include <cutils/properties.h>
+#include <semaphore.h>
+#include <cutils/native_handle.h>
+#include <media/stagefright/MetadataBufferType.h>
+#include "yuvConvert.h"
+#include "frameStats.h"
+#include "paramStore.h"
+#include "jpegEncode.h"
+#include "lumaStats.h"
 
 #define NO_ERROR 0
 
+/* Framebuffer used for MDP blits. Builds that link against a fake fb
+ * device may point this elsewhere. */
+#ifndef CAMERA_HAL_FB_DEVICE
+#define CAMERA_HAL_FB_DEVICE "/dev/graphics/fb0"
+#endif
+
+/* Buffers the HAL may hold dequeued on top of what the window keeps. */
+#define PREVIEW_DEQUEUED_BUFFERS 2
+
+/* Size of the copy ring used when the vendor preview heap can't be shared. */
+#define PREVIEW_CLIENT_BUFFERS   4
+
+/* Preview frames waiting for the render thread, must be a power of two. */
+#define PREVIEW_QUEUE_SIZE       4
+
+/* Recording frames that may be outstanding at the encoder at once. */
+#define RECORDING_POOL_BUFFERS   8
+
+/* MDP scaling range for preview frames, in either direction. */
+#define PREVIEW_MAX_SCALE        4
+
+/* Most pictures one burst may take. */
+#define BURST_MAX_SHOTS          8
+
+/* How long start_preview waits for a burst to finish. */
+#define BURST_TIMEOUT            5000000000LL
+
+/* How long pictures left over from a burst wait for the next take_picture. */
+#define BURST_QUEUE_TIMEOUT      2000000000LL
+
+/* Preview frames kept for zero shutter lag capture. */
+#define ZSL_RING_FRAMES          4
+
+/* How long a pre-warmed camera is kept open waiting for a device open. */
+#define PREWARM_TIMEOUT          3000000000LL
+
+/* How long a pre-warm waits for the device open of a connect. */
+#define PREWARM_DELAY            100000000LL
+
+/* Unused pre-warms in a row after which they stop until the next open. */
+#define PREWARM_MAX_MISSES       2
+
+/* Vendor camera library, loaded on first use. The host test harness links
+ * a mock vendor camera into its own executable and sets this to NULL so
+ * dlopen hands back the executable. */
+#ifndef VENDOR_CAMERA_LIBRARY
+#define VENDOR_CAMERA_LIBRARY    "libcamera.so"
+#endif
+
+/* Highest camera id the wrapper will open. */
+#define MAX_CAMERAS              2
+
 struct blitreq {
    unsigned int count;
    struct mdp_blit_req req;
 };
 
+/* An fb0 handle kept open across blits instead of one open/close per frame.
+ * It is opened and closed by the control ops with frameLock write-locked,
+ * and only used by the frame path, under the read lock. */
+struct blit_session {
+   int fd;
+};
+
+/* What the preview window was last configured with, so that usage, buffer
+ * count and geometry are set once per stream rather than once per frame. */
+struct preview_stream {
+   preview_stream_ops_t *window;
+   int32_t               width;
+   int32_t               height;
+   int32_t               bufferWidth;    /* differs from width/height when */
+   int32_t               bufferHeight;   /* the blit scales to the window */
+   bool                  configured;
+   bool                  scaling;        /* persist.camera.preview.scale */
+   bool                  scaleFailed;
+   bool                  rotate;         /* write buffers rotated by 90 */
+   bool                  yuv;            /* persist.camera.preview.yuv */
+   bool                  yuvFailed;
+   int                   format;         /* negotiated HAL_PIXEL_FORMAT */
+};
+
+/* Client memory for CAMERA_MSG_PREVIEW_FRAME. Where possible it wraps the
+ * vendor preview heap fd, so frames are handed out by index with no copy;
+ * otherwise it is a ring of preallocated buffers reused round-robin. Like
+ * the recording pool, frames are posted without the lock held and counted
+ * in posting, and mem is not released while it is non-zero. */
+struct preview_client_heap {
+   android::Mutex     lock;
+   android::Condition idle;       /* posting dropped to 0 */
+   unsigned int     posting;
+   camera_memory_t *mem;
+   void            *heapBase;   /* vendor heap that was wrapped or copied */
+   size_t           frameSize;
+   unsigned int     count;
+   unsigned int     next;
+   bool             wrapped;
+   bool             rotated;    /* frames are turned into portrait copies */
+};
+
+/* Preview frames handed from the vendor callback thread to the render
+ * thread. There is one producer and one consumer, but a full queue drops its
+ * oldest frame, so both sides advance head with a CAS. Frames are held by a
+ * strong reference taken on the queue's behalf. */
+struct preview_queue {
+   volatile int32_t  head;
+   volatile int32_t  tail;
+   android::IMemory *frames[PREVIEW_QUEUE_SIZE];
+   sem_t             pending;
+   volatile int32_t  rendered;
+   volatile int32_t  dropped;
+};
+
+/* What the video encoder takes in metadata mode instead of pixel data: the
+ * fd, offset and size of the vendor's frame, in a native handle. */
+struct recording_metadata {
+   int32_t          type;     /* kMetadataBufferTypeCameraSource */
+   native_handle_t *handle;
+};
+
+/* Client memory for CAMERA_MSG_VIDEO_FRAME, allocated once per recording.
+ * A returned frame's slot is computed from its data pointer. In metadata
+ * mode each slot is a recording_metadata and the vendor frame it points at
+ * is held until the encoder returns the slot. The encoder may return a slot
+ * from within the callback, so frames are posted without the lock held;
+ * posting counts them instead, and mem is not freed while it is non-zero. */
+struct recording_pool {
+   android::Mutex   lock;
+   android::Condition idle;       /* posting dropped to 0 */
+   bool             active;       /* from start to stop_recording */
+   unsigned int     posting;
+   camera_memory_t *mem;
+   size_t           frameSize;
+   unsigned int     count;
+   int              freeSlots[RECORDING_POOL_BUFFERS];
+   unsigned int     numFree;
+   nsecs_t          sentTime[RECORDING_POOL_BUFFERS];
+   bool             inUse[RECORDING_POOL_BUFFERS];
+   bool             metadata;
+   int32_t          rotateWidth;  /* copies are turned into portrait when */
+   int32_t          rotateHeight; /* frames are this size, 0 for as they are */
+   native_handle_t *handles[RECORDING_POOL_BUFFERS];
+   android::sp<android::IMemory> frames[RECORDING_POOL_BUFFERS];
+
+   /* Statistics, reset with each allocation. */
+   unsigned int     framesSent;
+   unsigned int     framesReleased;
+   unsigned int     framesDropped;
+   nsecs_t          totalHoldTime;
+   nsecs_t          maxHoldTime;
+};
+
+/* Lets frames through at no more than a given rate, spacing them by their
+ * arrival time. An interval of 0 lets every frame through. */
+struct frame_pacer {
+   volatile int32_t intervalUs;
+   nsecs_t          next;
+   volatile int32_t passed;
+   volatile int32_t skipped;
+};
+
+/*
+ * A burst takes several pictures for a single take_picture. The framework
+ * stops listening for compressed images after the first one, so later JPEGs
+ * are queued and each following take_picture is answered from the queue.
+ * Vendor takePicture calls for later shots and queued deliveries are made
+ * from the burst thread, never from a vendor or framework callback. The
+ * thread takes controlLock for its vendor calls, so control ops must not
+ * wait for it while holding controlLock.
+ *
+ * Queued pictures are dropped when they go stale: after BURST_QUEUE_TIMEOUT
+ * without a take_picture, on stop_preview, and when burst-count or a
+ * picture setting changes.
+ */
+struct burst_capture {
+   android::Mutex     lock;
+   android::Condition cond;
+   int                requested;     /* shots in the current burst */
+   int                taken;         /* JPEGs received so far */
+   bool               shotDue;       /* the thread should take the next */
+   unsigned int       deliveriesDue; /* take_picture calls to answer */
+   camera_memory_t   *queued[BURST_MAX_SHOTS];
+   unsigned int       numQueued;
+   unsigned int       generation;    /* bumped whenever the queue is dropped */
+   nsecs_t            start;
+   nsecs_t            lastDelivery;  /* burst end or last queued answer */
+
+   /* Statistics over completed bursts. */
+   unsigned int       bursts;
+   unsigned int       shots;
+   nsecs_t            totalTime;
+};
+
+enum {
+   ZSL_SLOT_EMPTY,
+   ZSL_SLOT_FILLING,
+   ZSL_SLOT_READY,
+   ZSL_SLOT_ENCODING
+};
+
+/*
+ * With zsl=on, copies of the most recent preview frames are kept so that
+ * take_picture can encode the one closest to the request instead of
+ * waiting for a vendor snapshot. Slots are claimed under the lock and
+ * filled or encoded outside of it.
+ */
+struct zsl_ring {
+   android::Mutex     lock;
+   android::Condition cond;
+   uint8_t           *buffer;
+   size_t             frameSize;
+   int32_t            width;
+   int32_t            height;
+   int                state[ZSL_RING_FRAMES];
+   nsecs_t            stamp[ZSL_RING_FRAMES];
+   unsigned int       next;
+   int                pending;      /* slot to encode, -1 if none */
+   nsecs_t            requested;    /* time of the take_picture */
+   int                rotation;     /* KEY_ROTATION at the take_picture */
+   int                quality;      /* KEY_JPEG_QUALITY likewise */
+   volatile int32_t   enabled;      /* the buffer is allocated */
+
+   /* Statistics. */
+   unsigned int       captures;
+   nsecs_t            totalLag;     /* |frame time - request time| */
+   nsecs_t            totalEncode;
+};
+
+enum {
+   CAMERA_OPEN_PENDING,
+   CAMERA_OPEN_DONE,
+   CAMERA_OPEN_FAILED
+};
+
+/*
+ * A vendor camera opened ahead of qcamera_device_open, triggered from
+ * get_camera_info when persist.camera.prewarm is set. It is handed to the
+ * next open of the same camera, or closed again after PREWARM_TIMEOUT.
+ *
+ * CameraService itself reads the info while connecting, right before the
+ * device open. So the open is only started if no device open follows
+ * within PREWARM_DELAY, which leaves the pre-warm to apps that read the
+ * info well ahead of Camera.open.
+ *
+ * An unused pre-warm powers the sensor up for PREWARM_TIMEOUT for nothing,
+ * and get_camera_info is also called by apps that never open the camera.
+ * After PREWARM_MAX_MISSES of those in a row there are no more pre-warms
+ * until a device is opened again.
+ */
+struct camera_prewarm {
+   android::Mutex     lock;
+   android::Condition cond;
+   bool               active;       /* cameraId is being or was opened */
+   int                cameraId;
+   bool               opening;
+   android::sp<android::CameraHardwareInterface> hw;
+   int                devicesOpen;  /* no pre-warm while one is open */
+   unsigned int       misses;       /* unused pre-warms since the last open */
+
+   /* Statistics. */
+   unsigned int       used;
+   unsigned int       expired;
+   unsigned int       skipped;      /* a device open came within the delay */
+};
+
+/*
+ * A picture taken while recording is copied out of the next recording
+ * frame on the callback thread and encoded by its own thread, so neither
+ * the vendor recording nor the encoder is stopped.
+ */
+struct video_snapshot {
+   android::Mutex     lock;
+   android::Condition cond;
+   volatile int32_t   requested;    /* grab the next recording frame */
+   bool               captured;     /* frame waits for the encoder */
+   uint8_t           *frame;        /* non-NULL while a snapshot is busy */
+   size_t             frameSize;
+   int32_t            width;
+   int32_t            height;
+   int                rotation;     /* KEY_ROTATION at the take_picture */
+   int                quality;      /* KEY_JPEG_QUALITY likewise */
+   nsecs_t            requestTime;
+   unsigned int       droppedAtRequest;
+
+   /* Statistics. */
+   unsigned int       taken;
+   unsigned int       dropped;      /* recording frames lost meanwhile */
+   nsecs_t            totalLatency;
+   nsecs_t            maxLatency;
+};
+
+/* The framework's callbacks, copied out as a unit by the frame path. */
+struct camera_callbacks {
+   camera_notify_callback         notify;
+   camera_data_callback           data;
+   camera_data_timestamp_callback dataTimestamp;
+   camera_request_memory          requestMemory;
+   void                          *user;
+};
+
+/*
+ * Everything that belongs to one opened camera. It is reached through
+ * camera_device_t::priv from the framework ops, and handed to the vendor
+ * library as the callback cookie.
+ *
+ * controlLock serializes control operations. frameLock protects callbacks,
+ * window and previewThread against the frame path: it is write-locked only
+ * to swap them, never around a vendor call, and the frame path drops its
+ * read lock before calling back into the framework, which may re-enter the
+ * msg_type ops. Those ops therefore take neither lock, except for turning
+ * video frames off, which CameraService only does from stopRecording.
+ */
+struct camera_hal_context {
+   camera_device_t                device;
+   camera_device_ops_t            ops;
+   int                            cameraId;
+
+   /* The vendor open runs on openThread; control ops wait on openState.
+    * msg_type changes made meanwhile are kept in deferredEnable and
+    * deferredDisable, under openLock, for openThread to apply. */
+   android::Mutex                 openLock;
+   android::Condition             openCond;
+   volatile int32_t               openState;
+   android::sp<android::Thread>   openThread;
+   int32_t                        deferredEnable;
+   int32_t                        deferredDisable;
+   unsigned int                   openWaits;      /* ops that had to wait */
+   nsecs_t                        openWaitTime;
+   bool                           prewarmed;
+   nsecs_t                        openRequested;
+   nsecs_t                        openCompleted;
+   nsecs_t                        previewStarted;
+   nsecs_t                        firstPreviewFrame;   /* of the session */
+   nsecs_t                        startToFirstFrame;   /* last start_preview */
+   bool                           rotatePreview;
+   bool                           metadataMode;
+   android::sp<android::CameraHardwareInterface> qCamera;
+
+   android::Mutex                 controlLock;
+   android::RWLock                frameLock;
+   struct camera_callbacks        callbacks;
+   preview_stream_ops_t          *window;
+   volatile int32_t               externallyRequestedFrames;
+
+   android::CameraParameters      camSettings;
+
+   /* Fixed-up flattened parameters returned by get_parameters. They are
+    * rebuilt only when paramGeneration has moved past cachedGeneration. */
+   android::String8               paramString;
+   volatile int32_t               paramGeneration;
+   int32_t                        cachedGeneration;
+   unsigned int                   paramCacheHits;
+   unsigned int                   paramCacheMisses;
+
+   /* Preview throttling; see CameraHAL_UpdatePreviewThrottle. */
+   struct frame_pacer             renderPacer;
+   struct frame_pacer             callbackPacer;
+   int                            throttleParams[2];
+
+   struct burst_capture           burst;
+   android::sp<android::Thread>   burstThread;
+   int                            burstShots;    /* burst-count parameter */
+
+   struct zsl_ring                zslRing;
+   android::sp<android::Thread>   zslThread;
+   bool                           zslEnabled;    /* zsl parameter */
+   int                            jpegQuality;
+   int                            jpegRotation;  /* sensor relative */
+   int                            pictureWidth;
+   int                            pictureHeight;
+
+   /* The parameters last forwarded to the vendor library, used to skip
+    * set_parameters calls that change nothing. They only describe the
+    * vendor's state while paramGeneration is still appliedGeneration;
+    * zoom commands, focus and captures move it on. */
+   android::String8               appliedString;
+   int32_t                        appliedGeneration;
+   struct param_store             appliedParams;
+   unsigned int                   paramsApplied;
+   unsigned int                   paramsSkipped;
+   unsigned int                   paramsReconfigured;
+
+   /* Preview size packed as (width << 16 | height) so that the frame path
+    * can pick up both halves with a single load. */
+   volatile int32_t               previewGeometry;
+
+   struct blit_session            previewBlit;
+   struct preview_stream          previewStream;
+   struct preview_client_heap     previewClientHeap;
+   struct preview_queue           previewQueue;
+   android::sp<android::Thread>   previewThread;
+   struct recording_pool          recordingPool;
+
+   /* luma-stats parameter; the latest preview luma statistics, published
+    * through get_parameters. */
+   volatile int32_t               lumaStatsEnabled;
+   android::Mutex                 lumaStatsLock;
+   struct luma_stats              lumaStats;
+   unsigned int                   lumaStatsFrames;
+
+   struct video_snapshot          videoSnapshot;
+   android::sp<android::Thread>   videoSnapshotThread;
+
+   /* Per-stage latency of the frame paths, reported by qcamera_dump. */
+   struct frame_stage_stats       frameStats[FRAME_STAGE_COUNT];
+   nsecs_t                        lastPreviewArrival;
+   nsecs_t                        lastRecordArrival;
+};
+
+/* Entry points of the vendor library. */
+typedef android::sp<android::CameraHardwareInterface>
+   (*vendor_open_camera_fn)(int id, int mode);
+typedef int (*vendor_number_of_cameras_fn)();
+typedef void (*vendor_camera_info_fn)(int cameraId,
+                                      android::CameraInfo *cameraInfo);
+
+/*
+ * The vendor library is dlopen'ed the first time it is needed rather than
+ * linked, so processes that only enumerate camera modules don't load and
+ * relocate it. The camera count and info never change, so they are asked
+ * for once.
+ */
+struct vendor_library {
+   android::Mutex              lock;
+   volatile int32_t            state;     /* 0 untried, 1 loaded, -1 failed */
+   void                       *handle;
+   vendor_open_camera_fn       openCameraHardware;
+   vendor_number_of_cameras_fn getNumberOfCameras;
+   vendor_camera_info_fn       getCameraInfo;
+   nsecs_t                     loadTime;
+
+   bool                        countCached;
+   int                         numCameras;
+   bool                        infoCached[MAX_CAMERAS];
+   android::CameraInfo         info[MAX_CAMERAS];
+};
+
+static struct vendor_library gVendor;
+
 /* Prototypes and extern functions. */
-extern "C" android::sp<android::CameraHardwareInterface> HAL_openCameraHardware(int id, int mode);
-extern "C" int HAL_getNumberOfCameras();
-extern "C" void HAL_getCameraInfo(int cameraId, struct CameraInfo* cameraInfo);
+int CameraHAL_GetNumberOfCameras();
 
 int qcamera_device_open(const hw_module_t* module, const char* name,
                         hw_device_t** device);
 int CameraHAL_GetCam_Info(int camera_id, struct camera_info *info);
+bool CameraHAL_PreRotatePreview(int cameraId);
+void CameraHAL_PrewarmCamera(int cameraId);
+bool CameraHAL_BurstFilterNotify(struct camera_hal_context *ctx,
+                                 int32_t msg_type);
 
-/* Global variables. */
-camera_notify_callback         origNotify_cb    = NULL;
-camera_data_callback           origData_cb      = NULL;
-camera_data_timestamp_callback origDataTS_cb    = NULL;
-camera_request_memory          origCamReqMemory = NULL;
-bool			       externallyRequestedFrames = false;
-android::Vector<camera_memory_t*>       sentFrames;
-
-android::String8          g_str;
-android::CameraParameters camSettings;
-preview_stream_ops_t      *mWindow = NULL;
-android::sp<android::CameraHardwareInterface> qCamera;
+static inline struct camera_hal_context *
+CameraHAL_GetContext(struct camera_device *device)
+{
+   return static_cast<struct camera_hal_context *>(device->priv);
+}
 
 static hw_module_methods_t camera_module_methods = {
    open: qcamera_device_open
@@ -77,96 +519,601 @@ camera_module_t HAL_MODULE_INFO_SYM = {
       dso: NULL,
       reserved: {0},
    },
-   get_number_of_cameras: HAL_getNumberOfCameras,
+   get_number_of_cameras: CameraHAL_GetNumberOfCameras,
    get_camera_info: CameraHAL_GetCam_Info,
 };		
 
+bool
+CameraHAL_LoadVendorLibrary()
+{
+   int32_t state = android_atomic_acquire_load(&gVendor.state);
+
+   if (state != 0) {
+      return state > 0;
+   }
+
+   android::Mutex::Autolock lock(gVendor.lock);
+   if (gVendor.state != 0) {
+      return gVendor.state > 0;
+   }
+   nsecs_t start = systemTime();
+   gVendor.handle = dlopen(VENDOR_CAMERA_LIBRARY, RTLD_NOW);
+   if (gVendor.handle != NULL) {
+      gVendor.openCameraHardware = (vendor_open_camera_fn)
+         dlsym(gVendor.handle, "HAL_openCameraHardware");
+      gVendor.getNumberOfCameras = (vendor_number_of_cameras_fn)
+         dlsym(gVendor.handle, "HAL_getNumberOfCameras");
+      gVendor.getCameraInfo      = (vendor_camera_info_fn)
+         dlsym(gVendor.handle, "HAL_getCameraInfo");
+   }
+   if (gVendor.handle == NULL || gVendor.openCameraHardware == NULL ||
+       gVendor.getNumberOfCameras == NULL || gVendor.getCameraInfo == NULL) {
+      LOGE("CameraHAL_LoadVendorLibrary: ERROR loading %s: %s\n",
+           VENDOR_CAMERA_LIBRARY, dlerror());
+      if (gVendor.handle != NULL) {
+         dlclose(gVendor.handle);
+         gVendor.handle = NULL;
+      }
+      android_atomic_release_store(-1, &gVendor.state);
+      return false;
+   }
+   gVendor.loadTime = systemTime() - start;
+   LOGD("CameraHAL_LoadVendorLibrary: loaded %s in %lldms\n",
+        VENDOR_CAMERA_LIBRARY, ns2ms(gVendor.loadTime));
+   android_atomic_release_store(1, &gVendor.state);
+   return true;
+}
+
+int
+CameraHAL_GetNumberOfCameras()
+{
+   if (!CameraHAL_LoadVendorLibrary()) {
+      return 0;
+   }
+
+   android::Mutex::Autolock lock(gVendor.lock);
+   if (!gVendor.countCached) {
+      gVendor.numCameras  = gVendor.getNumberOfCameras();
+      gVendor.countCached = true;
+   }
+   return gVendor.numCameras;
+}
+
+bool
+CameraHAL_GetVendorCameraInfo(int cameraId, android::CameraInfo *info)
+{
+   if (cameraId < 0 || cameraId >= MAX_CAMERAS ||
+       !CameraHAL_LoadVendorLibrary()) {
+      return false;
+   }
+
+   android::Mutex::Autolock lock(gVendor.lock);
+   if (!gVendor.infoCached[cameraId]) {
+      gVendor.getCameraInfo(cameraId, &gVendor.info[cameraId]);
+      gVendor.infoCached[cameraId] = true;
+   }
+   *info = gVendor.info[cameraId];
+   return true;
+}
+
+android::sp<android::CameraHardwareInterface>
+CameraHAL_OpenVendorCamera(int cameraId)
+{
+   if (!CameraHAL_LoadVendorLibrary()) {
+      return NULL;
+   }
+   return gVendor.openCameraHardware(cameraId, 5);
+}
+
 int
 CameraHAL_GetCam_Info(int camera_id, struct camera_info *info)
 {
-   LOGV("CameraHAL_GetCam_Info:\n");
-   HAL_getCameraInfo(camera_id, (struct CameraInfo*) info);
-   /* Disregard that... */
-   info->facing      = CAMERA_FACING_BACK;
-   info->orientation = 90;
+   LOGV("CameraHAL_GetCam_Info: camera_id:%d\n", camera_id);
+   if (!CameraHAL_GetVendorCameraInfo(camera_id,
+                                      (android::CameraInfo *)info)) {
+      return -EINVAL;
+   }
+   /* Disregard that... The blob describes camera 0, the back camera,
+    * wrongly, which is what this wrapper has always overridden. Any other
+    * camera it reports is taken as it describes it. */
+   if (camera_id == 0) {
+      info->facing      = CAMERA_FACING_BACK;
+      /* A pre-rotated preview is already upright. */
+      info->orientation = CameraHAL_PreRotatePreview(camera_id) ? 0 : 90;
+   }
+   CameraHAL_PrewarmCamera(camera_id);
    return NO_ERROR;
 }
 
 /* HAL helper functions. */
+
+/*
+ * With persist.camera.preview.rotate set, the back camera's preview is
+ * rotated into portrait by the blitter instead of by the compositor, and
+ * the camera reports an orientation of 0 so that apps leave the display
+ * orientation alone. To keep that true, apps are shown a portrait sensor
+ * throughout: CameraHAL_PortraitParams turns the parameters, and preview
+ * callback and recording frames are rotated on their way to the client.
+ * The front camera is left out since the compositor also mirrors it.
+ */
+bool
+CameraHAL_PreRotatePreview(int cameraId)
+{
+   char value[PROPERTY_VALUE_MAX];
+
+   if (cameraId != 0) {
+      return false;
+   }
+   property_get("persist.camera.preview.rotate", value, "0");
+   return atoi(value) != 0;
+}
+
+/* Moves KEY_ROTATION between the orientation apps were told about and the
+ * one the sensor really has. */
+void
+CameraHAL_AdjustRotation(android::CameraParameters &settings, int degrees)
+{
+   if (settings.get(android::CameraParameters::KEY_ROTATION) != NULL) {
+      int rotation = settings.getInt(android::CameraParameters::KEY_ROTATION);
+      settings.set(android::CameraParameters::KEY_ROTATION,
+                   (rotation + degrees) % 360);
+   }
+}
+
+/* Turns each WxH of a size or size list parameter into HxW. A value that
+ * does not parse is left for the vendor library to reject. */
+void
+CameraHAL_SwapSizes(android::CameraParameters &settings, const char *key)
+{
+   const char      *value = settings.get(key);
+   android::String8 swapped;
+   int              width, height, used;
+
+   if (value == NULL) {
+      return;
+   }
+   while (sscanf(value, "%dx%d%n", &width, &height, &used) == 2) {
+      swapped.appendFormat(swapped.isEmpty() ? "%dx%d" : ",%dx%d", height,
+                           width);
+      value += used;
+      if (*value != ',') {
+         break;
+      }
+      value++;
+   }
+   if (*value != '\0') {
+      LOGW("CameraHAL_SwapSizes: can't parse %s=%s\n", key,
+           settings.get(key));
+      return;
+   }
+   settings.set(key, swapped.string());
+}
+
+void
+CameraHAL_SwapParams(android::CameraParameters &settings, const char *keyA,
+                     const char *keyB)
+{
+   if (settings.get(keyA) != NULL && settings.get(keyB) != NULL) {
+      android::String8 valueA(settings.get(keyA));
+      settings.set(keyA, settings.get(keyB));
+      settings.set(keyB, valueA.string());
+   }
+}
+
+/* Rotates focus or metering areas, (left,top,right,bottom,weight) in
+ * -1000..1000, between the portrait frame and the sensor's, which is the
+ * portrait one turned 90 degrees anticlockwise. */
+void
+CameraHAL_RotateAreas(android::CameraParameters &settings, const char *key,
+                      bool toSensor)
+{
+   const char      *value = settings.get(key);
+   android::String8 rotated;
+   int              left, top, right, bottom, weight, used;
+
+   if (value == NULL) {
+      return;
+   }
+   while (sscanf(value, "(%d,%d,%d,%d,%d)%n", &left, &top, &right, &bottom,
+                 &weight, &used) == 5) {
+      rotated.appendFormat(rotated.isEmpty() ? "(%d,%d,%d,%d,%d)" :
+                                               ",(%d,%d,%d,%d,%d)",
+                           toSensor ? top : -bottom,
+                           toSensor ? -right : left,
+                           toSensor ? bottom : -top,
+                           toSensor ? -left : right, weight);
+      value += used;
+      if (*value != ',') {
+         break;
+      }
+      value++;
+   }
+   if (*value != '\0') {
+      LOGW("CameraHAL_RotateAreas: can't parse %s=%s\n", key,
+           settings.get(key));
+      return;
+   }
+   settings.set(key, rotated.string());
+}
+
+static const char *const portraitSizeKeys[] = {
+   android::CameraParameters::KEY_PREVIEW_SIZE,
+   android::CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES,
+   android::CameraParameters::KEY_VIDEO_SIZE,
+   android::CameraParameters::KEY_SUPPORTED_VIDEO_SIZES,
+   android::CameraParameters::KEY_PREFERRED_PREVIEW_SIZE_FOR_VIDEO,
+   android::CameraParameters::KEY_PICTURE_SIZE,
+   android::CameraParameters::KEY_SUPPORTED_PICTURE_SIZES,
+   android::CameraParameters::KEY_SUPPORTED_JPEG_THUMBNAIL_SIZES,
+   "record-size",
+};
+
+/* Moves parameters between the vendor library's landscape sensor and the
+ * portrait one apps see when the preview is pre-rotated. */
+void
+CameraHAL_PortraitParams(android::CameraParameters &settings, bool toSensor)
+{
+   for (unsigned int i = 0;
+        i < sizeof(portraitSizeKeys) / sizeof(portraitSizeKeys[0]); i++) {
+      CameraHAL_SwapSizes(settings, portraitSizeKeys[i]);
+   }
+   CameraHAL_SwapParams(settings,
+                        android::CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH,
+                        android::CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT);
+   CameraHAL_SwapParams(settings,
+                        android::CameraParameters::KEY_HORIZONTAL_VIEW_ANGLE,
+                        android::CameraParameters::KEY_VERTICAL_VIEW_ANGLE);
+   CameraHAL_AdjustRotation(settings, toSensor ? 90 : 270);
+   CameraHAL_RotateAreas(settings, android::CameraParameters::KEY_FOCUS_AREAS,
+                         toSensor);
+   CameraHAL_RotateAreas(settings,
+                         android::CameraParameters::KEY_METERING_AREAS,
+                         toSensor);
+}
+
+void
+CameraHAL_InvalidateParams(struct camera_hal_context *ctx)
+{
+   android_atomic_inc(&ctx->paramGeneration);
+}
+
+void
+CameraHAL_GetCallbacks(struct camera_hal_context *ctx,
+                       struct camera_callbacks *cb)
+{
+   android::RWLock::AutoRLock lock(ctx->frameLock);
+   *cb = ctx->callbacks;
+}
+
 void 
 CameraHAL_NotifyCb(int32_t msg_type, int32_t ext1,
                    int32_t ext2, void *user)
 {
+   struct camera_hal_context *ctx = (struct camera_hal_context *)user;
+   struct camera_callbacks    cb;
+
    LOGV("CameraHAL_NotifyCb: msg_type:%d ext1:%d ext2:%d user:%p\n",
         msg_type, ext1, ext2, user);
-   if (origNotify_cb != NULL) {
-      origNotify_cb(msg_type, ext1, ext2, user);
+   if (msg_type == CAMERA_MSG_FOCUS || msg_type == CAMERA_MSG_ZOOM) {
+      /* The vendor library updates focus-distances on completion, and zoom
+       * at each step of a smooth zoom. */
+      CameraHAL_InvalidateParams(ctx);
+   }
+   if (CameraHAL_BurstFilterNotify(ctx, msg_type)) {
+      return;
+   }
+   CameraHAL_GetCallbacks(ctx, &cb);
+   if (cb.notify != NULL) {
+      cb.notify(msg_type, ext1, ext2, cb.user);
    }
 }
 
 bool
-CameraHAL_CopyBuffers_Hw(int srcFd, int destFd,
-                         size_t srcOffset, size_t destOffset,
-                         int srcFormat, int destFormat,
-                         int x, int y, int w, int h)
+CameraHAL_OpenBlitSession(struct blit_session *session)
+{
+   if (session->fd >= 0) {
+      return true;
+   }
+   session->fd = open(CAMERA_HAL_FB_DEVICE, O_RDWR);
+   if (session->fd < 0) {
+      LOGE("CameraHAL_OpenBlitSession: Error opening %s %s\n",
+           CAMERA_HAL_FB_DEVICE, strerror(errno));
+      return false;
+   }
+   LOGV("CameraHAL_OpenBlitSession: fd:%d\n", session->fd);
+   return true;
+}
+
+void
+CameraHAL_CloseBlitSession(struct blit_session *session)
+{
+   if (session->fd >= 0) {
+      LOGV("CameraHAL_CloseBlitSession: fd:%d\n", session->fd);
+      close(session->fd);
+      session->fd = -1;
+   }
+}
+
+bool
+CameraHAL_ScaleBuffers_Hw(struct blit_session *session,
+                          int srcFd, int destFd,
+                          size_t srcOffset, size_t destOffset,
+                          int srcFormat, int destFormat,
+                          int srcW, int srcH, int destStride,
+                          int destW, int destH, int flags)
 {
     struct blitreq blit;
-    bool   success = true;
-    int    fb_fd = open("/dev/graphics/fb0", O_RDWR);
 
-    if (fb_fd < 0) {
-       LOGD("CameraHAL_CopyBuffers_Hw: Error opening /dev/graphics/fb0\n");
+    /* A frame that arrives after stop_preview falls back to the CPU. */
+    if (session->fd < 0) {
        return false;
     }
 
-    LOGV("CameraHAL_CopyBuffers_Hw: srcFD:%d destFD:%d srcOffset:%#x"
-         " destOffset:%#x x:%d y:%d w:%d h:%d\n", srcFd, destFd, srcOffset,
-         destOffset, x, y, w, h);
+    LOGV("CameraHAL_ScaleBuffers_Hw: srcFD:%d destFD:%d srcOffset:%#x"
+         " destOffset:%#x src:%dx%d dest:%dx%d stride:%d\n", srcFd, destFd,
+         srcOffset, destOffset, srcW, srcH, destW, destH, destStride);
 
     memset(&blit, 0, sizeof(blit));
     blit.count = 1;
 
-    blit.req.flags       = 0;
+    blit.req.flags       = flags;
     blit.req.alpha       = 0xff;
     blit.req.transp_mask = 0xffffffff;
 
-    blit.req.src.width     = w;
-    blit.req.src.height    = h;
+    blit.req.src.width     = srcW;
+    blit.req.src.height    = srcH;
     blit.req.src.offset    = srcOffset;
     blit.req.src.memory_id = srcFd;
     blit.req.src.format    = srcFormat;
 
-    blit.req.dst.width     = w;
-    blit.req.dst.height    = h;
+    blit.req.dst.width     = destStride;
+    blit.req.dst.height    = destH;
     blit.req.dst.offset    = destOffset;
     blit.req.dst.memory_id = destFd;
     blit.req.dst.format    = destFormat;
 
-    blit.req.src_rect.x = blit.req.dst_rect.x = x;
-    blit.req.src_rect.y = blit.req.dst_rect.y = y;
-    blit.req.src_rect.w = blit.req.dst_rect.w = w;
-    blit.req.src_rect.h = blit.req.dst_rect.h = h;
+    blit.req.src_rect.w = srcW;
+    blit.req.src_rect.h = srcH;
+    /* Like copybit, the destination rect of a rotated blit is given before
+     * rotation. */
+    blit.req.dst_rect.w = (flags & MDP_ROT_90) ? destH : destW;
+    blit.req.dst_rect.h = (flags & MDP_ROT_90) ? destW : destH;
 
-    if (ioctl(fb_fd, MSMFB_BLIT, &blit)) {
-       LOGV("CameraHAL_CopyBuffers_Hw: MSMFB_BLIT failed = %d %s\n",
+    if (ioctl(session->fd, MSMFB_BLIT, &blit)) {
+       LOGV("CameraHAL_ScaleBuffers_Hw: MSMFB_BLIT failed = %d %s\n",
             errno, strerror(errno));
-       success = false;
+       return false;
     }
-    close(fb_fd);
-    return success;
+    return true;
+}
+
+bool
+CameraHAL_CopyBuffers_Hw(struct blit_session *session,
+                         int srcFd, int destFd,
+                         size_t srcOffset, size_t destOffset,
+                         int srcFormat, int destFormat,
+                         int w, int h, int destStride)
+{
+    return CameraHAL_ScaleBuffers_Hw(session, srcFd, destFd, srcOffset,
+                                     destOffset, srcFormat, destFormat,
+                                     w, h, destStride, w, h, 0);
+}
+
+/* CPU fallback for when MSMFB_BLIT is unavailable or rejects the request. */
+bool
+CameraHAL_CopyBuffers_Sw(const void *src, buffer_handle_t *bufHandle,
+                         int w, int h, int stride, bool rotate, bool yuv)
+{
+   void              *vaddr = NULL;
+   android::status_t  retVal;
+
+   retVal = android::GraphicBufferMapper::get().lock(*bufHandle,
+                                   GRALLOC_USAGE_SW_WRITE_OFTEN,
+                                   rotate ? android::Rect(h, w) :
+                                            android::Rect(w, h), &vaddr);
+   if (retVal != NO_ERROR || vaddr == NULL) {
+      LOGE("CameraHAL_CopyBuffers_Sw: ERROR locking the buffer %d\n", retVal);
+      return false;
+   }
+   if (yuv) {
+      /* Same NV21 layout on both sides, only the strides differ. The
+       * window's chroma plane follows its last luma row, see
+       * CameraHAL_ConfigurePreviewStream. */
+      const char *in  = (const char *)src;
+      char       *out = (char *)vaddr;
+      for (int row = 0; row < h + h / 2; row++) {
+         memcpy(out + row * stride, in + row * w, w);
+      }
+   } else if (rotate) {
+      yuv420sp_to_rgbx_rot90((const uint8_t *)src, (uint8_t *)vaddr, w, h,
+                             stride, YUV420SP_NV21);
+   } else {
+      yuv420sp_to_rgbx((const uint8_t *)src, (uint8_t *)vaddr, w, h, stride,
+                       YUV420SP_NV21);
+   }
+   android::GraphicBufferMapper::get().unlock(*bufHandle);
+   return true;
+}
+
+void
+CameraHAL_UpdatePreviewGeometry(struct camera_hal_context *ctx)
+{
+   int32_t previewWidth, previewHeight;
+   android::CameraParameters hwParameters = ctx->qCamera->getParameters();
+
+   hwParameters.getPreviewSize(&previewWidth, &previewHeight);
+   if (previewWidth <= 0 || previewHeight <= 0 ||
+       previewWidth > 0xffff || previewHeight > 0xffff) {
+      LOGE("CameraHAL_UpdatePreviewGeometry: bad preview size %dx%d\n",
+           previewWidth, previewHeight);
+      return;
+   }
+   LOGV("CameraHAL_UpdatePreviewGeometry: %dx%d\n", previewWidth,
+        previewHeight);
+   android_atomic_release_store((previewWidth << 16) | previewHeight,
+                                &ctx->previewGeometry);
+}
+
+void
+CameraHAL_GetPreviewGeometry(struct camera_hal_context *ctx,
+                             int32_t *previewWidth, int32_t *previewHeight)
+{
+   int32_t geometry = android_atomic_acquire_load(&ctx->previewGeometry);
+
+   if (geometry == 0) {
+      /* Frames arriving before any set_parameters/start_preview. */
+      CameraHAL_UpdatePreviewGeometry(ctx);
+      geometry = android_atomic_acquire_load(&ctx->previewGeometry);
+   }
+   *previewWidth  = (geometry >> 16) & 0xffff;
+   *previewHeight = geometry & 0xffff;
+}
+
+/*
+ * Finds the buffer size the window would pick on its own by dequeueing one
+ * buffer at its default geometry. The size is swapped into the sensor's
+ * orientation when the compositor is rotating a landscape preview into a
+ * portrait window. Returns false if it is out of the blitter's range.
+ */
+bool
+CameraHAL_GetWindowBufferSize(preview_stream_ops_t *window,
+                              int32_t previewWidth, int32_t previewHeight,
+                              int32_t *bufferWidth, int32_t *bufferHeight)
+{
+   buffer_handle_t *bufHandle = NULL;
+   int32_t          stride, width, height;
+
+   if (window->set_buffers_geometry(window, 0, 0,
+                                    HAL_PIXEL_FORMAT_RGBX_8888) != NO_ERROR ||
+       window->dequeue_buffer(window, &bufHandle, &stride) != NO_ERROR) {
+      return false;
+   }
+   private_handle_t const *privHandle =
+      reinterpret_cast<private_handle_t const *>(*bufHandle);
+   width  = privHandle->width;
+   height = privHandle->height;
+   window->cancel_buffer(window, bufHandle);
+
+   if ((width > height) != (previewWidth > previewHeight)) {
+      int32_t tmp = width;
+      width  = height;
+      height = tmp;
+   }
+   if (width <= 0 || height <= 0 ||
+       width  > previewWidth  * PREVIEW_MAX_SCALE ||
+       height > previewHeight * PREVIEW_MAX_SCALE ||
+       width  * PREVIEW_MAX_SCALE < previewWidth ||
+       height * PREVIEW_MAX_SCALE < previewHeight) {
+      LOGW("CameraHAL_GetWindowBufferSize: cannot scale %dx%d to %dx%d\n",
+           previewWidth, previewHeight, width, height);
+      return false;
+   }
+   *bufferWidth  = width;
+   *bufferHeight = height;
+   return true;
+}
+
+bool
+CameraHAL_ConfigurePreviewStream(struct preview_stream *stream,
+                                 preview_stream_ops_t *window,
+                                 int32_t previewWidth, int32_t previewHeight)
+{
+   int minUndequeued = 0;
+   android::status_t retVal;
+
+   if (stream->configured && stream->window == window &&
+       stream->width == previewWidth && stream->height == previewHeight) {
+      return true;
+   }
+
+   LOGD("CameraHAL_ConfigurePreviewStream: window:%p %dx%d\n", window,
+        previewWidth, previewHeight);
+   stream->configured = false;
+
+   window->set_usage(window, GRALLOC_USAGE_PRIVATE_0 |
+                     GRALLOC_USAGE_SW_READ_OFTEN |
+                     GRALLOC_USAGE_SW_WRITE_OFTEN);
+
+   if (window->get_min_undequeued_buffer_count(window,
+                                               &minUndequeued) == NO_ERROR) {
+      retVal = window->set_buffer_count(window,
+                                        minUndequeued +
+                                        PREVIEW_DEQUEUED_BUFFERS);
+      if (retVal != NO_ERROR) {
+         LOGW("CameraHAL_ConfigurePreviewStream: set_buffer_count(%d) "
+              "failed %d\n", minUndequeued + PREVIEW_DEQUEUED_BUFFERS, retVal);
+      }
+   }
+
+   stream->bufferWidth  = stream->rotate ? previewHeight : previewWidth;
+   stream->bufferHeight = stream->rotate ? previewWidth : previewHeight;
+   if (stream->scaling && !stream->scaleFailed &&
+       CameraHAL_GetWindowBufferSize(window, stream->bufferWidth,
+                                     stream->bufferHeight,
+                                     &stream->bufferWidth,
+                                     &stream->bufferHeight)) {
+      LOGD("CameraHAL_ConfigurePreviewStream: scaling to %dx%d\n",
+           stream->bufferWidth, stream->bufferHeight);
+   }
+
+   /* gralloc lays a YCrCb_420_SP buffer out with its luma rows padded to
+    * 16 bytes and the chroma plane right after the last row. Both the blit
+    * and the CPU copy put the chroma at stride * height, so YUV is only
+    * used where the padding can't come into it: a width that is already a
+    * multiple of 16, which every advertised preview size is, and an even
+    * height. The stride is checked against it again per buffer. */
+   stream->format = HAL_PIXEL_FORMAT_RGBX_8888;
+   if (stream->yuv && !stream->yuvFailed &&
+       (stream->bufferWidth % 16) == 0 && (stream->bufferHeight % 2) == 0) {
+      retVal = window->set_buffers_geometry(window, stream->bufferWidth,
+                                            stream->bufferHeight,
+                                            HAL_PIXEL_FORMAT_YCrCb_420_SP);
+      if (retVal == NO_ERROR) {
+         stream->format = HAL_PIXEL_FORMAT_YCrCb_420_SP;
+      } else {
+         LOGW("CameraHAL_ConfigurePreviewStream: window refused YUV "
+              "buffers %d, using RGBX\n", retVal);
+         stream->yuvFailed = true;
+      }
+   }
+   if (stream->format == HAL_PIXEL_FORMAT_RGBX_8888) {
+      retVal = window->set_buffers_geometry(window, stream->bufferWidth,
+                                            stream->bufferHeight,
+                                            HAL_PIXEL_FORMAT_RGBX_8888);
+   }
+   if (retVal != NO_ERROR) {
+      LOGE("CameraHAL_ConfigurePreviewStream: set_buffers_geometry failed "
+           "%d\n", retVal);
+      return false;
+   }
+
+   stream->window     = window;
+   stream->width      = previewWidth;
+   stream->height     = previewHeight;
+   stream->configured = true;
+   return true;
 }
 
 void
-CameraHAL_HandlePreviewData(const android::sp<android::IMemory>& dataPtr,
+CameraHAL_ResetPreviewStream(struct preview_stream *stream)
+{
+   stream->configured  = false;
+   stream->scaleFailed = false;
+   stream->yuvFailed   = false;
+}
+
+/* Called with ctx->frameLock read-locked. */
+void
+CameraHAL_HandlePreviewData(struct camera_hal_context *ctx,
+                            const android::sp<android::IMemory>& dataPtr,
                             preview_stream_ops_t *mWindow,
-                            camera_request_memory getMemory,
                             int32_t previewWidth, int32_t previewHeight)
 {
-   if (mWindow != NULL && getMemory != NULL) {
+   if (mWindow != NULL) {
       ssize_t  offset;
       size_t   size;
       int32_t  previewFormat = MDP_Y_CBCR_H2V2;
-      int32_t  destFormat    = MDP_BGRA_8888;
+      int32_t  destFormat;
 
       android::status_t retVal;
       android::sp<android::IMemoryHeap> mHeap = dataPtr->getMemory(&offset,
@@ -176,15 +1123,11 @@ CameraHAL_HandlePreviewData(const android::sp<android::IMemory>& dataPtr,
            "offset:%#x size:%#x base:%p\n", previewWidth, previewHeight,
            (unsigned)offset, size, mHeap != NULL ? mHeap->base() : 0);
 
-      mWindow->set_usage(mWindow, GRALLOC_USAGE_PRIVATE_0 |
-                         GRALLOC_USAGE_SW_READ_OFTEN);
-      retVal = mWindow->set_buffers_geometry(mWindow,
-                                             previewWidth, previewHeight,
-                                             HAL_PIXEL_FORMAT_RGBX_8888
-                                             );
-      if (retVal == NO_ERROR) {
+      if (CameraHAL_ConfigurePreviewStream(&ctx->previewStream, mWindow,
+                                           previewWidth, previewHeight)) {
          int32_t          stride;
          buffer_handle_t *bufHandle = NULL;
+         nsecs_t          start = systemTime();
 
          LOGV("CameraHAL_HandlePreviewData: dequeueing buffer\n");
          retVal = mWindow->dequeue_buffer(mWindow, &bufHandle, &stride);
@@ -193,13 +1136,82 @@ CameraHAL_HandlePreviewData(const android::sp<android::IMemory>& dataPtr,
             if (retVal == NO_ERROR) {
                private_handle_t const *privHandle =
                   reinterpret_cast<private_handle_t const *>(*bufHandle);
-               CameraHAL_CopyBuffers_Hw(mHeap->getHeapID(), privHandle->fd,
-                                             offset, privHandle->offset,
-                                             previewFormat, destFormat,
-                                             0, 0, previewWidth,
-                                             previewHeight);
-               mWindow->enqueue_buffer(mWindow, bufHandle);
-               LOGV("CameraHAL_HandlePreviewData: enqueued buffer\n");
+               struct preview_stream *stream = &ctx->previewStream;
+               bool yuv = stream->format == HAL_PIXEL_FORMAT_YCrCb_420_SP;
+               bool copied;
+
+               /* A YUV window takes the preview frame as it is. */
+               destFormat = yuv ? previewFormat : MDP_BGRA_8888;
+
+               frame_stats_record(&ctx->frameStats[FRAME_STAGE_DEQUEUE],
+                                  systemTime() - start);
+               start = systemTime();
+               bool scaled = stream->rotate ?
+                  (stream->bufferWidth != previewHeight ||
+                   stream->bufferHeight != previewWidth) :
+                  (stream->bufferWidth != previewWidth ||
+                   stream->bufferHeight != previewHeight);
+
+               if (yuv && stride != stream->bufferWidth) {
+                  LOGW("CameraHAL_HandlePreviewData: YUV stride %d for "
+                       "width %d, using RGBX from the next frame on\n",
+                       stride, stream->bufferWidth);
+                  stream->yuvFailed  = true;
+                  stream->configured = false;
+                  copied             = false;
+               } else if (scaled || stream->rotate) {
+                  copied = CameraHAL_ScaleBuffers_Hw(&ctx->previewBlit,
+                                                     mHeap->getHeapID(),
+                                                     privHandle->fd,
+                                                     offset, privHandle->offset,
+                                                     previewFormat, destFormat,
+                                                     previewWidth,
+                                                     previewHeight, stride,
+                                                     stream->bufferWidth,
+                                                     stream->bufferHeight,
+                                                     stream->rotate ?
+                                                        MDP_ROT_90 : 0);
+                  if (!copied && (scaled || yuv)) {
+                     /* The CPU path can neither scale nor rotate into YUV;
+                      * go back to a plain RGBX window from the next frame
+                      * on. */
+                     LOGW("CameraHAL_HandlePreviewData: blit failed, "
+                          "disabling scaling and YUV output\n");
+                     stream->scaleFailed = true;
+                     stream->yuvFailed   = true;
+                     stream->configured  = false;
+                  } else if (!copied) {
+                     copied = CameraHAL_CopyBuffers_Sw((char *)mHeap->base() +
+                                                          offset,
+                                                       bufHandle, previewWidth,
+                                                       previewHeight, stride,
+                                                       true, false);
+                  }
+               } else {
+                  copied = CameraHAL_CopyBuffers_Hw(&ctx->previewBlit,
+                                                    mHeap->getHeapID(),
+                                                    privHandle->fd,
+                                                    offset, privHandle->offset,
+                                                    previewFormat, destFormat,
+                                                    previewWidth,
+                                                    previewHeight, stride) ||
+                           CameraHAL_CopyBuffers_Sw((char *)mHeap->base() +
+                                                       offset,
+                                                    bufHandle, previewWidth,
+                                                    previewHeight, stride,
+                                                    false, yuv);
+               }
+               frame_stats_record(&ctx->frameStats[FRAME_STAGE_BLIT],
+                                  systemTime() - start);
+               if (copied) {
+                  start = systemTime();
+                  mWindow->enqueue_buffer(mWindow, bufHandle);
+                  frame_stats_record(&ctx->frameStats[FRAME_STAGE_ENQUEUE],
+                                     systemTime() - start);
+                  LOGV("CameraHAL_HandlePreviewData: enqueued buffer\n");
+               } else {
+                  mWindow->cancel_buffer(mWindow, bufHandle);
+               }
             } else {
                LOGE("CameraHAL_HandlePreviewData: ERROR locking the buffer\n");
                mWindow->cancel_buffer(mWindow, bufHandle);
@@ -211,73 +1223,1585 @@ CameraHAL_HandlePreviewData(const android::sp<android::IMemory>& dataPtr,
    }
 }
 
-camera_memory_t *
-CameraHAL_GenClientData(const android::sp<android::IMemory> &dataPtr, 
-                        camera_request_memory reqClientMemory,
-                        void *user)
+void
+CameraHAL_PreviewQueuePush(struct preview_queue *queue,
+                           const android::sp<android::IMemory> &dataPtr)
+{
+   int32_t tail = queue->tail;
+
+   for (;;) {
+      int32_t           head = android_atomic_acquire_load(&queue->head);
+      android::IMemory *oldest;
+
+      if (tail - head < PREVIEW_QUEUE_SIZE) {
+         break;
+      }
+      oldest = queue->frames[head & (PREVIEW_QUEUE_SIZE - 1)];
+      if (android_atomic_release_cas(head, head + 1, &queue->head) == 0) {
+         oldest->decStrong(queue);
+         android_atomic_inc(&queue->dropped);
+         break;
+      }
+   }
+
+   dataPtr->incStrong(queue);
+   queue->frames[tail & (PREVIEW_QUEUE_SIZE - 1)] = dataPtr.get();
+   android_atomic_release_store(tail + 1, &queue->tail);
+   sem_post(&queue->pending);
+}
+
+/* Returns the oldest queued frame, which the caller must decStrong(queue). */
+android::IMemory *
+CameraHAL_PreviewQueuePop(struct preview_queue *queue)
+{
+   for (;;) {
+      int32_t           head = android_atomic_acquire_load(&queue->head);
+      int32_t           tail = android_atomic_acquire_load(&queue->tail);
+      android::IMemory *frame;
+
+      if (head == tail) {
+         return NULL;
+      }
+      frame = queue->frames[head & (PREVIEW_QUEUE_SIZE - 1)];
+      if (android_atomic_release_cas(head, head + 1, &queue->head) == 0) {
+         return frame;
+      }
+   }
+}
+
+void
+CameraHAL_RenderPreviewFrame(struct camera_hal_context *ctx,
+                             const android::sp<android::IMemory> &dataPtr)
+{
+   int32_t previewWidth, previewHeight;
+
+   CameraHAL_GetPreviewGeometry(ctx, &previewWidth, &previewHeight);
+   {
+      android::RWLock::AutoRLock lock(ctx->frameLock);
+      CameraHAL_HandlePreviewData(ctx, dataPtr, ctx->window,
+                                  previewWidth, previewHeight);
+   }
+   android_atomic_inc(&ctx->previewQueue.rendered);
+}
+
+class PreviewRenderThread : public android::Thread {
+public:
+   PreviewRenderThread(struct camera_hal_context *ctx)
+      : android::Thread(false), mCtx(ctx) { }
+
+   void stop() {
+      requestExit();
+      sem_post(&mCtx->previewQueue.pending);
+      requestExitAndWait();
+   }
+
+private:
+   struct camera_hal_context *mCtx;
+
+   virtual bool threadLoop() {
+      struct preview_queue *queue = &mCtx->previewQueue;
+      android::IMemory     *frame;
+
+      sem_wait(&queue->pending);
+      while ((frame = CameraHAL_PreviewQueuePop(queue)) != NULL) {
+         if (!exitPending()) {
+            CameraHAL_RenderPreviewFrame(mCtx, frame);
+         }
+         frame->decStrong(queue);
+      }
+      return !exitPending();
+   }
+};
+
+void
+CameraHAL_StartPreviewThread(struct camera_hal_context *ctx)
+{
+   char value[PROPERTY_VALUE_MAX];
+
+   property_get("persist.camera.preview.async", value, "0");
+   if (atoi(value) == 0 || ctx->previewThread != NULL) {
+      return;
+   }
+
+   ctx->previewQueue.head = ctx->previewQueue.tail = 0;
+   sem_init(&ctx->previewQueue.pending, 0, 0);
+   android::sp<android::Thread> thread = new PreviewRenderThread(ctx);
+   if (thread->run("CameraPreviewRender",
+                   android::PRIORITY_URGENT_DISPLAY) != NO_ERROR) {
+      LOGE("CameraHAL_StartPreviewThread: ERROR starting the thread\n");
+      sem_destroy(&ctx->previewQueue.pending);
+      return;
+   }
+   android::RWLock::AutoWLock lock(ctx->frameLock);
+   ctx->previewThread = thread;
+}
+
+/* The frame path queues to the thread with frameLock read-locked, so once
+ * the thread is unpublished under the write lock nothing posts to the
+ * semaphore any more and it can be destroyed. */
+void
+CameraHAL_StopPreviewThread(struct camera_hal_context *ctx)
+{
+   android::sp<android::Thread> thread;
+   android::IMemory            *frame;
+
+   {
+      android::RWLock::AutoWLock lock(ctx->frameLock);
+      thread = ctx->previewThread;
+      ctx->previewThread.clear();
+   }
+   if (thread == NULL) {
+      return;
+   }
+   static_cast<PreviewRenderThread *>(thread.get())->stop();
+   while ((frame = CameraHAL_PreviewQueuePop(&ctx->previewQueue)) != NULL) {
+      frame->decStrong(&ctx->previewQueue);
+   }
+   sem_destroy(&ctx->previewQueue.pending);
+}
+
+camera_memory_t *
+CameraHAL_GenClientData(const android::sp<android::IMemory> &dataPtr, 
+                        camera_request_memory reqClientMemory,
+                        void *user)
+{
+   ssize_t          offset;
+   size_t           size;
+   camera_memory_t *clientData = NULL;
+
+   android::sp<android::IMemoryHeap> mHeap = dataPtr->getMemory(&offset, &size);
+
+   LOGV("CameraHAL_GenClientData: offset:%#x size:%#x base:%p\n",
+        (unsigned)offset, size, mHeap != NULL ? mHeap->base() : 0);
+
+   clientData = reqClientMemory(-1, size, 1, user);
+   if (clientData != NULL) {
+      memcpy(clientData->data, (char *)(mHeap->base()) + offset, size);
+   } else {
+      LOGV("CameraHAL_GenClientData: ERROR allocating memory from client\n");
+   }
+   return clientData;
+}
+
+/* Called with clientHeap->lock held and nothing posting. */
+void
+CameraHAL_ClearPreviewClientHeap(struct preview_client_heap *clientHeap)
+{
+   if (clientHeap->mem != NULL) {
+      LOGV("CameraHAL_ClearPreviewClientHeap: mem:%p wrapped:%d\n",
+           clientHeap->mem, clientHeap->wrapped);
+      clientHeap->mem->release(clientHeap->mem);
+   }
+   clientHeap->mem       = NULL;
+   clientHeap->heapBase  = NULL;
+   clientHeap->frameSize = 0;
+   clientHeap->count     = 0;
+   clientHeap->next      = 0;
+   clientHeap->wrapped   = false;
+   clientHeap->rotated   = false;
+}
+
+/* Waits for a frame still being posted to the client, then releases. */
+void
+CameraHAL_ReleasePreviewClientHeap(struct preview_client_heap *clientHeap)
+{
+   android::Mutex::Autolock lock(clientHeap->lock);
+
+   while (clientHeap->posting > 0) {
+      clientHeap->idle.wait(clientHeap->lock);
+   }
+   CameraHAL_ClearPreviewClientHeap(clientHeap);
+}
+
+/*
+ * Wrapping the vendor heap makes the framework mmap its fd once more. pmem
+ * only lets a file be mapped once, and a failed map leaves the client
+ * memory pointing at MAP_FAILED, so the fd is tried here first.
+ */
+bool
+CameraHAL_HeapIsMappable(int fd, size_t size)
+{
+   void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+   if (base == MAP_FAILED) {
+      LOGD("CameraHAL_HeapIsMappable: fd:%d can't be mapped again: %s\n",
+           fd, strerror(errno));
+      return false;
+   }
+   munmap(base, size);
+   return true;
+}
+
+bool
+CameraHAL_SetupPreviewClientHeap(struct preview_client_heap *clientHeap,
+                                 const android::sp<android::IMemoryHeap> &heap,
+                                 ssize_t offset, size_t size, bool rotate,
+                                 camera_request_memory reqClientMemory,
+                                 void *user)
+{
+   size_t heapSize = heap->getSize();
+
+   CameraHAL_ClearPreviewClientHeap(clientHeap);
+
+   /* The framework maps an fd based client memory as count equally sized
+    * buffers, so the vendor frames must tile its heap exactly. Rotated
+    * frames can only be copies. */
+   if (!rotate && size > 0 && heap->getOffset() == 0 &&
+       (offset % size) == 0 && (heapSize % size) == 0 &&
+       CameraHAL_HeapIsMappable(heap->getHeapID(), heapSize)) {
+      clientHeap->mem = reqClientMemory(heap->getHeapID(), size,
+                                        heapSize / size, user);
+      if (clientHeap->mem != NULL && clientHeap->mem->data != NULL &&
+          clientHeap->mem->data != MAP_FAILED) {
+         clientHeap->count   = heapSize / size;
+         clientHeap->wrapped = true;
+      } else {
+         LOGW("CameraHAL_SetupPreviewClientHeap: can't share heap fd:%d\n",
+              heap->getHeapID());
+         CameraHAL_ClearPreviewClientHeap(clientHeap);
+      }
+   }
+
+   if (clientHeap->mem == NULL) {
+      clientHeap->mem = reqClientMemory(-1, size, PREVIEW_CLIENT_BUFFERS,
+                                        user);
+      if (clientHeap->mem == NULL || clientHeap->mem->data == NULL) {
+         LOGE("CameraHAL_SetupPreviewClientHeap: ERROR allocating memory "
+              "from client\n");
+         CameraHAL_ClearPreviewClientHeap(clientHeap);
+         return false;
+      }
+      clientHeap->count = PREVIEW_CLIENT_BUFFERS;
+   }
+
+   clientHeap->heapBase  = heap->base();
+   clientHeap->frameSize = size;
+   clientHeap->rotated   = rotate;
+   LOGD("CameraHAL_SetupPreviewClientHeap: %s %u x %u bytes\n",
+        clientHeap->wrapped ? "sharing vendor heap" :
+           rotate ? "rotated copy ring" : "copy ring",
+        clientHeap->count, size);
+   return true;
+}
+
+/* Returns the client memory holding the preview frame in dataPtr and its
+ * buffer index within it, turned into portrait when rotateWidth and
+ * rotateHeight give the frame's size. Called with clientHeap->lock held. */
+camera_memory_t *
+CameraHAL_GetPreviewClientData(struct preview_client_heap *clientHeap,
+                               const android::sp<android::IMemory> &dataPtr,
+                               int32_t rotateWidth, int32_t rotateHeight,
+                               camera_request_memory reqClientMemory,
+                               void *user, unsigned int *index)
+{
+   ssize_t offset;
+   size_t  size;
+   bool    rotate = rotateWidth > 0;
+   android::sp<android::IMemoryHeap> mHeap = dataPtr->getMemory(&offset,
+                                                                &size);
+
+   if (mHeap == NULL) {
+      return NULL;
+   }
+   if (rotate && size != (size_t)rotateWidth * rotateHeight * 3 / 2) {
+      /* Not the preview size; it can't be sent as a portrait frame. */
+      LOGV("CameraHAL_GetPreviewClientData: %u bytes for %dx%d, dropped\n",
+           size, rotateWidth, rotateHeight);
+      return NULL;
+   }
+
+   if (clientHeap->mem == NULL || clientHeap->heapBase != mHeap->base() ||
+       clientHeap->frameSize != size || clientHeap->rotated != rotate) {
+      if (!CameraHAL_SetupPreviewClientHeap(clientHeap, mHeap, offset, size,
+                                            rotate, reqClientMemory, user)) {
+         return NULL;
+      }
+   }
+
+   if (clientHeap->wrapped) {
+      *index = offset / size;
+   } else {
+      *index = clientHeap->next;
+      clientHeap->next = (clientHeap->next + 1) % clientHeap->count;
+      if (rotate) {
+         yuv420sp_rotate90((const uint8_t *)mHeap->base() + offset,
+                           (uint8_t *)clientHeap->mem->data + *index * size,
+                           rotateWidth, rotateHeight);
+      } else {
+         memcpy((char *)clientHeap->mem->data + *index * size,
+                (char *)mHeap->base() + offset, size);
+      }
+   }
+   return clientHeap->mem;
+}
+
+void
+CameraHAL_SetPacerRate(struct frame_pacer *pacer, int fps)
+{
+   android_atomic_release_store(fps > 0 ? 1000000 / fps : 0,
+                                &pacer->intervalUs);
+}
+
+bool
+CameraHAL_PacerAdmit(struct frame_pacer *pacer, nsecs_t now)
+{
+   nsecs_t interval =
+      (nsecs_t)android_atomic_acquire_load(&pacer->intervalUs) * 1000;
+
+   /* Frames arrive on the sensor's own clock, so accept one that is a
+    * little early rather than waiting a whole extra frame for it. */
+   if (interval != 0 && now < pacer->next - interval / 4) {
+      android_atomic_inc(&pacer->skipped);
+      return false;
+   }
+   if (now - pacer->next > interval) {
+      pacer->next = now + interval;
+   } else {
+      pacer->next += interval;
+   }
+   android_atomic_inc(&pacer->passed);
+   return true;
+}
+
+static const char *const throttleKeys[] = {
+   "preview-render-fps-max", "preview-callback-fps-max"
+};
+
+/*
+ * Resolves the render and client callback rate limits, picking up the
+ * parameters from params when given. The preview-render-fps-max and
+ * preview-callback-fps-max parameters take precedence over the
+ * persist.camera.preview.render_fps and persist.camera.preview.callback_fps
+ * properties; 0 means no limit and -1 goes back to the property. A set
+ * without the key keeps the last value.
+ */
+void
+CameraHAL_UpdatePreviewThrottle(struct camera_hal_context *ctx,
+                                const android::CameraParameters *params)
+{
+   static const char *const properties[] = {
+      "persist.camera.preview.render_fps", "persist.camera.preview.callback_fps"
+   };
+   struct frame_pacer *pacers[] = { &ctx->renderPacer, &ctx->callbackPacer };
+   char value[PROPERTY_VALUE_MAX];
+
+   for (int i = 0; i < 2; i++) {
+      int fps;
+
+      if (params != NULL && params->get(throttleKeys[i]) != NULL) {
+         ctx->throttleParams[i] = params->getInt(throttleKeys[i]);
+      }
+      fps = ctx->throttleParams[i];
+      if (fps < 0) {
+         property_get(properties[i], value, "0");
+         fps = atoi(value);
+      }
+      CameraHAL_SetPacerRate(pacers[i], fps);
+   }
+}
+
+/* Adds the wrapper's own parameters, which the vendor library doesn't
+ * report back, so that they survive a get/set round trip. */
+void
+CameraHAL_PublishWrapperParams(struct camera_hal_context *ctx,
+                               android::CameraParameters &settings)
+{
+   for (int i = 0; i < 2; i++) {
+      if (ctx->throttleParams[i] >= 0) {
+         settings.set(throttleKeys[i], ctx->throttleParams[i]);
+      }
+   }
+   if (ctx->burstShots >= 0) {
+      settings.set("burst-count", ctx->burstShots);
+   }
+   if (ctx->zslEnabled) {
+      settings.set("zsl", "on");
+   }
+}
+
+/* Ends the current burst; called with burst->lock held. */
+void
+CameraHAL_BurstFinish(struct burst_capture *burst)
+{
+   if (burst->requested > 1) {
+      burst->bursts++;
+      burst->shots     += burst->taken;
+      burst->totalTime += systemTime() - burst->start;
+   }
+   burst->requested    = burst->taken = 0;
+   burst->shotDue      = false;
+   burst->lastDelivery = systemTime();
+   burst->cond.broadcast();
+}
+
+class BurstCaptureThread : public android::Thread {
+public:
+   BurstCaptureThread(struct camera_hal_context *ctx)
+      : android::Thread(false), mCtx(ctx) { }
+
+   void stop() {
+      requestExit();
+      {
+         android::Mutex::Autolock lock(mCtx->burst.lock);
+         mCtx->burst.cond.broadcast();
+      }
+      requestExitAndWait();
+   }
+
+private:
+   struct camera_hal_context *mCtx;
+
+   virtual bool threadLoop() {
+      struct burst_capture   *burst = &mCtx->burst;
+      struct camera_callbacks cb;
+      camera_memory_t        *jpeg = NULL;
+      bool                    shot;
+
+      {
+         android::Mutex::Autolock lock(burst->lock);
+         while (!exitPending() && !burst->shotDue &&
+                burst->deliveriesDue == 0) {
+            burst->cond.wait(burst->lock);
+         }
+         if (exitPending()) {
+            return false;
+         }
+         shot = burst->shotDue;
+         burst->shotDue = false;
+         if (!shot) {
+            burst->deliveriesDue--;
+            jpeg = burst->queued[0];
+            burst->numQueued--;
+            memmove(&burst->queued[0], &burst->queued[1],
+                    burst->numQueued * sizeof(burst->queued[0]));
+         }
+      }
+
+      if (shot) {
+         android::Mutex::Autolock control(mCtx->controlLock);
+         {
+            /* cancel_picture may have ended the burst in the meantime. */
+            android::Mutex::Autolock lock(burst->lock);
+            if (exitPending() || burst->requested <= 1) {
+               return !exitPending();
+            }
+         }
+         /* The framework turned compressed images off after the first. */
+         mCtx->qCamera->enableMsgType(CAMERA_MSG_COMPRESSED_IMAGE);
+         if (mCtx->qCamera->takePicture() != NO_ERROR) {
+            LOGE("BurstCaptureThread: takePicture failed, ending burst\n");
+            android::Mutex::Autolock lock(burst->lock);
+            CameraHAL_BurstFinish(burst);
+         }
+      } else {
+         CameraHAL_GetCallbacks(mCtx, &cb);
+         if (cb.notify != NULL) {
+            cb.notify(CAMERA_MSG_SHUTTER, 0, 0, cb.user);
+         }
+         if (cb.data != NULL) {
+            cb.data(CAMERA_MSG_COMPRESSED_IMAGE, jpeg, 0, NULL, cb.user);
+         }
+         jpeg->release(jpeg);
+      }
+      return true;
+   }
+};
+
+void
+CameraHAL_BurstDropQueued(struct burst_capture *burst)
+{
+   for (unsigned int i = 0; i < burst->numQueued; i++) {
+      burst->queued[i]->release(burst->queued[i]);
+   }
+   burst->numQueued     = 0;
+   burst->deliveriesDue = 0;
+   burst->generation++;
+}
+
+/* Answers take_picture with a queued JPEG, if there is one left over. */
+bool
+CameraHAL_BurstTakeQueued(struct camera_hal_context *ctx)
+{
+   struct burst_capture *burst = &ctx->burst;
+   android::Mutex::Autolock lock(burst->lock);
+   nsecs_t now = systemTime();
+
+   if (burst->requested <= 1 && burst->deliveriesDue == 0 &&
+       burst->numQueued > 0 &&
+       now - burst->lastDelivery > BURST_QUEUE_TIMEOUT) {
+      LOGD("CameraHAL_BurstTakeQueued: dropping %u stale pictures\n",
+           burst->numQueued);
+      CameraHAL_BurstDropQueued(burst);
+   }
+   if (ctx->burstThread == NULL || burst->numQueued <= burst->deliveriesDue) {
+      return false;
+   }
+   burst->deliveriesDue++;
+   burst->lastDelivery = now;
+   burst->cond.broadcast();
+   return true;
+}
+
+/* Drops the pictures left over from a burst. */
+void
+CameraHAL_BurstFlush(struct camera_hal_context *ctx)
+{
+   android::Mutex::Autolock lock(ctx->burst.lock);
+
+   if (ctx->burst.numQueued > 0) {
+      LOGV("CameraHAL_BurstFlush: dropping %u pictures\n",
+           ctx->burst.numQueued);
+   }
+   CameraHAL_BurstDropQueued(&ctx->burst);
+}
+
+/* Sets up a burst of the given number of shots before takePicture. */
+void
+CameraHAL_BurstBegin(struct camera_hal_context *ctx, int shots)
+{
+   struct burst_capture *burst = &ctx->burst;
+
+   if (shots > 1 && ctx->burstThread == NULL) {
+      ctx->burstThread = new BurstCaptureThread(ctx);
+      if (ctx->burstThread->run("CameraBurstCapture") != NO_ERROR) {
+         LOGE("CameraHAL_BurstBegin: ERROR starting the thread\n");
+         ctx->burstThread.clear();
+      }
+   }
+
+   android::Mutex::Autolock lock(burst->lock);
+   CameraHAL_BurstDropQueued(burst);
+   burst->requested = ctx->burstThread != NULL ?
+                         (shots < BURST_MAX_SHOTS ? shots : BURST_MAX_SHOTS) :
+                         0;
+   burst->taken     = 0;
+   burst->shotDue   = false;
+   burst->start     = systemTime();
+}
+
+/* Waits for the vendor to finish the shots of a burst. */
+void
+CameraHAL_BurstWait(struct camera_hal_context *ctx)
+{
+   struct burst_capture *burst = &ctx->burst;
+   android::Mutex::Autolock lock(burst->lock);
+
+   while (burst->requested > 1) {
+      if (burst->cond.waitRelative(burst->lock, BURST_TIMEOUT) != NO_ERROR) {
+         LOGE("CameraHAL_BurstWait: timed out after %d of %d shots\n",
+              burst->taken, burst->requested);
+         CameraHAL_BurstFinish(burst);
+      }
+   }
+}
+
+void
+CameraHAL_StopBurst(struct camera_hal_context *ctx)
+{
+   if (ctx->burstThread != NULL) {
+      static_cast<BurstCaptureThread *>(ctx->burstThread.get())->stop();
+      ctx->burstThread.clear();
+   }
+   android::Mutex::Autolock lock(ctx->burst.lock);
+   CameraHAL_BurstFinish(&ctx->burst);
+   CameraHAL_BurstDropQueued(&ctx->burst);
+}
+
+/* Only the first shot of a burst is announced to the framework. */
+bool
+CameraHAL_BurstFilterNotify(struct camera_hal_context *ctx, int32_t msg_type)
+{
+   struct burst_capture *burst = &ctx->burst;
+   android::Mutex::Autolock lock(burst->lock);
+
+   if (burst->requested <= 1) {
+      return false;
+   }
+   if (msg_type == CAMERA_MSG_ERROR) {
+      CameraHAL_BurstFinish(burst);
+      return false;
+   }
+   return msg_type == CAMERA_MSG_SHUTTER && burst->taken > 0;
+}
+
+/* Returns true if a burst took over the data message. */
+bool
+CameraHAL_BurstFilterData(struct camera_hal_context *ctx, int32_t msg_type,
+                          const android::sp<android::IMemory> &dataPtr,
+                          const struct camera_callbacks *cb)
+{
+   struct burst_capture *burst = &ctx->burst;
+   camera_memory_t      *jpeg = NULL;
+   unsigned int          generation;
+   bool                  queue;
+
+   {
+      android::Mutex::Autolock lock(burst->lock);
+
+      if (burst->requested <= 1) {
+         return false;
+      }
+      if (msg_type != CAMERA_MSG_COMPRESSED_IMAGE) {
+         return burst->taken > 0 && (msg_type == CAMERA_MSG_RAW_IMAGE ||
+                                     msg_type == CAMERA_MSG_POSTVIEW_FRAME);
+      }
+      queue      = burst->taken > 0;
+      generation = burst->generation;
+   }
+
+   /* The copy goes through the framework, so it is made unlocked. */
+   if (queue && cb->requestMemory != NULL) {
+      jpeg = CameraHAL_GenClientData(dataPtr, cb->requestMemory, cb->user);
+   }
+
+   android::Mutex::Autolock lock(burst->lock);
+   if (burst->requested <= 1) {
+      /* cancel_picture ended the burst meanwhile. */
+      if (jpeg != NULL) {
+         jpeg->release(jpeg);
+      }
+      return queue;
+   }
+   if (++burst->taken > 1 && jpeg != NULL) {
+      if (burst->generation == generation) {
+         burst->queued[burst->numQueued++] = jpeg;
+      } else {
+         /* Flushed meanwhile, as taken with the old settings. */
+         jpeg->release(jpeg);
+      }
+   }
+   LOGV("CameraHAL_BurstFilterData: shot %d of %d\n", burst->taken,
+        burst->requested);
+   if (burst->taken < burst->requested) {
+      burst->shotDue = true;
+      burst->cond.broadcast();
+      return burst->taken > 1;
+   }
+   CameraHAL_BurstFinish(burst);
+   return true;
+}
+
+void
+CameraHAL_FreeZslRing(struct zsl_ring *ring)
+{
+   android::Mutex::Autolock lock(ring->lock);
+
+   /* The capture thread encodes straight out of the ring. */
+   while (ring->pending >= 0) {
+      ring->cond.wait(ring->lock);
+   }
+   for (int i = 0; i < ZSL_RING_FRAMES; i++) {
+      while (ring->state[i] == ZSL_SLOT_FILLING ||
+             ring->state[i] == ZSL_SLOT_ENCODING) {
+         ring->cond.wait(ring->lock);
+      }
+      ring->state[i] = ZSL_SLOT_EMPTY;
+   }
+   android_atomic_release_store(0, &ring->enabled);
+   free(ring->buffer);
+   ring->buffer    = NULL;
+   ring->frameSize = 0;
+}
+
+bool
+CameraHAL_AllocZslRing(struct zsl_ring *ring, int32_t width, int32_t height)
+{
+   CameraHAL_FreeZslRing(ring);
+
+   android::Mutex::Autolock lock(ring->lock);
+   ring->frameSize = width * height * 3 / 2;
+   ring->buffer    = (uint8_t *)malloc(ring->frameSize * ZSL_RING_FRAMES);
+   if (ring->buffer == NULL) {
+      LOGE("CameraHAL_AllocZslRing: ERROR allocating %d x %u bytes\n",
+           ZSL_RING_FRAMES, ring->frameSize);
+      ring->frameSize = 0;
+      return false;
+   }
+   ring->width  = width;
+   ring->height = height;
+   ring->next   = 0;
+   android_atomic_release_store(1, &ring->enabled);
+   LOGV("CameraHAL_AllocZslRing: %d x %dx%d\n", ZSL_RING_FRAMES, width,
+        height);
+   return true;
+}
+
+/* Keeps a copy of a preview frame, replacing the oldest one not in use. */
+void
+CameraHAL_ZslPutFrame(struct zsl_ring *ring,
+                      const android::sp<android::IMemory> &dataPtr,
+                      nsecs_t arrival)
+{
+   ssize_t offset;
+   size_t  size;
+   int     slot = -1;
+   android::sp<android::IMemoryHeap> heap;
+
+   /* Most previews run without ZSL, so skip the lock for them. */
+   if (!android_atomic_acquire_load(&ring->enabled)) {
+      return;
+   }
+   heap = dataPtr->getMemory(&offset, &size);
+   {
+      android::Mutex::Autolock lock(ring->lock);
+      if (ring->buffer == NULL || size < ring->frameSize) {
+         return;
+      }
+      for (int i = 0; i < ZSL_RING_FRAMES && slot < 0; i++) {
+         unsigned int candidate = (ring->next + i) % ZSL_RING_FRAMES;
+         if (ring->state[candidate] == ZSL_SLOT_EMPTY ||
+             ring->state[candidate] == ZSL_SLOT_READY) {
+            slot = candidate;
+         }
+      }
+      if (slot < 0) {
+         return;
+      }
+      ring->state[slot] = ZSL_SLOT_FILLING;
+      ring->next        = (slot + 1) % ZSL_RING_FRAMES;
+   }
+
+   memcpy(ring->buffer + slot * ring->frameSize,
+          (uint8_t *)heap->base() + offset, ring->frameSize);
+
+   android::Mutex::Autolock lock(ring->lock);
+   ring->stamp[slot] = arrival;
+   ring->state[slot] = ZSL_SLOT_READY;
+   ring->cond.broadcast();
+}
+
+/* Hands the frame closest to now to the capture thread. Returns false if
+ * there is none, a capture is still being encoded, or the preview frames
+ * aren't the picture size asked for. */
+bool
+CameraHAL_ZslRequest(struct zsl_ring *ring, int width, int height,
+                     int rotation, int quality)
+{
+   android::Mutex::Autolock lock(ring->lock);
+   nsecs_t now  = systemTime();
+   nsecs_t best = 0;
+   int     slot = -1;
+
+   if (ring->pending >= 0) {
+      return false;
+   }
+   if (ring->width != width || ring->height != height) {
+      LOGV("CameraHAL_ZslRequest: ring is %dx%d, picture is %dx%d\n",
+           ring->width, ring->height, width, height);
+      return false;
+   }
+   for (int i = 0; i < ZSL_RING_FRAMES; i++) {
+      nsecs_t lag = ring->stamp[i] > now ? ring->stamp[i] - now :
+                                           now - ring->stamp[i];
+      if (ring->state[i] == ZSL_SLOT_READY && (slot < 0 || lag < best)) {
+         slot = i;
+         best = lag;
+      }
+   }
+   if (slot < 0) {
+      return false;
+   }
+   ring->state[slot] = ZSL_SLOT_ENCODING;
+   ring->pending     = slot;
+   ring->requested   = now;
+   ring->rotation    = rotation;
+   ring->quality     = quality;
+   ring->cond.broadcast();
+   return true;
+}
+
+/* Hands an encoded picture to the client, or an error if jpeg is NULL.
+ * Called with no locks held. */
+void
+CameraHAL_PostJpeg(struct camera_callbacks *cb, const uint8_t *jpeg,
+                   size_t size)
+{
+   camera_memory_t *clientData = NULL;
+
+   if (jpeg == NULL) {
+      if (cb->notify != NULL) {
+         cb->notify(CAMERA_MSG_ERROR, CAMERA_ERROR_UNKNOWN, 0, cb->user);
+      }
+      return;
+   }
+   if (cb->data == NULL || cb->requestMemory == NULL) {
+      return;
+   }
+   clientData = cb->requestMemory(-1, size, 1, cb->user);
+   if (clientData != NULL && clientData->data != NULL) {
+      memcpy(clientData->data, jpeg, size);
+      cb->data(CAMERA_MSG_COMPRESSED_IMAGE, clientData, 0, NULL, cb->user);
+   }
+   if (clientData != NULL) {
+      clientData->release(clientData);
+   }
+}
+
+class ZslCaptureThread : public android::Thread {
+public:
+   ZslCaptureThread(struct camera_hal_context *ctx)
+      : android::Thread(false), mCtx(ctx) { }
+
+   void stop() {
+      requestExit();
+      {
+         android::Mutex::Autolock lock(mCtx->zslRing.lock);
+         mCtx->zslRing.cond.broadcast();
+      }
+      requestExitAndWait();
+   }
+
+private:
+   struct camera_hal_context *mCtx;
+
+   virtual bool threadLoop() {
+      struct zsl_ring        *ring = &mCtx->zslRing;
+      struct camera_callbacks cb;
+      const uint8_t          *frame;
+      uint8_t                *jpeg = NULL;
+      size_t                  jpegSize = 0;
+      int32_t                 width, height;
+      int                     slot, rotation, quality;
+      nsecs_t                 start;
+
+      {
+         android::Mutex::Autolock lock(ring->lock);
+         while (!exitPending() && ring->pending < 0) {
+            ring->cond.wait(ring->lock);
+         }
+         if (exitPending()) {
+            return false;
+         }
+         slot   = ring->pending;
+         frame  = ring->buffer + slot * ring->frameSize;
+         width    = ring->width;
+         height   = ring->height;
+         rotation = ring->rotation;
+         quality  = ring->quality;
+      }
+
+      CameraHAL_GetCallbacks(mCtx, &cb);
+      if (cb.notify != NULL) {
+         cb.notify(CAMERA_MSG_SHUTTER, 0, 0, cb.user);
+      }
+      start = systemTime();
+      if (jpeg_encode_nv21(frame, width, height, quality, rotation, &jpeg,
+                           &jpegSize) == 0) {
+         nsecs_t encodeTime = systemTime() - start;
+
+         {
+            android::Mutex::Autolock lock(ring->lock);
+            ring->captures++;
+            ring->totalEncode += encodeTime;
+            ring->totalLag += ring->stamp[slot] > ring->requested ?
+                                 ring->stamp[slot] - ring->requested :
+                                 ring->requested - ring->stamp[slot];
+            ring->state[slot] = ZSL_SLOT_READY;
+            ring->pending     = -1;
+            ring->cond.broadcast();
+         }
+         CameraHAL_PostJpeg(&cb, jpeg, jpegSize);
+         free(jpeg);
+      } else {
+         LOGE("ZslCaptureThread: ERROR encoding %dx%d\n", width, height);
+         {
+            android::Mutex::Autolock lock(ring->lock);
+            ring->state[slot] = ZSL_SLOT_READY;
+            ring->pending     = -1;
+            ring->cond.broadcast();
+         }
+         CameraHAL_PostJpeg(&cb, NULL, 0);
+      }
+      return true;
+   }
+};
+
+bool
+CameraHAL_ZslCapture(struct camera_hal_context *ctx)
+{
+   if (ctx->zslThread == NULL) {
+      ctx->zslThread = new ZslCaptureThread(ctx);
+      if (ctx->zslThread->run("CameraZslCapture") != NO_ERROR) {
+         LOGE("CameraHAL_ZslCapture: ERROR starting the thread\n");
+         ctx->zslThread.clear();
+         return false;
+      }
+   }
+   return CameraHAL_ZslRequest(&ctx->zslRing, ctx->pictureWidth,
+                               ctx->pictureHeight, ctx->jpegRotation,
+                               ctx->jpegQuality);
+}
+
+void
+CameraHAL_StopZsl(struct camera_hal_context *ctx)
+{
+   if (ctx->zslThread != NULL) {
+      static_cast<ZslCaptureThread *>(ctx->zslThread.get())->stop();
+      ctx->zslThread.clear();
+   }
+   {
+      android::Mutex::Autolock lock(ctx->zslRing.lock);
+      if (ctx->zslRing.pending >= 0) {
+         ctx->zslRing.state[ctx->zslRing.pending] = ZSL_SLOT_READY;
+         ctx->zslRing.pending = -1;
+      }
+   }
+   CameraHAL_FreeZslRing(&ctx->zslRing);
+}
+
+/* Keys get_parameters adds for luma-stats; they are not settings. */
+static const char *lumaStatsKeys[] = {
+   "luma-stats-frame",
+   "luma-mean",
+   "luma-focus-score",
+   "luma-histogram",
+};
+
+void
+CameraHAL_UpdateLumaStats(struct camera_hal_context *ctx,
+                          const android::sp<android::IMemory> &dataPtr)
+{
+   struct luma_stats stats;
+   int32_t           previewWidth, previewHeight;
+   ssize_t           offset;
+   size_t            size;
+   nsecs_t           start;
+
+   android::sp<android::IMemoryHeap> heap = dataPtr->getMemory(&offset, &size);
+   CameraHAL_GetPreviewGeometry(ctx, &previewWidth, &previewHeight);
+   if (size < (size_t)(previewWidth * previewHeight)) {
+      return;
+   }
+   start = systemTime();
+   luma_stats_compute((uint8_t *)heap->base() + offset, previewWidth,
+                      previewHeight, &stats);
+   frame_stats_record(&ctx->frameStats[FRAME_STAGE_LUMA_STATS],
+                      systemTime() - start);
+
+   android::Mutex::Autolock lock(ctx->lumaStatsLock);
+   ctx->lumaStats = stats;
+   ctx->lumaStatsFrames++;
+}
+
+void
+CameraHAL_AppendLumaStats(struct camera_hal_context *ctx,
+                          android::String8 &params)
+{
+   android::Mutex::Autolock lock(ctx->lumaStatsLock);
+
+   if (ctx->lumaStatsFrames == 0) {
+      return;
+   }
+   params.appendFormat(";%s=%u;%s=%u;%s=%u;%s=", lumaStatsKeys[0],
+                       ctx->lumaStatsFrames, lumaStatsKeys[1],
+                       ctx->lumaStats.mean, lumaStatsKeys[2],
+                       ctx->lumaStats.focus, lumaStatsKeys[3]);
+   for (int i = 0; i < LUMA_HIST_BINS; i++) {
+      params.appendFormat(i ? ",%u" : "%u", ctx->lumaStats.histogram[i]);
+   }
+}
+
+unsigned int
+CameraHAL_RecordingFramesDropped(struct recording_pool *pool)
+{
+   android::Mutex::Autolock lock(pool->lock);
+   return pool->framesDropped;
+}
+
+class VideoSnapshotThread : public android::Thread {
+public:
+   VideoSnapshotThread(struct camera_hal_context *ctx)
+      : android::Thread(false), mCtx(ctx) { }
+
+   void stop() {
+      requestExit();
+      {
+         android::Mutex::Autolock lock(mCtx->videoSnapshot.lock);
+         mCtx->videoSnapshot.cond.broadcast();
+      }
+      requestExitAndWait();
+   }
+
+private:
+   struct camera_hal_context *mCtx;
+
+   virtual bool threadLoop() {
+      struct video_snapshot  *snap = &mCtx->videoSnapshot;
+      struct camera_callbacks cb;
+      uint8_t                *jpeg = NULL;
+      size_t                  jpegSize = 0;
+      nsecs_t                 latency;
+      unsigned int            dropped;
+      int                     rc;
+
+      {
+         android::Mutex::Autolock lock(snap->lock);
+         while (!exitPending() && !snap->captured) {
+            snap->cond.wait(snap->lock);
+         }
+         if (exitPending()) {
+            return false;
+         }
+      }
+
+      /* frame stays ours until it is freed below. */
+      CameraHAL_GetCallbacks(mCtx, &cb);
+      if (cb.notify != NULL) {
+         cb.notify(CAMERA_MSG_SHUTTER, 0, 0, cb.user);
+      }
+      rc = jpeg_encode_nv21(snap->frame, snap->width, snap->height,
+                            snap->quality, snap->rotation, &jpeg,
+                            &jpegSize);
+      if (rc != 0) {
+         LOGE("VideoSnapshotThread: ERROR encoding %dx%d\n", snap->width,
+              snap->height);
+      }
+      CameraHAL_PostJpeg(&cb, rc == 0 ? jpeg : NULL, jpegSize);
+      free(jpeg);
+
+      dropped = CameraHAL_RecordingFramesDropped(&mCtx->recordingPool);
+      android::Mutex::Autolock lock(snap->lock);
+      latency = systemTime() - snap->requestTime;
+      snap->taken++;
+      snap->dropped      += dropped - snap->droppedAtRequest;
+      snap->totalLatency += latency;
+      if (latency > snap->maxLatency) {
+         snap->maxLatency = latency;
+      }
+      free(snap->frame);
+      snap->frame    = NULL;
+      snap->captured = false;
+      snap->cond.broadcast();
+      LOGD("VideoSnapshotThread: %dx%d in %lldms\n", snap->width,
+           snap->height, ns2ms(latency));
+      return true;
+   }
+};
+
+/* Arms a grab of the next recording frame; the picture follows from
+ * VideoSnapshotThread. */
+int
+CameraHAL_VideoSnapshot(struct camera_hal_context *ctx)
+{
+   struct video_snapshot *snap = &ctx->videoSnapshot;
+
+   if (ctx->videoSnapshotThread == NULL) {
+      ctx->videoSnapshotThread = new VideoSnapshotThread(ctx);
+      if (ctx->videoSnapshotThread->run("CameraVideoSnapshot") != NO_ERROR) {
+         LOGE("CameraHAL_VideoSnapshot: ERROR starting the thread\n");
+         ctx->videoSnapshotThread.clear();
+         return -EIO;
+      }
+   }
+
+   android::Mutex::Autolock lock(snap->lock);
+   if (snap->frame != NULL) {
+      LOGW("CameraHAL_VideoSnapshot: snapshot already in progress\n");
+      return -EBUSY;
+   }
+   if (snap->width <= 0 || snap->height <= 0) {
+      return -EINVAL;
+   }
+   snap->frameSize = snap->width * snap->height * 3 / 2;
+   snap->frame     = (uint8_t *)malloc(snap->frameSize);
+   if (snap->frame == NULL) {
+      return -ENOMEM;
+   }
+   snap->captured         = false;
+   snap->rotation         = ctx->jpegRotation;
+   snap->quality          = ctx->jpegQuality;
+   snap->requestTime      = systemTime();
+   snap->droppedAtRequest =
+      CameraHAL_RecordingFramesDropped(&ctx->recordingPool);
+   android_atomic_release_store(1, &snap->requested);
+   return NO_ERROR;
+}
+
+/* Called for every recording frame; only copies when a snapshot is armed. */
+void
+CameraHAL_VideoSnapshotGrab(struct video_snapshot *snap,
+                            const android::sp<android::IMemory> &dataPtr)
+{
+   ssize_t offset;
+   size_t  size;
+
+   if (!android_atomic_acquire_load(&snap->requested)) {
+      return;
+   }
+
+   android::sp<android::IMemoryHeap> heap = dataPtr->getMemory(&offset, &size);
+   android::Mutex::Autolock lock(snap->lock);
+   if (!snap->requested || snap->frame == NULL) {
+      return;
+   }
+   if (size < snap->frameSize) {
+      LOGW("CameraHAL_VideoSnapshotGrab: frame of %u bytes, expected %u\n",
+           size, snap->frameSize);
+      memset(snap->frame + size, 0, snap->frameSize - size);
+   }
+   memcpy(snap->frame, (uint8_t *)heap->base() + offset,
+          size < snap->frameSize ? size : snap->frameSize);
+   android_atomic_release_store(0, &snap->requested);
+   snap->captured = true;
+   snap->cond.broadcast();
+}
+
+/* Drops a snapshot that is still waiting for a recording frame. */
+void
+CameraHAL_CancelVideoSnapshot(struct camera_hal_context *ctx)
+{
+   struct video_snapshot *snap = &ctx->videoSnapshot;
+   android::Mutex::Autolock lock(snap->lock);
+
+   if (snap->requested) {
+      LOGW("CameraHAL_CancelVideoSnapshot: recording stopped before the "
+           "snapshot frame\n");
+      android_atomic_release_store(0, &snap->requested);
+      free(snap->frame);
+      snap->frame = NULL;
+   }
+}
+
+void
+CameraHAL_StopVideoSnapshot(struct camera_hal_context *ctx)
+{
+   if (ctx->videoSnapshotThread != NULL) {
+      static_cast<VideoSnapshotThread *>(
+         ctx->videoSnapshotThread.get())->stop();
+      ctx->videoSnapshotThread.clear();
+   }
+   CameraHAL_CancelVideoSnapshot(ctx);
+
+   android::Mutex::Autolock lock(ctx->videoSnapshot.lock);
+   free(ctx->videoSnapshot.frame);
+   ctx->videoSnapshot.frame    = NULL;
+   ctx->videoSnapshot.captured = false;
+}
+
+void
+CameraHAL_PostPreviewFrame(struct camera_hal_context *ctx,
+                           const struct camera_callbacks *cb,
+                           const android::sp<android::IMemory> &dataPtr)
+{
+   struct preview_client_heap *clientHeap = &ctx->previewClientHeap;
+   unsigned int                index;
+   nsecs_t                     start = systemTime();
+   camera_memory_t            *clientData;
+   int32_t                     rotateWidth = 0, rotateHeight = 0;
+
+   if (ctx->rotatePreview) {
+      CameraHAL_GetPreviewGeometry(ctx, &rotateWidth, &rotateHeight);
+   }
+   {
+      android::Mutex::Autolock lock(clientHeap->lock);
+      clientData = CameraHAL_GetPreviewClientData(clientHeap, dataPtr,
+                                                  rotateWidth, rotateHeight,
+                                                  cb->requestMemory,
+                                                  cb->user, &index);
+      if (clientData != NULL) {
+         clientHeap->posting++;
+      }
+   }
+   frame_stats_record(&ctx->frameStats[FRAME_STAGE_CLIENT_COPY],
+                      systemTime() - start);
+   if (clientData == NULL) {
+      return;
+   }
+
+   LOGV("CameraHAL_DataCb: Posting preview frame %u to client\n", index);
+   cb->data(CAMERA_MSG_PREVIEW_FRAME, clientData, index, NULL, cb->user);
+
+   android::Mutex::Autolock lock(clientHeap->lock);
+   if (--clientHeap->posting == 0) {
+      clientHeap->idle.broadcast();
+   }
+}
+
+void 
+CameraHAL_DataCb(int32_t msg_type, const android::sp<android::IMemory>& dataPtr,
+                 void *user)
+{
+   struct camera_hal_context *ctx = (struct camera_hal_context *)user;
+   struct camera_callbacks    cb;
+   bool                       queued;
+
+   LOGV("CameraHAL_DataCb: msg_type:%d user:%p\n", msg_type, user);
+
+   if (msg_type == CAMERA_MSG_PREVIEW_FRAME) {
+      nsecs_t now = systemTime();
+      if (ctx->lastPreviewArrival != 0) {
+         frame_stats_record(&ctx->frameStats[FRAME_STAGE_PREVIEW_ARRIVAL],
+                            now - ctx->lastPreviewArrival);
+      } else {
+         ctx->startToFirstFrame = now - ctx->previewStarted;
+         if (ctx->firstPreviewFrame == 0) {
+            ctx->firstPreviewFrame = now;
+         }
+      }
+      ctx->lastPreviewArrival = now;
+   }
+
+   CameraHAL_GetCallbacks(ctx, &cb);
+   if (msg_type == CAMERA_MSG_PREVIEW_FRAME) {
+      CameraHAL_ZslPutFrame(&ctx->zslRing, dataPtr, ctx->lastPreviewArrival);
+      if (android_atomic_acquire_load(&ctx->lumaStatsEnabled)) {
+         CameraHAL_UpdateLumaStats(ctx, dataPtr);
+      }
+      if (android_atomic_acquire_load(&ctx->externallyRequestedFrames) &&
+          cb.data != NULL && cb.requestMemory != NULL &&
+          CameraHAL_PacerAdmit(&ctx->callbackPacer, ctx->lastPreviewArrival)) {
+         CameraHAL_PostPreviewFrame(ctx, &cb, dataPtr);
+      }
+      if (!CameraHAL_PacerAdmit(&ctx->renderPacer, ctx->lastPreviewArrival)) {
+         return;
+      }
+      {
+         android::RWLock::AutoRLock lock(ctx->frameLock);
+         queued = ctx->previewThread != NULL;
+         if (queued) {
+            CameraHAL_PreviewQueuePush(&ctx->previewQueue, dataPtr);
+         }
+      }
+      if (!queued) {
+         CameraHAL_RenderPreviewFrame(ctx, dataPtr);
+      }
+   } else if (cb.data != NULL && cb.requestMemory != NULL &&
+              !CameraHAL_BurstFilterData(ctx, msg_type, dataPtr, &cb)) {
+      camera_memory_t *clientData = CameraHAL_GenClientData(dataPtr,
+                                       cb.requestMemory, cb.user);
+      if (clientData != NULL) {
+         LOGV("CameraHAL_DataCb: Posting %d data to client\n",msg_type);
+         cb.data(msg_type, clientData, 0, NULL, cb.user);
+         clientData->release(clientData);
+      }
+   }
+}
+
+void
+CameraHAL_ResetRecordingPool(struct recording_pool *pool)
+{
+   pool->numFree = 0;
+   for (unsigned int i = 0; i < pool->count; i++) {
+      pool->freeSlots[pool->numFree++] = pool->count - 1 - i;
+      pool->inUse[i] = false;
+   }
+}
+
+void
+CameraHAL_FreeRecordingPool(struct recording_pool *pool)
+{
+   android::Mutex::Autolock lock(pool->lock);
+
+   while (pool->posting > 0) {
+      pool->idle.wait(pool->lock);
+   }
+   if (pool->mem != NULL) {
+      LOGV("CameraHAL_FreeRecordingPool: mem:%p\n", pool->mem);
+      pool->mem->release(pool->mem);
+   }
+   for (unsigned int i = 0; i < RECORDING_POOL_BUFFERS; i++) {
+      if (pool->handles[i] != NULL) {
+         /* The fd belongs to the vendor heap, so it is not closed. */
+         native_handle_delete(pool->handles[i]);
+         pool->handles[i] = NULL;
+      }
+      pool->frames[i].clear();
+   }
+   pool->mem       = NULL;
+   pool->frameSize = 0;
+   pool->count     = 0;
+   pool->numFree   = 0;
+}
+
+bool
+CameraHAL_AllocRecordingPool(struct recording_pool *pool, size_t frameSize,
+                             bool metadata,
+                             camera_request_memory reqClientMemory, void *user)
+{
+   CameraHAL_FreeRecordingPool(pool);
+
+   android::Mutex::Autolock lock(pool->lock);
+   if (!pool->active) {
+      /* stop_recording got in first. */
+      return false;
+   }
+   /* What CameraHAL_EnsureRecordingPool retries with after a failure. */
+   pool->metadata = metadata;
+   for (unsigned int i = 0; metadata && i < RECORDING_POOL_BUFFERS; i++) {
+      pool->handles[i] = native_handle_create(1, 2);
+      if (pool->handles[i] == NULL) {
+         LOGE("CameraHAL_AllocRecordingPool: ERROR creating handles\n");
+         while (i-- > 0) {
+            native_handle_delete(pool->handles[i]);
+            pool->handles[i] = NULL;
+         }
+         return false;
+      }
+   }
+   if (metadata) {
+      frameSize = sizeof(struct recording_metadata);
+   }
+   pool->mem = reqClientMemory(-1, frameSize, RECORDING_POOL_BUFFERS, user);
+   if (pool->mem == NULL || pool->mem->data == NULL) {
+      LOGE("CameraHAL_AllocRecordingPool: ERROR allocating %u x %u bytes\n",
+           RECORDING_POOL_BUFFERS, frameSize);
+      if (pool->mem != NULL) {
+         pool->mem->release(pool->mem);
+         pool->mem = NULL;
+      }
+      for (unsigned int i = 0; metadata && i < RECORDING_POOL_BUFFERS; i++) {
+         native_handle_delete(pool->handles[i]);
+         pool->handles[i] = NULL;
+      }
+      return false;
+   }
+   pool->frameSize      = frameSize;
+   pool->count          = RECORDING_POOL_BUFFERS;
+   pool->framesSent     = 0;
+   pool->framesReleased = 0;
+   pool->framesDropped  = 0;
+   pool->totalHoldTime  = 0;
+   pool->maxHoldTime    = 0;
+   CameraHAL_ResetRecordingPool(pool);
+   LOGV("CameraHAL_AllocRecordingPool: %u x %u bytes\n", pool->count,
+        frameSize);
+   return true;
+}
+
+/* Regrows a pool sized from the parameters at start_recording when the vendor
+ * delivers larger frames, as long as nothing is out at the encoder. */
+void
+CameraHAL_EnsureRecordingPool(struct recording_pool *pool, size_t frameSize,
+                              camera_request_memory reqClientMemory,
+                              void *user)
+{
+   bool metadata;
+
+   {
+      android::Mutex::Autolock lock(pool->lock);
+      if (!pool->active ||
+          (pool->mem != NULL && (pool->metadata ||
+                                 frameSize <= pool->frameSize)) ||
+          pool->numFree != pool->count) {
+         return;
+      }
+      metadata = pool->metadata;
+   }
+   CameraHAL_AllocRecordingPool(pool, frameSize, metadata, reqClientMemory,
+                                user);
+}
+
+/* Starts or stops accepting recording frames. Once stopped, frames are
+ * dropped, the pool is not regrown and frames still being posted have been
+ * handed over. */
+void
+CameraHAL_SetRecordingPoolActive(struct recording_pool *pool, bool active)
+{
+   android::Mutex::Autolock lock(pool->lock);
+
+   pool->active = active;
+   while (!active && pool->posting > 0) {
+      pool->idle.wait(pool->lock);
+   }
+}
+
+/*
+ * Takes a free slot for a frame and fills it in: with a copy of the frame,
+ * or in metadata mode with a pointer to it, in which case the frame is held
+ * until the slot is put back. Returns -1 if there is no slot. Otherwise
+ * *mem and *metadata say what to post, and the pool stays allocated until
+ * CameraHAL_EndRecordingPost.
+ */
+int
+CameraHAL_GetRecordingSlot(struct recording_pool *pool,
+                           const android::sp<android::IMemory> &frame,
+                           camera_memory_t **mem, bool *metadata,
+                           struct frame_stage_stats *copyStats)
+{
+   android::Mutex::Autolock lock(pool->lock);
+   ssize_t offset;
+   size_t  size;
+   int     slot;
+   android::sp<android::IMemoryHeap> heap = frame->getMemory(&offset, &size);
+
+   if (!pool->active) {
+      return -1;
+   }
+   if (pool->mem == NULL || pool->numFree == 0 ||
+       (!pool->metadata && size > pool->frameSize) ||
+       (pool->rotateWidth > 0 &&
+        size != (size_t)pool->rotateWidth * pool->rotateHeight * 3 / 2)) {
+      pool->framesDropped++;
+      return -1;
+   }
+   slot = pool->freeSlots[--pool->numFree];
+   if (!pool->metadata) {
+      nsecs_t start = systemTime();
+      if (pool->rotateWidth > 0) {
+         yuv420sp_rotate90((const uint8_t *)heap->base() + offset,
+                           (uint8_t *)pool->mem->data +
+                              slot * pool->frameSize,
+                           pool->rotateWidth, pool->rotateHeight);
+      } else {
+         memcpy((char *)pool->mem->data + slot * pool->frameSize,
+                (char *)heap->base() + offset, size);
+      }
+      frame_stats_record(copyStats, systemTime() - start);
+   } else {
+      struct recording_metadata *meta = (struct recording_metadata *)
+         ((char *)pool->mem->data + slot * pool->frameSize);
+      native_handle_t *handle = pool->handles[slot];
+
+      handle->data[0]    = heap->getHeapID();
+      handle->data[1]    = offset;
+      handle->data[2]    = size;
+      meta->type         = android::kMetadataBufferTypeCameraSource;
+      meta->handle       = handle;
+      pool->frames[slot] = frame;
+   }
+   pool->inUse[slot]    = true;
+   pool->sentTime[slot] = systemTime();
+   pool->framesSent++;
+   pool->posting++;
+   *mem      = pool->mem;
+   *metadata = pool->metadata;
+   return slot;
+}
+
+void
+CameraHAL_EndRecordingPost(struct recording_pool *pool)
+{
+   android::Mutex::Autolock lock(pool->lock);
+
+   if (--pool->posting == 0) {
+      pool->idle.broadcast();
+   }
+}
+
+/* Puts back a slot returned by the encoder. A vendor frame it held is
+ * handed back in *frame for the caller to release. */
+bool
+CameraHAL_PutRecordingSlot(struct recording_pool *pool, const void *opaque,
+                           android::sp<android::IMemory> *frame)
 {
-   ssize_t          offset;
-   size_t           size;
-   camera_memory_t *clientData = NULL;
-
-   android::sp<android::IMemoryHeap> mHeap = dataPtr->getMemory(&offset, &size);
+   android::Mutex::Autolock lock(pool->lock);
+   size_t  delta;
+   int     slot;
+   nsecs_t holdTime;
 
-   LOGV("CameraHAL_GenClientData: offset:%#x size:%#x base:%p\n",
-        (unsigned)offset, size, mHeap != NULL ? mHeap->base() : 0);
+   if (pool->mem == NULL || opaque < pool->mem->data) {
+      return false;
+   }
+   delta = (const char *)opaque - (const char *)pool->mem->data;
+   slot  = delta / pool->frameSize;
+   if (delta % pool->frameSize != 0 || slot >= (int)pool->count ||
+       !pool->inUse[slot]) {
+      return false;
+   }
 
-   clientData = reqClientMemory(-1, size, 1, user);
-   if (clientData != NULL) {
-      memcpy(clientData->data, (char *)(mHeap->base()) + offset, size);
-   } else {
-      LOGV("CameraHAL_GenClientData: ERROR allocating memory from client\n");
+   holdTime = systemTime() - pool->sentTime[slot];
+   pool->totalHoldTime += holdTime;
+   if (holdTime > pool->maxHoldTime) {
+      pool->maxHoldTime = holdTime;
    }
-   return clientData;
+   pool->framesReleased++;
+   pool->inUse[slot] = false;
+   *frame = pool->frames[slot];
+   pool->frames[slot].clear();
+   pool->freeSlots[pool->numFree++] = slot;
+   return true;
 }
 
-void 
-CameraHAL_DataCb(int32_t msg_type, const android::sp<android::IMemory>& dataPtr,
-                 void *user)
+void
+CameraHAL_LogRecordingPoolStats(struct recording_pool *pool)
 {
-   LOGV("CameraHAL_DataCb: msg_type:%d user:%p\n", msg_type, user);
+   android::Mutex::Autolock lock(pool->lock);
+
+   LOGD("Recording pool (%s): sent:%u released:%u dropped(exhausted):%u "
+        "hold avg:%lldus max:%lldus\n",
+        pool->metadata ? "metadata" : "copy", pool->framesSent,
+        pool->framesReleased, pool->framesDropped,
+        pool->framesReleased ?
+           pool->totalHoldTime / pool->framesReleased / 1000 : 0LL,
+        pool->maxHoldTime / 1000);
+}
 
-   if ((msg_type != CAMERA_MSG_PREVIEW_FRAME || externallyRequestedFrames) && 
-          origData_cb != NULL && origCamReqMemory != NULL) {
-      camera_memory_t *clientData = CameraHAL_GenClientData(dataPtr,
-                                       origCamReqMemory, user);
-      if (clientData != NULL) {
-         LOGV("CameraHAL_DataCb: Posting %d data to client\n",msg_type);
-         origData_cb(msg_type, clientData, 0, NULL, user);
-         clientData->release(clientData);
+/* Gives the vendor back the frames still held for the encoder in metadata
+ * mode. Their slots stay taken until the encoder returns them or the pool
+ * is freed, so a late release_recording_frame still finds its slot. */
+void
+CameraHAL_ReturnRecordingFrames(struct camera_hal_context *ctx)
+{
+   struct recording_pool        *pool = &ctx->recordingPool;
+   android::sp<android::IMemory> frames[RECORDING_POOL_BUFFERS];
+   unsigned int                  returned = 0;
+
+   {
+      android::Mutex::Autolock lock(pool->lock);
+      for (unsigned int i = 0; i < RECORDING_POOL_BUFFERS; i++) {
+         frames[i] = pool->frames[i];
+         pool->frames[i].clear();
       }
    }
-   if (msg_type == CAMERA_MSG_PREVIEW_FRAME) {
-      int32_t previewWidth, previewHeight;
-      android::CameraParameters hwParameters = qCamera->getParameters();
-      hwParameters.getPreviewSize(&previewWidth, &previewHeight);
-      CameraHAL_HandlePreviewData(dataPtr, mWindow, origCamReqMemory,
-                                  previewWidth, previewHeight);
-   } 
+   for (unsigned int i = 0; i < RECORDING_POOL_BUFFERS; i++) {
+      if (frames[i] != NULL) {
+         ctx->qCamera->releaseRecordingFrame(frames[i]);
+         returned++;
+      }
+   }
+   if (returned > 0) {
+      LOGW("CameraHAL_ReturnRecordingFrames: took back %u frames from the "
+           "encoder\n", returned);
+   }
 }
 
 void 
 CameraHAL_DataTSCb(nsecs_t timestamp, int32_t msg_type,
                    const android::sp<android::IMemory>& dataPtr, void *user)
 {
-   LOGD("CameraHAL_DataTSCb: timestamp:%lld now:%lld msg_type:%d user:%p\n",
-        timestamp /1000, systemTime(), msg_type, user);
-
-   if (origDataTS_cb != NULL && origCamReqMemory != NULL) {
-      camera_memory_t *clientData = CameraHAL_GenClientData(dataPtr,
-                                       origCamReqMemory, user);
-      if (clientData != NULL) {
+   struct camera_hal_context *ctx = (struct camera_hal_context *)user;
+   struct recording_pool     *pool = &ctx->recordingPool;
+   struct camera_callbacks    cb;
+   nsecs_t                    now = systemTime();
+
+   LOGV("CameraHAL_DataTSCb: timestamp:%lld now:%lld msg_type:%d user:%p\n",
+        timestamp /1000, now, msg_type, user);
+
+   frame_stats_record(&ctx->frameStats[FRAME_STAGE_TIMESTAMP_LATENCY],
+                      now - timestamp);
+   if (ctx->lastRecordArrival != 0) {
+      frame_stats_record(&ctx->frameStats[FRAME_STAGE_RECORD_ARRIVAL],
+                         now - ctx->lastRecordArrival);
+   }
+   ctx->lastRecordArrival = now;
+
+   CameraHAL_VideoSnapshotGrab(&ctx->videoSnapshot, dataPtr);
+
+   CameraHAL_GetCallbacks(ctx, &cb);
+   if (cb.dataTimestamp != NULL && cb.requestMemory != NULL) {
+      ssize_t          offset;
+      size_t           size;
+      int              slot;
+      camera_memory_t *mem = NULL;
+      bool             metadata = false;
+      struct frame_stage_stats *copyStats =
+         &ctx->frameStats[FRAME_STAGE_CLIENT_COPY];
+
+      dataPtr->getMemory(&offset, &size);
+      CameraHAL_EnsureRecordingPool(pool, size, cb.requestMemory, cb.user);
+      slot = CameraHAL_GetRecordingSlot(pool, dataPtr, &mem, &metadata,
+                                        copyStats);
+      if (slot >= 0) {
          LOGV("CameraHAL_DataTSCb: Posting data to client timestamp:%lld\n", 
               systemTime());
-
-	 sentFrames.push_back(clientData);
-         origDataTS_cb(timestamp, msg_type, sentFrames.top(), 0, user);
-         qCamera->releaseRecordingFrame(dataPtr);
+         cb.dataTimestamp(timestamp, msg_type, mem, slot, cb.user);
+         CameraHAL_EndRecordingPost(pool);
       } else {
-         LOGD("CameraHAL_DataTSCb: ERROR allocating memory from client\n");
+         LOGW("CameraHAL_DataTSCb: no free recording buffer, dropping "
+              "frame\n");
+      }
+      if (slot < 0 || !metadata) {
+         ctx->qCamera->releaseRecordingFrame(dataPtr);
       }
    }
 }
@@ -299,6 +2823,10 @@ CameraHAL_FixupParams(android::CameraParameters &settings)
    settings.set(android::CameraParameters::KEY_PREVIEW_FORMAT,
                 android::CameraParameters::PIXEL_FORMAT_YUV420SP);
 
+   /* Taken from the recording frames by the wrapper. */
+   settings.set(android::CameraParameters::KEY_VIDEO_SNAPSHOT_SUPPORTED,
+                android::CameraParameters::TRUE);
+
    if (!settings.get(android::CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES)) {
       settings.set(android::CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES,
                    preview_sizes);
@@ -332,13 +2860,273 @@ CameraHAL_FixupParams(android::CameraParameters &settings)
    }
 }
 
-static void releaseCameraFrames()
+/* Keys whose change makes the vendor library restart the preview pipeline. */
+static const char *const reconfigureKeys[] = {
+   android::CameraParameters::KEY_PREVIEW_SIZE,
+   android::CameraParameters::KEY_PREVIEW_FORMAT,
+   android::CameraParameters::KEY_PREVIEW_FRAME_RATE,
+   android::CameraParameters::KEY_PREVIEW_FPS_RANGE,
+   android::CameraParameters::KEY_VIDEO_SIZE,
+   "record-size",
+};
+
+/* Keys whose change makes pictures left over from a burst stale. */
+static const char *const pictureKeys[] = {
+   android::CameraParameters::KEY_PICTURE_SIZE,
+   android::CameraParameters::KEY_PICTURE_FORMAT,
+   android::CameraParameters::KEY_JPEG_QUALITY,
+   android::CameraParameters::KEY_ROTATION,
+};
+
+bool
+CameraHAL_IsKeyIn(const char *key, const char *const *keys, size_t count)
+{
+   for (size_t i = 0; i < count; i++) {
+      if (strcmp(key, keys[i]) == 0) {
+         return true;
+      }
+   }
+   return false;
+}
+
+struct param_changes {
+   android::String8 names;
+   bool             reconfigure;
+   bool             picture;
+};
+
+void
+CameraHAL_NoteChangedParam(int atom, void *arg)
 {
-    android::Vector<camera_memory_t*>::iterator it;
-    for (it = sentFrames.begin(); it != sentFrames.end(); ++it) {
-        (*it)->release(*it);
-    }
-    sentFrames.clear();
+   struct param_changes *changes = (struct param_changes *)arg;
+   const char           *key = param_atom_name(atom);
+
+   if (!changes->names.isEmpty()) {
+      changes->names.append(",");
+   }
+   changes->names.append(key);
+   if (CameraHAL_IsKeyIn(key, reconfigureKeys,
+                         sizeof(reconfigureKeys) / sizeof(reconfigureKeys[0]))) {
+      changes->reconfigure = true;
+   }
+   if (CameraHAL_IsKeyIn(key, pictureKeys,
+                         sizeof(pictureKeys) / sizeof(pictureKeys[0]))) {
+      changes->picture = true;
+   }
+}
+
+static struct camera_prewarm gPrewarm;
+
+class CameraPrewarmThread : public android::Thread {
+public:
+   CameraPrewarmThread() : android::Thread(false) { }
+
+private:
+   virtual bool threadLoop() {
+      android::sp<android::CameraHardwareInterface> hw;
+      int     cameraId;
+      nsecs_t start, deadline, now;
+
+      {
+         android::Mutex::Autolock lock(gPrewarm.lock);
+         deadline = systemTime() + PREWARM_DELAY;
+         while (gPrewarm.devicesOpen == 0 &&
+                (now = systemTime()) < deadline) {
+            gPrewarm.cond.waitRelative(gPrewarm.lock, deadline - now);
+         }
+         if (gPrewarm.devicesOpen > 0) {
+            /* The info was read by a connect. */
+            gPrewarm.active  = false;
+            gPrewarm.opening = false;
+            gPrewarm.skipped++;
+            gPrewarm.cond.broadcast();
+            return false;
+         }
+         cameraId = gPrewarm.cameraId;
+      }
+      start = systemTime();
+      hw    = CameraHAL_OpenVendorCamera(cameraId);
+      LOGD("CameraPrewarmThread: opened camera %d in %lldms\n", cameraId,
+           ns2ms(systemTime() - start));
+
+      android::Mutex::Autolock lock(gPrewarm.lock);
+      gPrewarm.opening = false;
+      if (hw == NULL) {
+         gPrewarm.active = false;
+         gPrewarm.cond.broadcast();
+         return false;
+      }
+      gPrewarm.hw = hw;
+      gPrewarm.cond.broadcast();
+
+      deadline = systemTime() + PREWARM_TIMEOUT;
+      while (gPrewarm.hw == hw && (now = systemTime()) < deadline) {
+         gPrewarm.cond.waitRelative(gPrewarm.lock, deadline - now);
+      }
+      if (gPrewarm.hw == hw) {
+         LOGD("CameraPrewarmThread: camera %d unused, closing\n", cameraId);
+         gPrewarm.hw.clear();
+         gPrewarm.active = false;
+         gPrewarm.expired++;
+         gPrewarm.misses++;
+         hw->release();
+      }
+      return false;
+   }
+};
+
+/* Starts opening a camera in the background so that a following
+ * qcamera_device_open finds it ready. */
+void
+CameraHAL_PrewarmCamera(int cameraId)
+{
+   char value[PROPERTY_VALUE_MAX];
+
+   property_get("persist.camera.prewarm", value, "0");
+   if (atoi(value) == 0) {
+      return;
+   }
+
+   android::Mutex::Autolock lock(gPrewarm.lock);
+   /* The vendor library drives one sensor at a time. */
+   if (gPrewarm.active || gPrewarm.devicesOpen > 0 ||
+       gPrewarm.misses >= PREWARM_MAX_MISSES) {
+      return;
+   }
+   gPrewarm.active   = true;
+   gPrewarm.cameraId = cameraId;
+   gPrewarm.opening  = true;
+   android::sp<android::Thread> thread = new CameraPrewarmThread();
+   if (thread->run("CameraPrewarm") != NO_ERROR) {
+      LOGE("CameraHAL_PrewarmCamera: ERROR starting the thread\n");
+      gPrewarm.active   = false;
+      gPrewarm.opening  = false;
+   }
+}
+
+/* Takes the pre-warmed camera if it is the one asked for. Any other camera
+ * is closed first, since it would keep the sensor stack busy. */
+android::sp<android::CameraHardwareInterface>
+CameraHAL_ClaimPrewarmed(int cameraId)
+{
+   android::sp<android::CameraHardwareInterface> hw;
+   android::Mutex::Autolock lock(gPrewarm.lock);
+
+   while (gPrewarm.opening) {
+      gPrewarm.cond.wait(gPrewarm.lock);
+   }
+   hw = gPrewarm.hw;
+   if (hw != NULL) {
+      gPrewarm.hw.clear();
+      gPrewarm.cond.broadcast();
+      if (gPrewarm.cameraId != cameraId) {
+         hw->release();
+         hw.clear();
+      } else {
+         gPrewarm.used++;
+      }
+   }
+   gPrewarm.active = false;
+   return hw;
+}
+
+class CameraOpenThread : public android::Thread {
+public:
+   CameraOpenThread(struct camera_hal_context *ctx)
+      : android::Thread(false), mCtx(ctx) { }
+
+private:
+   struct camera_hal_context *mCtx;
+
+   virtual bool threadLoop() {
+      android::sp<android::CameraHardwareInterface> hw;
+      int32_t state;
+
+      hw = CameraHAL_ClaimPrewarmed(mCtx->cameraId);
+      mCtx->prewarmed = hw != NULL;
+      if (hw == NULL) {
+         hw = CameraHAL_OpenVendorCamera(mCtx->cameraId);
+      }
+      if (hw == NULL) {
+         LOGE("CameraOpenThread: ERROR opening camera %d\n", mCtx->cameraId);
+      } else {
+         /* The callbacks only forward to ctx->callbacks, so they go in
+          * now; qcamera_set_callbacks doesn't have to wait for the open. */
+         hw->setCallbacks(CameraHAL_NotifyCb, CameraHAL_DataCb,
+                          CameraHAL_DataTSCb, mCtx);
+      }
+
+      android::Mutex::Autolock lock(mCtx->openLock);
+      if (hw != NULL && mCtx->deferredDisable != 0) {
+         hw->disableMsgType(mCtx->deferredDisable);
+      }
+      if (hw != NULL && mCtx->deferredEnable != 0) {
+         hw->enableMsgType(mCtx->deferredEnable);
+      }
+      mCtx->qCamera       = hw;
+      mCtx->openCompleted = systemTime();
+      state = hw != NULL ? CAMERA_OPEN_DONE : CAMERA_OPEN_FAILED;
+      android_atomic_release_store(state, &mCtx->openState);
+      mCtx->openCond.broadcast();
+      LOGD("CameraOpenThread: camera %d %s in %lldms%s\n", mCtx->cameraId,
+           hw != NULL ? "opened" : "failed",
+           ns2ms(mCtx->openCompleted - mCtx->openRequested),
+           mCtx->prewarmed ? " (pre-warmed)" : "");
+      return false;
+   }
+};
+
+/* Waits for the vendor open started by qcamera_device_open. Once it is
+ * done this is a single load. */
+bool
+CameraHAL_WaitOpen(struct camera_hal_context *ctx)
+{
+   int32_t state = android_atomic_acquire_load(&ctx->openState);
+
+   if (state == CAMERA_OPEN_PENDING) {
+      android::Mutex::Autolock lock(ctx->openLock);
+      nsecs_t start = systemTime();
+
+      if (ctx->openState == CAMERA_OPEN_PENDING) {
+         while ((state = android_atomic_acquire_load(&ctx->openState)) ==
+                CAMERA_OPEN_PENDING) {
+            ctx->openCond.wait(ctx->openLock);
+         }
+         ctx->openWaits++;
+         ctx->openWaitTime += systemTime() - start;
+      }
+      state = ctx->openState;
+   }
+   return state == CAMERA_OPEN_DONE;
+}
+
+/* Keeps a msg_type change made before the vendor open finished, for the
+ * open thread to apply. Returns false once the open is over, when the
+ * caller has to make the change itself. */
+bool
+CameraHAL_DeferMsgType(struct camera_hal_context *ctx, int32_t enable,
+                       int32_t disable)
+{
+   if (android_atomic_acquire_load(&ctx->openState) != CAMERA_OPEN_PENDING) {
+      return false;
+   }
+   android::Mutex::Autolock lock(ctx->openLock);
+   if (ctx->openState != CAMERA_OPEN_PENDING) {
+      return false;
+   }
+   ctx->deferredEnable  = (ctx->deferredEnable & ~disable) | enable;
+   ctx->deferredDisable = (ctx->deferredDisable & ~enable) | disable;
+   return true;
+}
+
+/* Context for an op that needs the vendor camera, NULL if it failed to
+ * open. */
+static inline struct camera_hal_context *
+CameraHAL_GetOpenContext(struct camera_device *device)
+{
+   struct camera_hal_context *ctx = CameraHAL_GetContext(device);
+
+   return CameraHAL_WaitOpen(ctx) ? ctx : NULL;
 }
 
 /* Hardware Camera interface handlers. */
@@ -351,12 +3139,25 @@ qcamera_set_preview_window(struct camera_device * device,
       LOGE("qcamera_set_preview_window : Invalid device.\n");
       return -EINVAL;
    } else {
+      struct camera_hal_context *ctx = CameraHAL_GetContext(device);
+      android::Mutex::Autolock control(ctx->controlLock);
+      android::RWLock::AutoWLock lock(ctx->frameLock);
+
       LOGV("qcamera_set_preview_window : window :%p\n", window);
-      mWindow = window;
+      /* The framework reuses the same ops for a new native window. */
+      CameraHAL_ResetPreviewStream(&ctx->previewStream);
+      ctx->window = window;
       return 0;
    }
 }
 
+/*
+ * CameraService calls set_callbacks and enable_msg_type while connecting,
+ * right after the open. Neither waits for the vendor open, so connect
+ * returns without it and the open overlaps with the app setting up its
+ * preview surface, up to the first op that needs the vendor library,
+ * typically get_parameters. The dump reports how long ops still waited.
+ */
 void 
 qcamera_set_callbacks(struct camera_device * device, 
                       camera_notify_callback notify_cb,    
@@ -364,186 +3165,553 @@ qcamera_set_callbacks(struct camera_device * device,
                       camera_data_timestamp_callback data_cb_timestamp,        
                       camera_request_memory get_memory, void *user)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetContext(device);
+
    LOGV("qcamera_set_callbacks: notify_cb: %p, data_cb: %p "
         "data_cb_timestamp: %p, get_memory: %p, user :%p", 
         notify_cb, data_cb, data_cb_timestamp, get_memory, user);
 
-   origNotify_cb    = notify_cb;
-   origData_cb      = data_cb;
-   origDataTS_cb    = data_cb_timestamp;
-   origCamReqMemory = get_memory;
-   qCamera->setCallbacks(CameraHAL_NotifyCb, CameraHAL_DataCb,
-                         CameraHAL_DataTSCb, user);
+   /* The vendor library was handed our own callbacks by the open thread. */
+   android::RWLock::AutoWLock lock(ctx->frameLock);
+   ctx->callbacks.notify        = notify_cb;
+   ctx->callbacks.data          = data_cb;
+   ctx->callbacks.dataTimestamp = data_cb_timestamp;
+   ctx->callbacks.requestMemory = get_memory;
+   ctx->callbacks.user          = user;
 }
 
+/*
+ * The msg_type ops are called back from within the data callbacks, so they
+ * must not take controlLock.
+ */
 void 
 qcamera_enable_msg_type(struct camera_device * device, int32_t msg_type)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetContext(device);
+
    if (msg_type & CAMERA_MSG_PREVIEW_FRAME)
-       externallyRequestedFrames = true;
+       android_atomic_release_store(1, &ctx->externallyRequestedFrames);
 
-   qCamera->enableMsgType(msg_type);
+   if (CameraHAL_DeferMsgType(ctx, msg_type, 0) ||
+       !CameraHAL_WaitOpen(ctx)) {
+      return;
+   }
+   ctx->qCamera->enableMsgType(msg_type);
 }
 
 void 
 qcamera_disable_msg_type(struct camera_device * device, int32_t msg_type)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetContext(device);
+
    if (msg_type & CAMERA_MSG_PREVIEW_FRAME)
-       externallyRequestedFrames = false;
+       android_atomic_release_store(0, &ctx->externallyRequestedFrames);
    LOGV("qcamera_disable_msg_type: msg_type:%d\n", msg_type);
+   if (CameraHAL_DeferMsgType(ctx, 0, msg_type) ||
+       !CameraHAL_WaitOpen(ctx)) {
+      return;
+   }
    if (msg_type == CAMERA_MSG_VIDEO_FRAME) {
-       LOGW("%s: releasing stale video frames", __FUNCTION__);
-       releaseCameraFrames();
+      /* Only stopRecording turns video frames off, never a callback, so
+       * this one can take controlLock. Frames still being posted are let
+       * through before the encoder's are taken back. */
+      android::Mutex::Autolock control(ctx->controlLock);
+      ctx->qCamera->disableMsgType(msg_type);
+      CameraHAL_SetRecordingPoolActive(&ctx->recordingPool, false);
+      CameraHAL_ReturnRecordingFrames(ctx);
+      return;
    }
-   qCamera->disableMsgType(msg_type);
+   ctx->qCamera->disableMsgType(msg_type);
 }
 
 int 
 qcamera_msg_type_enabled(struct camera_device * device, int32_t msg_type)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetContext(device);
+
    LOGV("qcamera_msg_type_enabled: msg_type:%d\n", msg_type);
-   return qCamera->msgTypeEnabled(msg_type);
+   if (android_atomic_acquire_load(&ctx->openState) == CAMERA_OPEN_PENDING) {
+      android::Mutex::Autolock lock(ctx->openLock);
+      if (ctx->openState == CAMERA_OPEN_PENDING) {
+         return ctx->deferredEnable & msg_type;
+      }
+   }
+   return CameraHAL_WaitOpen(ctx) ? ctx->qCamera->msgTypeEnabled(msg_type) :
+                                    0;
 }
 
 int 
 qcamera_start_preview(struct camera_device * device)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+   char value[PROPERTY_VALUE_MAX];
+
+   if (ctx == NULL) {
+      return -EIO;
+   }
+
    LOGV("qcamera_start_preview: Enabling CAMERA_MSG_PREVIEW_FRAME\n");
 
+   /* Outside controlLock, which the burst thread needs to finish. */
+   CameraHAL_BurstWait(ctx);
+
+   android::Mutex::Autolock control(ctx->controlLock);
+   CameraHAL_InvalidateParams(ctx);
+   CameraHAL_UpdatePreviewGeometry(ctx);
+   {
+      android::RWLock::AutoWLock lock(ctx->frameLock);
+      CameraHAL_OpenBlitSession(&ctx->previewBlit);
+      CameraHAL_ResetPreviewStream(&ctx->previewStream);
+      property_get("persist.camera.preview.scale", value, "0");
+      ctx->previewStream.scaling = atoi(value) != 0;
+      property_get("persist.camera.preview.yuv", value, "0");
+      ctx->previewStream.yuv     = atoi(value) != 0;
+      ctx->previewStream.rotate  = ctx->rotatePreview;
+   }
+   CameraHAL_StartPreviewThread(ctx);
+   if (ctx->zslEnabled) {
+      int32_t previewWidth, previewHeight;
+      CameraHAL_GetPreviewGeometry(ctx, &previewWidth, &previewHeight);
+      CameraHAL_AllocZslRing(&ctx->zslRing, previewWidth, previewHeight);
+   }
+
+   ctx->lastPreviewArrival  = 0;
+   ctx->previewStarted      = systemTime();
+   ctx->renderPacer.next   = 0;
+   ctx->callbackPacer.next = 0;
+   CameraHAL_UpdatePreviewThrottle(ctx, NULL);
+   for (int stage = FRAME_STAGE_PREVIEW_ARRIVAL;
+        stage <= FRAME_STAGE_CLIENT_COPY; stage++) {
+      frame_stats_reset(&ctx->frameStats[stage]);
+   }
+   frame_stats_reset(&ctx->frameStats[FRAME_STAGE_LUMA_STATS]);
+
    /* TODO: Remove hack. */
-   qCamera->enableMsgType(CAMERA_MSG_PREVIEW_FRAME);
-   return qCamera->startPreview();
+   ctx->qCamera->enableMsgType(CAMERA_MSG_PREVIEW_FRAME);
+   return ctx->qCamera->startPreview();
 }
 
 void 
 qcamera_stop_preview(struct camera_device * device)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+
+   if (ctx == NULL) {
+      return;
+   }
+
    LOGV("qcamera_stop_preview:\n");
 
+   android::Mutex::Autolock control(ctx->controlLock);
    /* TODO: Remove hack. */
-   qCamera->disableMsgType(CAMERA_MSG_PREVIEW_FRAME);
-   return qCamera->stopPreview();
+   ctx->qCamera->disableMsgType(CAMERA_MSG_PREVIEW_FRAME);
+   ctx->qCamera->stopPreview();
+   CameraHAL_BurstFlush(ctx);
+   CameraHAL_StopPreviewThread(ctx);
+   CameraHAL_FreeZslRing(&ctx->zslRing);
+   {
+      /* A late frame may still be blitting. */
+      android::RWLock::AutoWLock lock(ctx->frameLock);
+      CameraHAL_CloseBlitSession(&ctx->previewBlit);
+   }
+   CameraHAL_ReleasePreviewClientHeap(&ctx->previewClientHeap);
 }
 
 int 
 qcamera_preview_enabled(struct camera_device * device)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+
    LOGV("qcamera_preview_enabled:\n");
-   return qCamera->previewEnabled() ? 1 : 0;
+   return ctx != NULL && ctx->qCamera->previewEnabled() ? 1 : 0;
 }
 
+/*
+ * Metadata mode hands the encoder the vendor's recording frame by fd and
+ * offset instead of a copy. It depends on the encoder taking
+ * kMetadataBufferTypeCameraSource buffers, so it stays off unless
+ * persist.camera.record.metadata is set.
+ */
 int 
 qcamera_store_meta_data_in_buffers(struct camera_device * device, int enable)
 {
-   LOGV("qcamera_store_meta_data_in_buffers:\n");
-   return -1;
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+   char value[PROPERTY_VALUE_MAX];
+
+   if (ctx == NULL) {
+      return -EIO;
+   }
+
+   LOGV("qcamera_store_meta_data_in_buffers: enable:%d\n", enable);
+   android::Mutex::Autolock control(ctx->controlLock);
+   property_get("persist.camera.record.metadata", value, "0");
+   /* Metadata points the encoder at the vendor's own landscape frames,
+    * which a pre-rotated camera can't hand out as they are. */
+   if (enable && (atoi(value) == 0 || ctx->rotatePreview)) {
+      ctx->metadataMode = false;
+      return -1;
+   }
+   ctx->metadataMode = enable != 0;
+   return NO_ERROR;
 }
 
 int 
 qcamera_start_recording(struct camera_device * device)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+   struct camera_callbacks    cb;
+   int32_t videoWidth, videoHeight;
+
+   if (ctx == NULL) {
+      return -EIO;
+   }
+
    LOGV("qcamera_start_recording\n");
 
+   android::Mutex::Autolock control(ctx->controlLock);
+   CameraHAL_SetRecordingPoolActive(&ctx->recordingPool, true);
+   ctx->lastRecordArrival = 0;
+   frame_stats_reset(&ctx->frameStats[FRAME_STAGE_RECORD_ARRIVAL]);
+   frame_stats_reset(&ctx->frameStats[FRAME_STAGE_TIMESTAMP_LATENCY]);
+
+   CameraHAL_GetCallbacks(ctx, &cb);
+   if (cb.requestMemory != NULL) {
+      android::CameraParameters hwParameters = ctx->qCamera->getParameters();
+      hwParameters.getVideoSize(&videoWidth, &videoHeight);
+      if (videoWidth <= 0 || videoHeight <= 0) {
+         hwParameters.getPreviewSize(&videoWidth, &videoHeight);
+      }
+      {
+         android::Mutex::Autolock lock(ctx->recordingPool.lock);
+         ctx->recordingPool.rotateWidth  = ctx->rotatePreview ? videoWidth : 0;
+         ctx->recordingPool.rotateHeight = ctx->rotatePreview ? videoHeight :
+                                                                0;
+      }
+      if (!CameraHAL_AllocRecordingPool(&ctx->recordingPool,
+                                        videoWidth * videoHeight * 3 / 2,
+                                        ctx->metadataMode,
+                                        cb.requestMemory, cb.user) &&
+          ctx->metadataMode) {
+         /* The encoder was promised metadata, it can't be sent frames. */
+         LOGE("qcamera_start_recording: ERROR setting up metadata "
+              "buffers\n");
+         CameraHAL_SetRecordingPoolActive(&ctx->recordingPool, false);
+         return -ENOMEM;
+      }
+
+      android::Mutex::Autolock lock(ctx->videoSnapshot.lock);
+      ctx->videoSnapshot.width  = videoWidth;
+      ctx->videoSnapshot.height = videoHeight;
+   }
+
    /* TODO: Remove hack. */
-   qCamera->enableMsgType(CAMERA_MSG_VIDEO_FRAME);
-   qCamera->startRecording();
+   ctx->qCamera->enableMsgType(CAMERA_MSG_VIDEO_FRAME);
+   ctx->qCamera->startRecording();
    return NO_ERROR;
 }
 
 void 
 qcamera_stop_recording(struct camera_device * device)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+
+   if (ctx == NULL) {
+      return;
+   }
+
    LOGV("qcamera_stop_recording:\n");
 
+   android::Mutex::Autolock control(ctx->controlLock);
    /* TODO: Remove hack. */
-   qCamera->disableMsgType(CAMERA_MSG_VIDEO_FRAME);
-   qCamera->stopRecording();
+   ctx->qCamera->disableMsgType(CAMERA_MSG_VIDEO_FRAME);
+   CameraHAL_SetRecordingPoolActive(&ctx->recordingPool, false);
+   CameraHAL_CancelVideoSnapshot(ctx);
+   CameraHAL_ReturnRecordingFrames(ctx);
+   ctx->qCamera->stopRecording();
+   CameraHAL_LogRecordingPoolStats(&ctx->recordingPool);
+   CameraHAL_FreeRecordingPool(&ctx->recordingPool);
 }
 
 int 
 qcamera_recording_enabled(struct camera_device * device)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+
    LOGV("qcamera_recording_enabled:\n");
-   return (int)qCamera->recordingEnabled();
+   return ctx != NULL ? (int)ctx->qCamera->recordingEnabled() : 0;
 }
 
 void 
 qcamera_release_recording_frame(struct camera_device * device, 
                                 const void *opaque)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+
+   android::sp<android::IMemory> frame;
+
+   if (ctx == NULL) {
+      return;
+   }
+
    LOGV("qcamera_release_recording_frame: opaque:%p\n", opaque);
-   if (opaque != NULL) {
-       android::Vector<camera_memory_t*>::iterator it;
-       for (it = sentFrames.begin(); it != sentFrames.end(); ++it) {
-           camera_memory_t *mem = *it;
-           if (mem->data == opaque) {
-               mem->release(mem);
-               sentFrames.erase(it);
-               break;
-           }
-       }
+   if (opaque != NULL &&
+       !CameraHAL_PutRecordingSlot(&ctx->recordingPool, opaque, &frame)) {
+      LOGW("qcamera_release_recording_frame: unknown frame %p\n", opaque);
+   }
+   if (frame != NULL) {
+      ctx->qCamera->releaseRecordingFrame(frame);
    }
 }
 
 int 
 qcamera_auto_focus(struct camera_device * device)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+
+   if (ctx == NULL) {
+      return -EIO;
+   }
+
    LOGV("qcamera_auto_focus:\n");
-   qCamera->autoFocus();
+   android::Mutex::Autolock control(ctx->controlLock);
+   ctx->qCamera->autoFocus();
    return NO_ERROR;
 }
 
 int 
 qcamera_cancel_auto_focus(struct camera_device * device)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+
+   if (ctx == NULL) {
+      return -EIO;
+   }
+
    LOGV("qcamera_cancel_auto_focus:\n");
-   qCamera->cancelAutoFocus();
+   android::Mutex::Autolock control(ctx->controlLock);
+   ctx->qCamera->cancelAutoFocus();
    return NO_ERROR;
 }
 
 int 
 qcamera_take_picture(struct camera_device * device)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+
+   if (ctx == NULL) {
+      return -EIO;
+   }
+
    LOGV("qcamera_take_picture:\n");
 
+   android::Mutex::Autolock control(ctx->controlLock);
+   CameraHAL_InvalidateParams(ctx);
+   if (ctx->qCamera->recordingEnabled()) {
+      LOGV("qcamera_take_picture: taking a video snapshot\n");
+      return CameraHAL_VideoSnapshot(ctx);
+   }
+   if (CameraHAL_BurstTakeQueued(ctx)) {
+      LOGV("qcamera_take_picture: answering from the burst queue\n");
+      return NO_ERROR;
+   }
+   if (ctx->zslEnabled && CameraHAL_ZslCapture(ctx)) {
+      LOGV("qcamera_take_picture: capturing from the ZSL ring\n");
+      return NO_ERROR;
+   }
+   CameraHAL_BurstBegin(ctx, ctx->burstShots);
+
    /* TODO: Remove hack. */
-   qCamera->enableMsgType(CAMERA_MSG_SHUTTER |
-                         CAMERA_MSG_POSTVIEW_FRAME |
-                         CAMERA_MSG_RAW_IMAGE |
-                         CAMERA_MSG_COMPRESSED_IMAGE);
+   ctx->qCamera->enableMsgType(CAMERA_MSG_SHUTTER |
+                              CAMERA_MSG_POSTVIEW_FRAME |
+                              CAMERA_MSG_RAW_IMAGE |
+                              CAMERA_MSG_COMPRESSED_IMAGE);
 
-   qCamera->takePicture();
+   ctx->qCamera->takePicture();
    return NO_ERROR;
 }
 
 int 
 qcamera_cancel_picture(struct camera_device * device)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+
+   if (ctx == NULL) {
+      return -EIO;
+   }
+
    LOGV("camera_cancel_picture:\n");
-   qCamera->cancelPicture();
+   android::Mutex::Autolock control(ctx->controlLock);
+   {
+      android::Mutex::Autolock lock(ctx->burst.lock);
+      CameraHAL_BurstFinish(&ctx->burst);
+   }
+   ctx->qCamera->cancelPicture();
    return NO_ERROR;	
 }
 
 int 
 qcamera_set_parameters(struct camera_device * device, const char *params)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+   struct param_store         newParams;
+   struct param_changes       changes;
+   bool                       vendorChanged;
+   int                        burstShots;
+   int                        rc;
+
+   if (ctx == NULL) {
+      return -EIO;
+   }
+
    LOGV("qcamera_set_parameters: %s\n", params);
-   g_str = android::String8(params);
-   camSettings.unflatten(g_str);
-   qCamera->setParameters(camSettings);
+   android::Mutex::Autolock control(ctx->controlLock);
+   vendorChanged = android_atomic_acquire_load(&ctx->paramGeneration) !=
+                   ctx->appliedGeneration;
+   if (!vendorChanged && !ctx->appliedString.isEmpty() &&
+       strcmp(ctx->appliedString.string(), params) == 0) {
+      ctx->paramsSkipped++;
+      return NO_ERROR;
+   }
+
+   param_store_init(&newParams);
+   changes.reconfigure = true;
+   changes.picture     = true;
+   rc = param_store_unflatten(&newParams, params);
+   /* Clients hand back the statistics they read with the settings. */
+   for (unsigned int i = 0;
+        i < sizeof(lumaStatsKeys) / sizeof(lumaStatsKeys[0]); i++) {
+      param_store_remove(&newParams, lumaStatsKeys[i]);
+   }
+   if (rc < 0) {
+      /* Nothing to compare against next time, but still forward it. */
+      param_store_clear(&newParams);
+      ctx->appliedString.clear();
+   } else if (!ctx->appliedString.isEmpty()) {
+      changes.reconfigure = false;
+      changes.picture     = false;
+      if (param_store_diff(&ctx->appliedParams, &newParams,
+                           CameraHAL_NoteChangedParam, &changes) == 0 &&
+          !vendorChanged) {
+         /* Same set, different order or formatting. */
+         param_store_free(&newParams);
+         ctx->appliedString = params;
+         ctx->paramsSkipped++;
+         return NO_ERROR;
+      }
+      if (changes.reconfigure) {
+         LOGD("qcamera_set_parameters: reconfiguring for %s\n",
+              changes.names.string());
+      } else if (changes.names.isEmpty()) {
+         LOGV("qcamera_set_parameters: reapplying after a vendor change\n");
+      } else {
+         LOGV("qcamera_set_parameters: changed %s\n",
+              changes.names.string());
+      }
+   }
+
+   /* The vendor library reads back every key it knows about, so it has to
+    * be handed the whole set rather than only what changed. */
+   android::String8 paramString(params);
+   ctx->camSettings.unflatten(paramString);
+   for (unsigned int i = 0;
+        i < sizeof(lumaStatsKeys) / sizeof(lumaStatsKeys[0]); i++) {
+      ctx->camSettings.remove(lumaStatsKeys[i]);
+   }
+   if (ctx->rotatePreview) {
+      CameraHAL_PortraitParams(ctx->camSettings, true);
+   }
+   android_atomic_release_store(ctx->camSettings.get("luma-stats") != NULL &&
+                                strcmp(ctx->camSettings.get("luma-stats"),
+                                       "on") == 0,
+                                &ctx->lumaStatsEnabled);
+   CameraHAL_UpdatePreviewThrottle(ctx, &ctx->camSettings);
+   /* Like the throttle keys, a set without them keeps the old values. */
+   burstShots = ctx->burstShots;
+   if (ctx->camSettings.get("burst-count") != NULL) {
+      burstShots = ctx->camSettings.getInt("burst-count");
+   }
+   if (changes.picture || burstShots != ctx->burstShots) {
+      CameraHAL_BurstFlush(ctx);
+   }
+   ctx->burstShots = burstShots;
+   if (ctx->camSettings.get("zsl") != NULL) {
+      ctx->zslEnabled = strcmp(ctx->camSettings.get("zsl"), "on") == 0;
+   }
+   if (ctx->camSettings.getInt(
+          android::CameraParameters::KEY_JPEG_QUALITY) > 0) {
+      ctx->jpegQuality = ctx->camSettings.getInt(
+                            android::CameraParameters::KEY_JPEG_QUALITY);
+   }
+   ctx->camSettings.getPictureSize(&ctx->pictureWidth, &ctx->pictureHeight);
+   /* What the vendor library gets, since ZSL frames come straight off the
+    * sensor just like its own snapshots. */
+   if (ctx->camSettings.get(android::CameraParameters::KEY_ROTATION) != NULL) {
+      ctx->jpegRotation = ctx->camSettings.getInt(
+                             android::CameraParameters::KEY_ROTATION);
+   }
+   rc = ctx->qCamera->setParameters(ctx->camSettings);
+   CameraHAL_InvalidateParams(ctx);
+   ctx->appliedGeneration = android_atomic_acquire_load(&ctx->paramGeneration);
+   if (rc != NO_ERROR) {
+      LOGE("qcamera_set_parameters: ERROR %d applying %s\n", rc,
+           changes.names.string());
+      /* It may have been partially applied; do not trust the cache. */
+      ctx->appliedString.clear();
+      param_store_free(&newParams);
+   } else {
+      ctx->appliedString = paramString;
+      param_store_free(&ctx->appliedParams);
+      ctx->appliedParams = newParams;
+   }
+   ctx->paramsApplied++;
+   if (changes.reconfigure) {
+      ctx->paramsReconfigured++;
+      CameraHAL_UpdatePreviewGeometry(ctx);
+   }
    return NO_ERROR;
 }
 
 char* 
 qcamera_get_parameters(struct camera_device * device)
 { 
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
    char *rc = NULL;
+
+   int32_t generation;
+   android::String8 result;
+
+   if (ctx == NULL) {
+      return strdup("");
+   }
+
    LOGV("qcamera_get_parameters\n");
-   camSettings = qCamera->getParameters();
-   LOGV("qcamera_get_parameters: after calling qCamera->getParameters()\n");
-   CameraHAL_FixupParams(camSettings);
-   g_str = camSettings.flatten();
-   rc = strdup((char *)g_str.string());
+   android::Mutex::Autolock control(ctx->controlLock);
+   generation = android_atomic_acquire_load(&ctx->paramGeneration);
+   if (generation != ctx->cachedGeneration) {
+      ctx->camSettings = ctx->qCamera->getParameters();
+      LOGV("qcamera_get_parameters: after calling qCamera->getParameters()\n");
+      CameraHAL_FixupParams(ctx->camSettings);
+      CameraHAL_PublishWrapperParams(ctx, ctx->camSettings);
+      if (ctx->rotatePreview) {
+         CameraHAL_PortraitParams(ctx->camSettings, false);
+      }
+      ctx->paramString = ctx->camSettings.flatten();
+      ctx->cachedGeneration = generation;
+      ctx->paramCacheMisses++;
+   } else {
+      ctx->paramCacheHits++;
+   }
+   if (android_atomic_acquire_load(&ctx->lumaStatsEnabled)) {
+      /* Statistics change every frame, so they stay out of the cache. */
+      result = ctx->paramString;
+      if (ctx->camSettings.get("luma-stats") == NULL) {
+         result.append(";luma-stats=on");
+      }
+      CameraHAL_AppendLumaStats(ctx, result);
+      rc = strdup(result.string());
+   } else {
+      rc = strdup((char *)ctx->paramString.string());
+   }
    LOGV("camera_get_parameters: returning rc:%p :%s\n", 
         rc, (rc != NULL) ? rc : "EMPTY STRING");
    return rc;
@@ -561,25 +3729,166 @@ int
 qcamera_send_command(struct camera_device * device, int32_t cmd, 
                         int32_t arg0, int32_t arg1)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+   int rc;
+
+   if (ctx == NULL) {
+      return -EIO;
+   }
+
    LOGV("qcamera_send_command: cmd:%d arg0:%d arg1:%d\n", 
         cmd, arg0, arg1);
-   return qCamera->sendCommand(cmd, arg0, arg1);
+   android::Mutex::Autolock control(ctx->controlLock);
+   rc = ctx->qCamera->sendCommand(cmd, arg0, arg1);
+   /* Zoom commands move the zoom parameter; smooth zoom keeps moving it
+    * and reports each step with CAMERA_MSG_ZOOM. */
+   CameraHAL_InvalidateParams(ctx);
+   return rc;
 }
 
 void 
 qcamera_release(struct camera_device * device)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetOpenContext(device);
+
+   if (ctx == NULL) {
+      return;
+   }
+
    LOGV("camera_release:\n");
-   releaseCameraFrames();
-   qCamera->release();
+   /* The burst thread takes controlLock, so it is stopped first. */
+   CameraHAL_StopBurst(ctx);
+
+   android::Mutex::Autolock control(ctx->controlLock);
+   CameraHAL_SetRecordingPoolActive(&ctx->recordingPool, false);
+   CameraHAL_ReturnRecordingFrames(ctx);
+   CameraHAL_StopZsl(ctx);
+   CameraHAL_StopVideoSnapshot(ctx);
+   ctx->qCamera->release();
+   CameraHAL_StopPreviewThread(ctx);
+   CameraHAL_FreeRecordingPool(&ctx->recordingPool);
+   {
+      android::RWLock::AutoWLock lock(ctx->frameLock);
+      CameraHAL_CloseBlitSession(&ctx->previewBlit);
+   }
+   CameraHAL_ReleasePreviewClientHeap(&ctx->previewClientHeap);
+}
+
+void
+CameraHAL_DumpFrameStats(struct camera_hal_context *ctx,
+                         android::String8 &result)
+{
+   struct frame_stats_summary summary;
+
+   result.appendFormat("  Frame path latency (us, last %d samples):\n",
+                       FRAME_STATS_SAMPLES);
+   for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++) {
+      frame_stats_summarize(&ctx->frameStats[stage], &summary);
+      result.appendFormat("    %-18s n:%3d mean:%7d p50:%7d p95:%7d "
+                          "p99:%7d max:%7d\n",
+                          frame_stats_stage_name(stage), summary.count,
+                          summary.mean, summary.p50, summary.p95,
+                          summary.p99, summary.max);
+      if ((stage == FRAME_STAGE_PREVIEW_ARRIVAL ||
+           stage == FRAME_STAGE_RECORD_ARRIVAL) && summary.mean > 0) {
+         result.appendFormat("    %-18s %d.%02d fps\n",
+                             stage == FRAME_STAGE_PREVIEW_ARRIVAL ?
+                                "preview rate" : "record rate",
+                             100000000 / summary.mean / 100,
+                             100000000 / summary.mean % 100);
+      }
+   }
 }
 
 int 
 qcamera_dump(struct camera_device * device, int fd)
 {
+   struct camera_hal_context *ctx = CameraHAL_GetContext(device);
+
    LOGV("qcamera_dump:\n");
    android::Vector<android::String16> args;
-   return qCamera->dump(fd, args);
+   android::String8 result;
+
+   if (!CameraHAL_WaitOpen(ctx)) {
+      result.appendFormat("CameraHAL wrapper: camera %d failed to open\n",
+                          ctx->cameraId);
+      write(fd, result.string(), result.size());
+      return NO_ERROR;
+   }
+
+   android::Mutex::Autolock control(ctx->controlLock);
+   result.appendFormat("CameraHAL wrapper: camera %d\n", ctx->cameraId);
+   result.appendFormat("  Vendor library: %s loaded in %lldms\n",
+                       VENDOR_CAMERA_LIBRARY, ns2ms(gVendor.loadTime));
+   result.appendFormat("  Open: %lldms%s, first preview frame %lldms after "
+                       "open, %lldms after start_preview\n",
+                       ns2ms(ctx->openCompleted - ctx->openRequested),
+                       ctx->prewarmed ? " (pre-warmed)" : "",
+                       ctx->firstPreviewFrame ?
+                          ns2ms(ctx->firstPreviewFrame - ctx->openRequested) :
+                          -1LL,
+                       ns2ms(ctx->startToFirstFrame));
+   {
+      android::Mutex::Autolock lock(ctx->openLock);
+      result.appendFormat("  Open gate: %u ops waited %lldms in all\n",
+                          ctx->openWaits, ns2ms(ctx->openWaitTime));
+   }
+   {
+      android::Mutex::Autolock lock(gPrewarm.lock);
+      result.appendFormat("  Pre-warm: used:%u expired:%u skipped:%u "
+                          "misses:%u\n", gPrewarm.used, gPrewarm.expired,
+                          gPrewarm.skipped, gPrewarm.misses);
+   }
+   result.appendFormat("  Preview render: %s %s rendered:%d dropped:%d\n",
+                       ctx->previewThread != NULL ? "async" : "sync",
+                       ctx->previewStream.format ==
+                          HAL_PIXEL_FORMAT_YCrCb_420_SP ? "yuv" : "rgbx",
+                       android_atomic_acquire_load(&ctx->previewQueue.rendered),
+                       android_atomic_acquire_load(&ctx->previewQueue.dropped));
+   result.appendFormat("  Parameters: applied:%u skipped:%u "
+                       "reconfigured:%u cache hits:%u misses:%u\n",
+                       ctx->paramsApplied, ctx->paramsSkipped,
+                       ctx->paramsReconfigured, ctx->paramCacheHits,
+                       ctx->paramCacheMisses);
+   result.appendFormat("  Throttle: render %dus passed:%d skipped:%d, "
+                       "callback %dus passed:%d skipped:%d\n",
+                       ctx->renderPacer.intervalUs, ctx->renderPacer.passed,
+                       ctx->renderPacer.skipped, ctx->callbackPacer.intervalUs,
+                       ctx->callbackPacer.passed, ctx->callbackPacer.skipped);
+   {
+      struct burst_capture *burst = &ctx->burst;
+      android::Mutex::Autolock lock(burst->lock);
+      int rate = burst->totalTime > 0 ?
+                    (int)(burst->shots * 100000000000LL / burst->totalTime) : 0;
+      result.appendFormat("  Burst: bursts:%u shots:%u %d.%02d shots/s "
+                          "queued:%u\n", burst->bursts, burst->shots,
+                          rate / 100, rate % 100, burst->numQueued);
+   }
+   {
+      struct zsl_ring *ring = &ctx->zslRing;
+      android::Mutex::Autolock lock(ring->lock);
+      result.appendFormat("  ZSL: %s %dx%d captures:%u avg lag:%lldus "
+                          "avg encode:%lldus\n",
+                          ctx->zslEnabled ? "on" : "off", ring->width,
+                          ring->height, ring->captures,
+                          ring->captures ?
+                             ring->totalLag / ring->captures / 1000 : 0LL,
+                          ring->captures ?
+                             ring->totalEncode / ring->captures / 1000 : 0LL);
+   }
+   {
+      struct video_snapshot *snap = &ctx->videoSnapshot;
+      android::Mutex::Autolock lock(snap->lock);
+      result.appendFormat("  Video snapshot: taken:%u avg latency:%lldms "
+                          "max:%lldms recording frames dropped:%u\n",
+                          snap->taken,
+                          snap->taken ?
+                             ns2ms(snap->totalLatency) / snap->taken : 0LL,
+                          ns2ms(snap->maxLatency), snap->dropped);
+   }
+   CameraHAL_DumpFrameStats(ctx, result);
+   write(fd, result.string(), result.size());
+   return ctx->qCamera->dump(fd, args);
 }
 
 int 
@@ -589,14 +3898,25 @@ camera_device_close(hw_device_t* device)
    LOGD("camera_device_close\n");
    camera_device_t *cameraDev = (camera_device_t *)device;
    if (cameraDev) {
-      camera_device_ops_t *camera_ops = cameraDev->ops;
-      if (camera_ops) {
-         if (qCamera != NULL) {
-            qCamera.clear();
-         }
-         free(camera_ops);
+      struct camera_hal_context *ctx = CameraHAL_GetContext(cameraDev);
+      CameraHAL_WaitOpen(ctx);
+      ctx->openThread->requestExitAndWait();
+      ctx->openThread.clear();
+      CameraHAL_StopBurst(ctx);
+      CameraHAL_StopZsl(ctx);
+      CameraHAL_StopVideoSnapshot(ctx);
+      CameraHAL_StopPreviewThread(ctx);
+      CameraHAL_SetRecordingPoolActive(&ctx->recordingPool, false);
+      CameraHAL_FreeRecordingPool(&ctx->recordingPool);
+      CameraHAL_CloseBlitSession(&ctx->previewBlit);
+      CameraHAL_ReleasePreviewClientHeap(&ctx->previewClientHeap);
+      ctx->qCamera.clear();
+      param_store_free(&ctx->appliedParams);
+      delete ctx;
+      {
+         android::Mutex::Autolock lock(gPrewarm.lock);
+         gPrewarm.devicesOpen--;
       }
-      free(cameraDev);
       rc = NO_ERROR;
    }
    return rc;
@@ -612,20 +3932,39 @@ qcamera_device_open(const hw_module_t* module, const char* name,
    LOGD("qcamera_device_open: name:%s device:%p cameraId:%d\n", 
         name, device, cameraId);
 
-   qCamera = HAL_openCameraHardware(cameraId, 5);
-   camera_device_t* camera_device = NULL;
-   camera_device_ops_t* camera_ops = NULL;
+   if (cameraId < 0 || cameraId >= MAX_CAMERAS ||
+       cameraId >= CameraHAL_GetNumberOfCameras()) {
+      LOGE("qcamera_device_open: Invalid camera id %d\n", cameraId);
+      return -EINVAL;
+   }
+
+   {
+      android::Mutex::Autolock lock(gPrewarm.lock);
+      gPrewarm.devicesOpen++;
+      gPrewarm.misses = 0;
+      gPrewarm.cond.broadcast();
+   }
+
+   struct camera_hal_context *ctx = new camera_hal_context();
+   ctx->cameraId        = cameraId;
+   ctx->openRequested   = systemTime();
+   ctx->rotatePreview   = CameraHAL_PreRotatePreview(cameraId);
+   ctx->previewBlit.fd  = -1;
+   ctx->paramGeneration = 1;
+   ctx->throttleParams[0] = ctx->throttleParams[1] = -1;
+   ctx->burstShots      = -1;
+   ctx->zslRing.pending = -1;
+   ctx->jpegQuality     = 85;
 
-   camera_device = (camera_device_t*)malloc(sizeof(*camera_device));
-   camera_ops = (camera_device_ops_t*)malloc(sizeof(*camera_ops));
-   memset(camera_device, 0, sizeof(*camera_device));
-   memset(camera_ops, 0, sizeof(*camera_ops));
+   camera_device_t* camera_device = &ctx->device;
+   camera_device_ops_t* camera_ops = &ctx->ops;
 
    camera_device->common.tag              = HARDWARE_DEVICE_TAG;
    camera_device->common.version          = 0;
    camera_device->common.module           = (hw_module_t *)(module);
    camera_device->common.close            = camera_device_close;
    camera_device->ops                     = camera_ops;	
+   camera_device->priv                    = ctx;
            
    camera_ops->set_preview_window         = qcamera_set_preview_window;
    camera_ops->set_callbacks              = qcamera_set_callbacks;
@@ -652,6 +3991,18 @@ qcamera_device_open(const hw_module_t* module, const char* name,
    camera_ops->release                    = qcamera_release;
    camera_ops->dump                       = qcamera_dump;
 
+   /* The vendor open takes hundreds of milliseconds, so it is finished off
+    * the binder thread while the framework sets the device up. */
+   ctx->openThread = new CameraOpenThread(ctx);
+   if (ctx->openThread->run("CameraOpen") != NO_ERROR) {
+      LOGE("qcamera_device_open: ERROR starting the open thread\n");
+      ctx->openThread.clear();
+      delete ctx;
+      android::Mutex::Autolock lock(gPrewarm.lock);
+      gPrewarm.devicesOpen--;
+      return -EIO;
+   }
+
    *device = &camera_device->common;
 
    return NO_ERROR;
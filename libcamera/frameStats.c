@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/atomic.h>
+#include "frameStats.h"
+
+static const char *stage_names[FRAME_STAGE_COUNT] = {
+   "preview arrival",
+   "window dequeue",
+   "blit",
+   "window enqueue",
+   "client copy",
+   "record arrival",
+   "timestamp latency",
+   "luma stats",
+};
+
+const char *
+frame_stats_stage_name(int stage)
+{
+   return (stage >= 0 && stage < FRAME_STAGE_COUNT) ? stage_names[stage] : "?";
+}
+
+void
+frame_stats_reset(struct frame_stage_stats *stats)
+{
+   android_atomic_release_store(0, &stats->next);
+}
+
+void
+frame_stats_record(struct frame_stage_stats *stats, int64_t ns)
+{
+   int32_t slot = android_atomic_inc(&stats->next);
+   int64_t us   = ns / 1000;
+
+   if (us > INT32_MAX) {
+      us = INT32_MAX;
+   } else if (us < 0) {
+      us = 0;
+   }
+   stats->samples[slot & (FRAME_STATS_SAMPLES - 1)] = (int32_t)us;
+}
+
+static int
+compare_samples(const void *a, const void *b)
+{
+   int32_t x = *(const int32_t *)a;
+   int32_t y = *(const int32_t *)b;
+
+   return (x > y) - (x < y);
+}
+
+void
+frame_stats_summarize(const struct frame_stage_stats *stats,
+                      struct frame_stats_summary *summary)
+{
+   int32_t sorted[FRAME_STATS_SAMPLES];
+   int64_t total = 0;
+   int32_t recorded = android_atomic_acquire_load(&stats->next);
+   int     count = recorded;
+   int     i;
+
+   /* The counter is only ever incremented, a wrap just means "full". */
+   if (count < 0 || count > FRAME_STATS_SAMPLES) {
+      count = FRAME_STATS_SAMPLES;
+   }
+
+   memset(summary, 0, sizeof(*summary));
+   if (count == 0) {
+      return;
+   }
+
+   memcpy(sorted, stats->samples, count * sizeof(sorted[0]));
+   qsort(sorted, count, sizeof(sorted[0]), compare_samples);
+   for (i = 0; i < count; i++) {
+      total += sorted[i];
+   }
+
+   summary->count = count;
+   summary->mean  = (int32_t)(total / count);
+   summary->p50   = sorted[(count - 1) * 50 / 100];
+   summary->p95   = sorted[(count - 1) * 95 / 100];
+   summary->p99   = sorted[(count - 1) * 99 / 100];
+   summary->max   = sorted[count - 1];
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAMERA_HAL_FRAME_STATS_H
+#define CAMERA_HAL_FRAME_STATS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of recent samples kept per stage, must be a power of two. */
+#define FRAME_STATS_SAMPLES 256
+
+enum {
+   FRAME_STAGE_PREVIEW_ARRIVAL,   /* interval between preview callbacks */
+   FRAME_STAGE_DEQUEUE,           /* window dequeue_buffer + lock_buffer */
+   FRAME_STAGE_BLIT,              /* MDP blit or CPU fallback */
+   FRAME_STAGE_ENQUEUE,           /* window enqueue_buffer */
+   FRAME_STAGE_CLIENT_COPY,       /* copy into client memory */
+   FRAME_STAGE_RECORD_ARRIVAL,    /* interval between recording callbacks */
+   FRAME_STAGE_TIMESTAMP_LATENCY, /* systemTime() - sensor timestamp */
+   FRAME_STAGE_LUMA_STATS,        /* preview luma statistics */
+   FRAME_STAGE_COUNT
+};
+
+/*
+ * Ring of the most recent samples of one stage, in microseconds. Writers
+ * claim a slot with an atomic increment and never block; a reader may see
+ * a sample being replaced, which only matters for a single statistic.
+ */
+struct frame_stage_stats {
+   volatile int32_t next;
+   int32_t          samples[FRAME_STATS_SAMPLES];
+};
+
+struct frame_stats_summary {
+   int     count;
+   int32_t mean;
+   int32_t p50;
+   int32_t p95;
+   int32_t p99;
+   int32_t max;
+};
+
+const char *frame_stats_stage_name(int stage);
+void frame_stats_reset(struct frame_stage_stats *stats);
+void frame_stats_record(struct frame_stage_stats *stats, int64_t ns);
+void frame_stats_summarize(const struct frame_stage_stats *stats,
+                           struct frame_stats_summary *summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,701 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CameraHAL"
+
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/log.h>
+#include "jpegEncode.h"
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+/*
+ * Baseline sequential JPEG with the example tables of ITU T.81 Annex K.
+ * The forward DCT is the AAN algorithm, whose output is scaled per
+ * coefficient; the scale is folded into the quantizer reciprocals.
+ */
+
+/* Worst case output of one MCU: six blocks of 64 coefficients with a
+ * 16 bit code and 11 extra bits each, all of it byte stuffed, plus a byte
+ * of bits left over from the MCU before. */
+#define MCU_WORST_BYTES (6 * 64 * (16 + 11) * 2 / 8 + 1)
+#define MCU_MAX_BYTES   4096
+
+typedef char mcu_max_bytes_check[MCU_MAX_BYTES >= MCU_WORST_BYTES ? 1 : -1];
+
+/* Reciprocal precision of the quantizer. */
+#define RECIP_BITS      24
+
+static const uint8_t zigzag[64] = {
+    0,  1,  8, 16,  9,  2,  3, 10,
+   17, 24, 32, 25, 18, 11,  4,  5,
+   12, 19, 26, 33, 40, 48, 41, 34,
+   27, 20, 13,  6,  7, 14, 21, 28,
+   35, 42, 49, 56, 57, 50, 43, 36,
+   29, 22, 15, 23, 30, 37, 44, 51,
+   58, 59, 52, 45, 38, 31, 39, 46,
+   53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static const uint8_t lumaQuant[64] = {
+   16,  11,  10,  16,  24,  40,  51,  61,
+   12,  12,  14,  19,  26,  58,  60,  55,
+   14,  13,  16,  24,  40,  57,  69,  56,
+   14,  17,  22,  29,  51,  87,  80,  62,
+   18,  22,  37,  56,  68, 109, 103,  77,
+   24,  35,  55,  64,  81, 104, 113,  92,
+   49,  64,  78,  87, 103, 121, 120, 101,
+   72,  92,  95,  98, 112, 100, 103,  99
+};
+
+static const uint8_t chromaQuant[64] = {
+   17,  18,  24,  47,  99,  99,  99,  99,
+   18,  21,  26,  66,  99,  99,  99,  99,
+   24,  26,  56,  99,  99,  99,  99,  99,
+   47,  66,  99,  99,  99,  99,  99,  99,
+   99,  99,  99,  99,  99,  99,  99,  99,
+   99,  99,  99,  99,  99,  99,  99,  99,
+   99,  99,  99,  99,  99,  99,  99,  99,
+   99,  99,  99,  99,  99,  99,  99,  99
+};
+
+/* cos(k * pi / 16) * sqrt(2), with 1 for k = 0. */
+static const double aanScale[8] = {
+   1.0, 1.387039845, 1.306562965, 1.175875602,
+   1.0, 0.785694958, 0.541196100, 0.275899379
+};
+
+/* Huffman tables as code counts per length 1..16, then the symbols. */
+static const uint8_t dcLumaBits[16] = {
+   0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0
+};
+static const uint8_t dcChromaBits[16] = {
+   0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0
+};
+static const uint8_t dcValues[12] = {
+   0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11
+};
+
+static const uint8_t acLumaBits[16] = {
+   0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d
+};
+static const uint8_t acLumaValues[162] = {
+   0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+   0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+   0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+   0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+   0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+   0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+   0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+   0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+   0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+   0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+   0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+   0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+   0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+   0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+   0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+   0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+   0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+   0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+   0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+   0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+   0xf9, 0xfa
+};
+
+static const uint8_t acChromaBits[16] = {
+   0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77
+};
+static const uint8_t acChromaValues[162] = {
+   0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+   0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+   0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+   0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+   0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+   0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+   0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+   0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+   0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+   0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+   0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+   0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+   0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+   0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+   0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+   0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+   0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+   0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+   0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+   0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+   0xf9, 0xfa
+};
+
+struct huff_table {
+   uint16_t code[256];
+   uint8_t  size[256];    /* 0 for symbols the table lacks */
+};
+
+struct component {
+   uint8_t                  quant[64];    /* zigzag order, as written */
+   uint32_t                 recip[64];    /* natural order, DCT scaled */
+   const struct huff_table *dc;
+   const struct huff_table *ac;
+   int                      lastDc;
+};
+
+struct jpeg_writer {
+   uint8_t  *buffer;
+   size_t    size;
+   size_t    pos;
+   uint32_t  bits;
+   int       numBits;
+};
+
+static void
+build_huff_table(struct huff_table *table, const uint8_t *bits,
+                 const uint8_t *values)
+{
+   unsigned int code = 0;
+   int          len, i, k = 0;
+
+   memset(table->size, 0, sizeof(table->size));
+   for (len = 1; len <= 16; len++) {
+      for (i = 0; i < bits[len - 1]; i++) {
+         table->code[values[k]] = code++;
+         table->size[values[k]] = len;
+         k++;
+      }
+      code <<= 1;
+   }
+}
+
+static void
+build_component(struct component *comp, const uint8_t *base, int quality,
+                const struct huff_table *dc, const struct huff_table *ac)
+{
+   int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+   int k;
+
+   for (k = 0; k < 64; k++) {
+      int q = (base[k] * scale + 50) / 100;
+
+      q = q < 1 ? 1 : (q > 255 ? 255 : q);
+      comp->recip[k] = (uint32_t)((1 << RECIP_BITS) /
+                                  (q * aanScale[k >> 3] * aanScale[k & 7] * 8)
+                                  + 0.5);
+   }
+   for (k = 0; k < 64; k++) {
+      int q = (base[zigzag[k]] * scale + 50) / 100;
+
+      comp->quant[k] = q < 1 ? 1 : (q > 255 ? 255 : q);
+   }
+   comp->dc     = dc;
+   comp->ac     = ac;
+   comp->lastDc = 0;
+}
+
+static int
+writer_reserve(struct jpeg_writer *w, size_t bytes)
+{
+   uint8_t *buffer;
+   size_t   size = w->size;
+
+   if (w->pos + bytes <= w->size) {
+      return 0;
+   }
+   while (w->pos + bytes > size) {
+      size *= 2;
+   }
+   buffer = (uint8_t *)realloc(w->buffer, size);
+   if (buffer == NULL) {
+      LOGE("jpeg_encode_nv21: out of memory\n");
+      return -1;
+   }
+   w->buffer = buffer;
+   w->size   = size;
+   return 0;
+}
+
+static inline void
+put_byte(struct jpeg_writer *w, int byte)
+{
+   w->buffer[w->pos++] = (uint8_t)byte;
+}
+
+static inline void
+put_word(struct jpeg_writer *w, int word)
+{
+   put_byte(w, word >> 8);
+   put_byte(w, word & 0xff);
+}
+
+/* Appends len (<= 16) bits of entropy coded data, stuffing 0xff bytes. */
+static inline void
+put_bits(struct jpeg_writer *w, unsigned int code, int len)
+{
+   w->bits     = (w->bits << len) | (code & ((1u << len) - 1));
+   w->numBits += len;
+   while (w->numBits >= 8) {
+      int byte = (w->bits >> (w->numBits - 8)) & 0xff;
+
+      put_byte(w, byte);
+      if (byte == 0xff) {
+         put_byte(w, 0);
+      }
+      w->numBits -= 8;
+   }
+}
+
+static void
+flush_bits(struct jpeg_writer *w)
+{
+   if (w->numBits > 0) {
+      put_bits(w, 0x7f, 8 - w->numBits);
+   }
+}
+
+static void
+put_huff_table(struct jpeg_writer *w, int id, const uint8_t *bits,
+               const uint8_t *values, int count)
+{
+   put_byte(w, id);
+   memcpy(w->buffer + w->pos, bits, 16);
+   w->pos += 16;
+   memcpy(w->buffer + w->pos, values, count);
+   w->pos += count;
+}
+
+/* EXIF orientation for a clockwise rotation in degrees, 0 if none. */
+static int
+exif_orientation(int rotation)
+{
+   switch (rotation) {
+   case 90:
+      return 6;
+   case 180:
+      return 3;
+   case 270:
+      return 8;
+   default:
+      return 0;
+   }
+}
+
+static void
+put_headers(struct jpeg_writer *w, int width, int height, int orientation,
+            const struct component *luma, const struct component *chroma)
+{
+   static const uint8_t jfif[] = {
+      0xff, 0xe0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01,
+      0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00
+   };
+   /* A big endian TIFF header and an IFD0 holding only Orientation. */
+   static const uint8_t exif[] = {
+      0xff, 0xe1, 0x00, 0x22, 'E', 'x', 'i', 'f', 0x00, 0x00,
+      'M', 'M', 0x00, 0x2a, 0x00, 0x00, 0x00, 0x08,
+      0x00, 0x01,
+      0x01, 0x12, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01
+   };
+   int i;
+
+   put_word(w, 0xffd8);
+   if (orientation != 0) {
+      memcpy(w->buffer + w->pos, exif, sizeof(exif));
+      w->pos += sizeof(exif);
+      put_word(w, orientation);
+      put_word(w, 0);
+      put_word(w, 0);
+      put_word(w, 0);
+   } else {
+      memcpy(w->buffer + w->pos, jfif, sizeof(jfif));
+      w->pos += sizeof(jfif);
+   }
+
+   put_word(w, 0xffdb);
+   put_word(w, 2 + 2 * 65);
+   put_byte(w, 0);
+   memcpy(w->buffer + w->pos, luma->quant, 64);
+   w->pos += 64;
+   put_byte(w, 1);
+   memcpy(w->buffer + w->pos, chroma->quant, 64);
+   w->pos += 64;
+
+   /* Y sampled 2x2, Cb and Cr 1x1. */
+   put_word(w, 0xffc0);
+   put_word(w, 17);
+   put_byte(w, 8);
+   put_word(w, height);
+   put_word(w, width);
+   put_byte(w, 3);
+   for (i = 1; i <= 3; i++) {
+      put_byte(w, i);
+      put_byte(w, i == 1 ? 0x22 : 0x11);
+      put_byte(w, i == 1 ? 0 : 1);
+   }
+
+   put_word(w, 0xffc4);
+   put_word(w, 2 + 4 * 17 + 2 * 12 + 2 * 162);
+   put_huff_table(w, 0x00, dcLumaBits, dcValues, 12);
+   put_huff_table(w, 0x10, acLumaBits, acLumaValues, 162);
+   put_huff_table(w, 0x01, dcChromaBits, dcValues, 12);
+   put_huff_table(w, 0x11, acChromaBits, acChromaValues, 162);
+
+   put_word(w, 0xffda);
+   put_word(w, 12);
+   put_byte(w, 3);
+   for (i = 1; i <= 3; i++) {
+      put_byte(w, i);
+      put_byte(w, i == 1 ? 0x00 : 0x11);
+   }
+   put_byte(w, 0);
+   put_byte(w, 63);
+   put_byte(w, 0);
+}
+
+/*
+ * Copies an 8x8 block of samples step bytes apart out of a plane, repeating
+ * the last row and column where the block runs over the edge.
+ */
+static void
+load_block(uint8_t *block, const uint8_t *plane, int stride, int step,
+           int x, int y, int width, int height)
+{
+   int row, col;
+
+   if (step == 1 && x + 8 <= width && y + 8 <= height) {
+      for (row = 0; row < 8; row++) {
+         memcpy(block + row * 8, plane + (y + row) * stride + x, 8);
+      }
+      return;
+   }
+   for (row = 0; row < 8; row++) {
+      const uint8_t *src = plane +
+                           (y + row < height ? y + row : height - 1) * stride;
+
+      for (col = 0; col < 8; col++) {
+         block[row * 8 + col] =
+            src[(x + col < width ? x + col : width - 1) * step];
+      }
+   }
+}
+
+/* Fixed point constants of the AAN butterflies, 14 fractional bits. */
+#define FIX_0_382683433  6270
+#define FIX_0_541196100  8867
+#define FIX_0_707106781  11585
+#define FIX_1_306562965  21407
+#define MULTIPLY(v, c)   (((v) * (c) + (1 << 13)) >> 14)
+
+void
+jpeg_fdct_ref(const uint8_t *block, int16_t *coef)
+{
+   int data[64];
+   int pass, i;
+
+   for (i = 0; i < 64; i++) {
+      data[i] = block[i] - 128;
+   }
+
+   /* Rows, then columns. */
+   for (pass = 0; pass < 2; pass++) {
+      int step  = pass == 0 ? 1 : 8;
+      int next  = pass == 0 ? 8 : 1;
+
+      for (i = 0; i < 8; i++) {
+         int *d = data + i * next;
+         int tmp0 = d[0] + d[7 * step], tmp7 = d[0] - d[7 * step];
+         int tmp1 = d[step] + d[6 * step], tmp6 = d[step] - d[6 * step];
+         int tmp2 = d[2 * step] + d[5 * step];
+         int tmp5 = d[2 * step] - d[5 * step];
+         int tmp3 = d[3 * step] + d[4 * step];
+         int tmp4 = d[3 * step] - d[4 * step];
+         int tmp10, tmp11, tmp12, tmp13, z1, z2, z3, z4, z5, z11, z13;
+
+         tmp10 = tmp0 + tmp3;
+         tmp13 = tmp0 - tmp3;
+         tmp11 = tmp1 + tmp2;
+         tmp12 = tmp1 - tmp2;
+         d[0]        = tmp10 + tmp11;
+         d[4 * step] = tmp10 - tmp11;
+         z1 = MULTIPLY(tmp12 + tmp13, FIX_0_707106781);
+         d[2 * step] = tmp13 + z1;
+         d[6 * step] = tmp13 - z1;
+
+         tmp10 = tmp4 + tmp5;
+         tmp11 = tmp5 + tmp6;
+         tmp12 = tmp6 + tmp7;
+         z5  = MULTIPLY(tmp10 - tmp12, FIX_0_382683433);
+         z2  = MULTIPLY(tmp10, FIX_0_541196100) + z5;
+         z4  = MULTIPLY(tmp12, FIX_1_306562965) + z5;
+         z3  = MULTIPLY(tmp11, FIX_0_707106781);
+         z11 = tmp7 + z3;
+         z13 = tmp7 - z3;
+         d[5 * step] = z13 + z2;
+         d[3 * step] = z13 - z2;
+         d[step]     = z11 + z4;
+         d[7 * step] = z11 - z4;
+      }
+   }
+   for (i = 0; i < 64; i++) {
+      coef[i] = (int16_t)data[i];
+   }
+}
+
+#ifdef __ARM_NEON__
+/* vqrdmulh takes Q15 constants; 1.306... is split into 1 + 0.306...
+ * It rounds like MULTIPLY, where vqdmulh would truncate every product. */
+#define Q15_0_382683433  12540
+#define Q15_0_541196100  17734
+#define Q15_0_707106781  23170
+#define Q15_0_306562965  10045
+
+/* One AAN pass over eight vectors, i.e. eight 1-D transforms at once. */
+static inline void
+fdct_pass_neon(int16x8_t *d)
+{
+   int16x8_t tmp0 = vaddq_s16(d[0], d[7]), tmp7 = vsubq_s16(d[0], d[7]);
+   int16x8_t tmp1 = vaddq_s16(d[1], d[6]), tmp6 = vsubq_s16(d[1], d[6]);
+   int16x8_t tmp2 = vaddq_s16(d[2], d[5]), tmp5 = vsubq_s16(d[2], d[5]);
+   int16x8_t tmp3 = vaddq_s16(d[3], d[4]), tmp4 = vsubq_s16(d[3], d[4]);
+   int16x8_t tmp10, tmp11, tmp12, tmp13, z1, z2, z3, z4, z5, z11, z13;
+
+   tmp10 = vaddq_s16(tmp0, tmp3);
+   tmp13 = vsubq_s16(tmp0, tmp3);
+   tmp11 = vaddq_s16(tmp1, tmp2);
+   tmp12 = vsubq_s16(tmp1, tmp2);
+   d[0] = vaddq_s16(tmp10, tmp11);
+   d[4] = vsubq_s16(tmp10, tmp11);
+   z1   = vqrdmulhq_n_s16(vaddq_s16(tmp12, tmp13), Q15_0_707106781);
+   d[2] = vaddq_s16(tmp13, z1);
+   d[6] = vsubq_s16(tmp13, z1);
+
+   tmp10 = vaddq_s16(tmp4, tmp5);
+   tmp11 = vaddq_s16(tmp5, tmp6);
+   tmp12 = vaddq_s16(tmp6, tmp7);
+   z5  = vqrdmulhq_n_s16(vsubq_s16(tmp10, tmp12), Q15_0_382683433);
+   z2  = vaddq_s16(vqrdmulhq_n_s16(tmp10, Q15_0_541196100), z5);
+   z4  = vaddq_s16(vaddq_s16(tmp12,
+                             vqrdmulhq_n_s16(tmp12, Q15_0_306562965)), z5);
+   z3  = vqrdmulhq_n_s16(tmp11, Q15_0_707106781);
+   z11 = vaddq_s16(tmp7, z3);
+   z13 = vsubq_s16(tmp7, z3);
+   d[5] = vaddq_s16(z13, z2);
+   d[3] = vsubq_s16(z13, z2);
+   d[1] = vaddq_s16(z11, z4);
+   d[7] = vsubq_s16(z11, z4);
+}
+
+static inline void
+transpose_neon(int16x8_t *d)
+{
+   int16x8x2_t a0 = vtrnq_s16(d[0], d[1]);
+   int16x8x2_t a1 = vtrnq_s16(d[2], d[3]);
+   int16x8x2_t a2 = vtrnq_s16(d[4], d[5]);
+   int16x8x2_t a3 = vtrnq_s16(d[6], d[7]);
+   int32x4x2_t b0 = vtrnq_s32(vreinterpretq_s32_s16(a0.val[0]),
+                              vreinterpretq_s32_s16(a1.val[0]));
+   int32x4x2_t b1 = vtrnq_s32(vreinterpretq_s32_s16(a0.val[1]),
+                              vreinterpretq_s32_s16(a1.val[1]));
+   int32x4x2_t b2 = vtrnq_s32(vreinterpretq_s32_s16(a2.val[0]),
+                              vreinterpretq_s32_s16(a3.val[0]));
+   int32x4x2_t b3 = vtrnq_s32(vreinterpretq_s32_s16(a2.val[1]),
+                              vreinterpretq_s32_s16(a3.val[1]));
+
+   d[0] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b0.val[0]),
+                                             vget_low_s32(b2.val[0])));
+   d[4] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b0.val[0]),
+                                             vget_high_s32(b2.val[0])));
+   d[1] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b1.val[0]),
+                                             vget_low_s32(b3.val[0])));
+   d[5] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b1.val[0]),
+                                             vget_high_s32(b3.val[0])));
+   d[2] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b0.val[1]),
+                                             vget_low_s32(b2.val[1])));
+   d[6] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b0.val[1]),
+                                             vget_high_s32(b2.val[1])));
+   d[3] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b1.val[1]),
+                                             vget_low_s32(b3.val[1])));
+   d[7] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b1.val[1]),
+                                             vget_high_s32(b3.val[1])));
+}
+
+static void
+fdct_neon(const uint8_t *block, int16_t *coef)
+{
+   const uint8x8_t bias = vdup_n_u8(128);
+   int16x8_t       d[8];
+   int             i;
+
+   for (i = 0; i < 8; i++) {
+      d[i] = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(block + i * 8), bias));
+   }
+   /* Transposed, the pass runs along the rows; transposed back, along
+    * the columns, which leaves coefficient (u, v) in lane v of d[u]. */
+   transpose_neon(d);
+   fdct_pass_neon(d);
+   transpose_neon(d);
+   fdct_pass_neon(d);
+   for (i = 0; i < 8; i++) {
+      vst1q_s16(coef + i * 8, d[i]);
+   }
+}
+#endif
+
+void
+jpeg_fdct(const uint8_t *block, int16_t *coef)
+{
+#ifdef __ARM_NEON__
+   fdct_neon(block, coef);
+#else
+   jpeg_fdct_ref(block, coef);
+#endif
+}
+
+static inline int
+num_bits(unsigned int v)
+{
+   int n = 0;
+
+   while (v != 0) {
+      n++;
+      v >>= 1;
+   }
+   return n;
+}
+
+static void
+encode_block(struct jpeg_writer *w, struct component *comp,
+             const uint8_t *block)
+{
+   int16_t coef[64];
+   int     quant[64];
+   int     k, run, diff, bits;
+
+   jpeg_fdct(block, coef);
+
+   for (k = 0; k < 64; k++) {
+      int      c = coef[zigzag[k]];
+      uint32_t a = c < 0 ? -c : c;
+      int      q = (int)(((uint64_t)a * comp->recip[zigzag[k]] +
+                          (1 << (RECIP_BITS - 1))) >> RECIP_BITS);
+
+      /* Baseline limits AC values to 10 bits and DC to 11. */
+      if (q > (k == 0 ? 2047 : 1023)) {
+         q = k == 0 ? 2047 : 1023;
+      }
+      quant[k] = c < 0 ? -q : q;
+   }
+
+   diff = quant[0] - comp->lastDc;
+   comp->lastDc = quant[0];
+   bits = num_bits(diff < 0 ? -diff : diff);
+   put_bits(w, comp->dc->code[bits], comp->dc->size[bits]);
+   if (bits != 0) {
+      put_bits(w, diff < 0 ? diff - 1 : diff, bits);
+   }
+
+   run = 0;
+   for (k = 1; k < 64; k++) {
+      int v = quant[k];
+
+      if (v == 0) {
+         run++;
+         continue;
+      }
+      while (run > 15) {
+         put_bits(w, comp->ac->code[0xf0], comp->ac->size[0xf0]);
+         run -= 16;
+      }
+      bits = num_bits(v < 0 ? -v : v);
+      put_bits(w, comp->ac->code[(run << 4) | bits],
+               comp->ac->size[(run << 4) | bits]);
+      put_bits(w, v < 0 ? v - 1 : v, bits);
+      run = 0;
+   }
+   if (run > 0) {
+      put_bits(w, comp->ac->code[0x00], comp->ac->size[0x00]);
+   }
+}
+
+int
+jpeg_encode_nv21(const uint8_t *src, int width, int height, int quality,
+                 int rotation, uint8_t **out, size_t *outSize)
+{
+   struct huff_table  dcLuma, acLuma, dcChroma, acChroma;
+   struct component   luma, cb, cr;
+   struct jpeg_writer w;
+   const uint8_t     *chroma = src + width * height;
+   uint8_t            block[64];
+   int                cw = width / 2, ch = height / 2;
+   int                x, y, i;
+
+   /* NV21 needs an even size for its half resolution chroma. */
+   if (width <= 0 || height <= 0 || width > 65534 || height > 65534 ||
+       ((width | height) & 1) != 0) {
+      LOGE("jpeg_encode_nv21: unsupported size %dx%d\n", width, height);
+      return -1;
+   }
+   quality = quality < 1 ? 1 : (quality > 100 ? 100 : quality);
+
+   build_huff_table(&dcLuma, dcLumaBits, dcValues);
+   build_huff_table(&acLuma, acLumaBits, acLumaValues);
+   build_huff_table(&dcChroma, dcChromaBits, dcValues);
+   build_huff_table(&acChroma, acChromaBits, acChromaValues);
+   build_component(&luma, lumaQuant, quality, &dcLuma, &acLuma);
+   build_component(&cb, chromaQuant, quality, &dcChroma, &acChroma);
+   build_component(&cr, chromaQuant, quality, &dcChroma, &acChroma);
+
+   memset(&w, 0, sizeof(w));
+   w.size   = width * height / 4 + 1024;
+   w.buffer = (uint8_t *)malloc(w.size);
+   if (w.buffer == NULL) {
+      return -1;
+   }
+   put_headers(&w, width, height, exif_orientation(rotation), &luma, &cb);
+
+   /* NV21 chroma is interleaved Cr, Cb at half resolution. */
+   for (y = 0; y < height; y += 16) {
+      for (x = 0; x < width; x += 16) {
+         if (writer_reserve(&w, MCU_MAX_BYTES) < 0) {
+            free(w.buffer);
+            return -1;
+         }
+         for (i = 0; i < 4; i++) {
+            load_block(block, src, width, 1, x + (i & 1) * 8,
+                       y + (i >> 1) * 8, width, height);
+            encode_block(&w, &luma, block);
+         }
+         load_block(block, chroma + 1, width, 2, x / 2, y / 2, cw, ch);
+         encode_block(&w, &cb, block);
+         load_block(block, chroma, width, 2, x / 2, y / 2, cw, ch);
+         encode_block(&w, &cr, block);
+      }
+   }
+
+   if (writer_reserve(&w, 4) < 0) {
+      free(w.buffer);
+      return -1;
+   }
+   flush_bits(&w);
+   put_word(&w, 0xffd9);
+
+   *out     = w.buffer;
+   *outSize = w.pos;
+   return 0;
+}
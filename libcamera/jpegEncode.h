@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAMERA_HAL_JPEG_ENCODE_H
+#define CAMERA_HAL_JPEG_ENCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Encodes a packed NV21 frame (luma stride == width, Cr first in the chroma
+ * plane) as a baseline JFIF with 4:2:0 sampling. A rotation of 90, 180 or
+ * 270 degrees clockwise, as in KEY_ROTATION, is recorded as an EXIF
+ * orientation in place of the JFIF header; the pixels are not rotated.
+ * On success *out is a malloc'd buffer of *outSize bytes owned by the
+ * caller. Returns 0 on success, -1 on failure.
+ *
+ * The HAL encodes ZSL and video snapshots with it, both taken from preview
+ * or recording frames. Vendor snapshots keep the vendor's own JPEG.
+ */
+int jpeg_encode_nv21(const uint8_t *src, int width, int height, int quality,
+                     int rotation, uint8_t **out, size_t *outSize);
+
+/*
+ * The encoder's forward DCT of an 8x8 block of samples, rows first. The
+ * output is AAN scaled: coefficient (u, v), at coef[u * 8 + v], is
+ * 8 * aan(u) * aan(v) times the true one. jpeg_fdct is the NEON version on
+ * ARM; jpeg_fdct_ref is the C one it is checked against.
+ */
+void jpeg_fdct(const uint8_t *block, int16_t *coef);
+void jpeg_fdct_ref(const uint8_t *block, int16_t *coef);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
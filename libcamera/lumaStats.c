@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "lumaStats.h"
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+struct luma_sums {
+   uint32_t sum;
+   uint32_t gradient;
+   uint32_t gradients;
+};
+
+static inline uint32_t
+abs_diff(int a, int b)
+{
+   return a > b ? a - b : b - a;
+}
+
+/* Grid samples of one row from column x on. */
+static void
+stats_row_ref(const uint8_t *row, const uint8_t *below, int x, int width,
+              struct luma_stats *stats, struct luma_sums *sums)
+{
+   for (; x < width; x += LUMA_GRID_STEP) {
+      stats->histogram[row[x] >> 2]++;
+      sums->sum += row[x];
+      if (x + LUMA_GRID_STEP < width) {
+         sums->gradient += abs_diff(row[x + LUMA_GRID_STEP], row[x]);
+         sums->gradients++;
+      }
+      if (below != NULL) {
+         sums->gradient += abs_diff(below[x], row[x]);
+         sums->gradients++;
+      }
+   }
+}
+
+static void
+stats_finish(struct luma_stats *stats, const struct luma_sums *sums,
+             uint32_t samples)
+{
+   stats->samples = samples;
+   stats->mean    = samples ? sums->sum / samples : 0;
+   stats->focus   = sums->gradients ?
+                       (uint32_t)((uint64_t)sums->gradient * 16 /
+                                  sums->gradients) : 0;
+}
+
+static inline uint32_t
+grid_samples(int width, int height)
+{
+   return ((width + LUMA_GRID_STEP - 1) / LUMA_GRID_STEP) *
+          ((height + LUMA_GRID_STEP - 1) / LUMA_GRID_STEP);
+}
+
+void
+luma_stats_compute_ref(const uint8_t *luma, int width, int height,
+                       struct luma_stats *stats)
+{
+   struct luma_sums sums = { 0, 0, 0 };
+   int              y;
+
+   memset(stats->histogram, 0, sizeof(stats->histogram));
+   for (y = 0; y < height; y += LUMA_GRID_STEP) {
+      stats_row_ref(luma + y * width,
+                    y + LUMA_GRID_STEP < height ?
+                       luma + (y + LUMA_GRID_STEP) * width : NULL,
+                    0, width, stats, &sums);
+   }
+   stats_finish(stats, &sums, grid_samples(width, height));
+}
+
+#ifdef __ARM_NEON__
+static void
+stats_row_neon(const uint8_t *row, const uint8_t *below, int width,
+               struct luma_stats *stats, struct luma_sums *sums)
+{
+   uint32x4_t sum      = vdupq_n_u32(0);
+   uint32x4_t gradient = vdupq_n_u32(0);
+   uint8_t    bins[16];
+   int        x, i;
+
+   /* vld4 splits 64 pixels into four phases; phase 0 is 16 grid samples.
+    * The load at x + 4 gives each sample its right neighbour. */
+   for (x = 0; x + 16 * LUMA_GRID_STEP + LUMA_GRID_STEP <= width;
+        x += 16 * LUMA_GRID_STEP) {
+      uint8x16_t s     = vld4q_u8(row + x).val[0];
+      uint8x16_t right = vld4q_u8(row + x + LUMA_GRID_STEP).val[0];
+
+      sum      = vpadalq_u16(sum, vpaddlq_u8(s));
+      gradient = vpadalq_u16(gradient, vpaddlq_u8(vabdq_u8(right, s)));
+      if (below != NULL) {
+         uint8x16_t down = vld4q_u8(below + x).val[0];
+         gradient = vpadalq_u16(gradient, vpaddlq_u8(vabdq_u8(down, s)));
+         sums->gradients += 16;
+      }
+      sums->gradients += 16;
+
+      vst1q_u8(bins, vshrq_n_u8(s, 2));
+      for (i = 0; i < 16; i++) {
+         stats->histogram[bins[i]]++;
+      }
+   }
+   sums->sum      += vgetq_lane_u32(sum, 0) + vgetq_lane_u32(sum, 1) +
+                     vgetq_lane_u32(sum, 2) + vgetq_lane_u32(sum, 3);
+   sums->gradient += vgetq_lane_u32(gradient, 0) +
+                     vgetq_lane_u32(gradient, 1) +
+                     vgetq_lane_u32(gradient, 2) +
+                     vgetq_lane_u32(gradient, 3);
+   stats_row_ref(row, below, x, width, stats, sums);
+}
+#endif
+
+void
+luma_stats_compute(const uint8_t *luma, int width, int height,
+                   struct luma_stats *stats)
+{
+#ifdef __ARM_NEON__
+   struct luma_sums sums = { 0, 0, 0 };
+   int              y;
+
+   memset(stats->histogram, 0, sizeof(stats->histogram));
+   for (y = 0; y < height; y += LUMA_GRID_STEP) {
+      stats_row_neon(luma + y * width,
+                     y + LUMA_GRID_STEP < height ?
+                        luma + (y + LUMA_GRID_STEP) * width : NULL,
+                     width, stats, &sums);
+   }
+   stats_finish(stats, &sums, grid_samples(width, height));
+#else
+   luma_stats_compute_ref(luma, width, height, stats);
+#endif
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAMERA_HAL_LUMA_STATS_H
+#define CAMERA_HAL_LUMA_STATS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LUMA_HIST_BINS   64
+
+/* Distance between samples of the grid, in rows and in columns. */
+#define LUMA_GRID_STEP   4
+
+/*
+ * Statistics of a luma plane, taken on a grid of every LUMA_GRID_STEP-th
+ * pixel of every LUMA_GRID_STEP-th row. focus is the mean absolute
+ * difference between horizontally and vertically neighbouring samples,
+ * times 16; it peaks when the image is sharpest.
+ */
+struct luma_stats {
+   uint32_t histogram[LUMA_HIST_BINS];
+   uint32_t samples;
+   uint32_t mean;
+   uint32_t focus;
+};
+
+/*
+ * luma_stats_compute_ref() is the plain C reference, luma_stats_compute()
+ * uses NEON when built for it and produces identical results.
+ */
+void luma_stats_compute_ref(const uint8_t *luma, int width, int height,
+                            struct luma_stats *stats);
+void luma_stats_compute(const uint8_t *luma, int width, int height,
+                        struct luma_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
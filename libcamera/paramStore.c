@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CameraHAL"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <cutils/log.h>
+#include "paramStore.h"
+
+#define ATOM_HASH_SIZE    (PARAM_ATOM_MAX * 2)
+#define STORE_MIN_SLOTS   64
+
+struct param_atom {
+   uint32_t    hash;
+   const char *name;
+};
+
+/* Atoms are never freed; the table lives as long as the library. */
+static pthread_mutex_t   atomLock = PTHREAD_MUTEX_INITIALIZER;
+static struct param_atom atoms[PARAM_ATOM_MAX];
+static int               numAtoms;
+static short             atomHash[ATOM_HASH_SIZE];   /* atom + 1, 0 = free */
+
+static uint32_t
+param_hash(const char *key, size_t len)
+{
+   uint32_t hash = 2166136261u;
+
+   while (len-- > 0) {
+      hash = (hash ^ (unsigned char)*key++) * 16777619u;
+   }
+   return hash;
+}
+
+static int
+param_atom_find_locked(const char *key, size_t len, uint32_t hash,
+                       unsigned int *slot)
+{
+   unsigned int i = hash & (ATOM_HASH_SIZE - 1);
+
+   while (atomHash[i] != 0) {
+      const struct param_atom *atom = &atoms[atomHash[i] - 1];
+      if (atom->hash == hash && strncmp(atom->name, key, len) == 0 &&
+          atom->name[len] == '\0') {
+         return atomHash[i] - 1;
+      }
+      i = (i + 1) & (ATOM_HASH_SIZE - 1);
+   }
+   *slot = i;
+   return -1;
+}
+
+int
+param_atom_intern(const char *key, size_t len)
+{
+   uint32_t     hash = param_hash(key, len);
+   unsigned int slot;
+   int          atom;
+   char        *name;
+
+   pthread_mutex_lock(&atomLock);
+   atom = param_atom_find_locked(key, len, hash, &slot);
+   if (atom < 0 && numAtoms < PARAM_ATOM_MAX &&
+       (name = (char *)malloc(len + 1)) != NULL) {
+      memcpy(name, key, len);
+      name[len] = '\0';
+      atom = numAtoms++;
+      atoms[atom].hash = hash;
+      atoms[atom].name = name;
+      atomHash[slot] = (short)(atom + 1);
+   } else if (atom < 0) {
+      LOGE("param_atom_intern: cannot intern %.*s\n", (int)len, key);
+   }
+   pthread_mutex_unlock(&atomLock);
+   return atom;
+}
+
+int
+param_atom_lookup(const char *key)
+{
+   size_t       len = strlen(key);
+   unsigned int slot;
+   int          atom;
+
+   pthread_mutex_lock(&atomLock);
+   atom = param_atom_find_locked(key, len, param_hash(key, len), &slot);
+   pthread_mutex_unlock(&atomLock);
+   return atom;
+}
+
+const char *
+param_atom_name(int atom)
+{
+   /* An atom handed out is never changed, so no lock is needed. */
+   return (atom >= 0 && atom < PARAM_ATOM_MAX) ? atoms[atom].name : NULL;
+}
+
+static unsigned int
+param_store_home(const struct param_store *store, int atom)
+{
+   return atoms[atom].hash & (store->capacity - 1);
+}
+
+static struct param_entry *
+param_store_find(const struct param_store *store, int atom)
+{
+   unsigned int i;
+
+   if (store->capacity == 0 || atom < 0) {
+      return NULL;
+   }
+   i = param_store_home(store, atom);
+   while (store->slots[i].atom >= 0) {
+      if (store->slots[i].atom == atom) {
+         return &store->slots[i];
+      }
+      i = (i + 1) & (store->capacity - 1);
+   }
+   return NULL;
+}
+
+static int
+param_store_resize(struct param_store *store, unsigned int capacity)
+{
+   struct param_entry *old = store->slots;
+   unsigned int        oldCapacity = store->capacity;
+   unsigned int        i, j;
+
+   store->slots = (struct param_entry *)malloc(capacity * sizeof(*old));
+   if (store->slots == NULL) {
+      store->slots = old;
+      return -1;
+   }
+   store->capacity = capacity;
+   for (i = 0; i < capacity; i++) {
+      store->slots[i].atom  = -1;
+      store->slots[i].value = NULL;
+   }
+   for (i = 0; i < oldCapacity; i++) {
+      if (old[i].atom >= 0) {
+         j = param_store_home(store, old[i].atom);
+         while (store->slots[j].atom >= 0) {
+            j = (j + 1) & (capacity - 1);
+         }
+         store->slots[j] = old[i];
+      }
+   }
+   free(old);
+   return 0;
+}
+
+void
+param_store_init(struct param_store *store)
+{
+   store->slots    = NULL;
+   store->capacity = 0;
+   store->count    = 0;
+}
+
+void
+param_store_clear(struct param_store *store)
+{
+   unsigned int i;
+
+   for (i = 0; i < store->capacity; i++) {
+      free(store->slots[i].value);
+      store->slots[i].atom  = -1;
+      store->slots[i].value = NULL;
+   }
+   store->count = 0;
+}
+
+void
+param_store_free(struct param_store *store)
+{
+   param_store_clear(store);
+   free(store->slots);
+   param_store_init(store);
+}
+
+const char *
+param_store_get_atom(const struct param_store *store, int atom)
+{
+   struct param_entry *entry = param_store_find(store, atom);
+
+   return entry != NULL ? entry->value : NULL;
+}
+
+const char *
+param_store_get(const struct param_store *store, const char *key)
+{
+   return param_store_get_atom(store, param_atom_lookup(key));
+}
+
+int
+param_store_set_atom(struct param_store *store, int atom, const char *value,
+                     size_t len)
+{
+   struct param_entry *entry;
+   unsigned int        i;
+   char               *copy;
+
+   if (atom < 0) {
+      return -1;
+   }
+   copy = (char *)malloc(len + 1);
+   if (copy == NULL) {
+      return -1;
+   }
+   memcpy(copy, value, len);
+   copy[len] = '\0';
+
+   entry = param_store_find(store, atom);
+   if (entry != NULL) {
+      free(entry->value);
+      entry->value = copy;
+      return 0;
+   }
+   if ((store->count + 1) * 2 > store->capacity &&
+       param_store_resize(store, store->capacity ? store->capacity * 2 :
+                                                   STORE_MIN_SLOTS) < 0) {
+      free(copy);
+      return -1;
+   }
+   i = param_store_home(store, atom);
+   while (store->slots[i].atom >= 0) {
+      i = (i + 1) & (store->capacity - 1);
+   }
+   store->slots[i].atom  = atom;
+   store->slots[i].value = copy;
+   store->count++;
+   return 0;
+}
+
+int
+param_store_set(struct param_store *store, const char *key, const char *value)
+{
+   return param_store_set_atom(store, param_atom_intern(key, strlen(key)),
+                               value, strlen(value));
+}
+
+void
+param_store_remove(struct param_store *store, const char *key)
+{
+   struct param_entry *entry = param_store_find(store, param_atom_lookup(key));
+   unsigned int        hole, i, home;
+
+   if (entry == NULL) {
+      return;
+   }
+   free(entry->value);
+   store->count--;
+
+   /* Shift later members of the probe chain back into the hole. */
+   hole = entry - store->slots;
+   i    = hole;
+   for (;;) {
+      i = (i + 1) & (store->capacity - 1);
+      if (store->slots[i].atom < 0) {
+         break;
+      }
+      home = param_store_home(store, store->slots[i].atom);
+      if (((i - home) & (store->capacity - 1)) >=
+          ((i - hole) & (store->capacity - 1))) {
+         store->slots[hole] = store->slots[i];
+         hole = i;
+      }
+   }
+   store->slots[hole].atom  = -1;
+   store->slots[hole].value = NULL;
+}
+
+int
+param_store_unflatten(struct param_store *store, const char *params)
+{
+   const char *a = params;
+   const char *b, *c;
+   int         atom;
+
+   param_store_clear(store);
+   for (;;) {
+      /* Same rules as CameraParameters::unflatten. */
+      b = strchr(a, '=');
+      if (b == NULL) {
+         break;
+      }
+      atom = param_atom_intern(a, b - a);
+      a = b + 1;
+      c = strchr(a, ';');
+      if (param_store_set_atom(store, atom, a,
+                               c != NULL ? (size_t)(c - a) : strlen(a)) < 0) {
+         return -1;
+      }
+      if (c == NULL) {
+         break;
+      }
+      a = c + 1;
+   }
+   return 0;
+}
+
+char *
+param_store_flatten(const struct param_store *store)
+{
+   size_t       len = 1;
+   unsigned int i;
+   char        *result, *p;
+
+   for (i = 0; i < store->capacity; i++) {
+      if (store->slots[i].atom >= 0) {
+         len += strlen(atoms[store->slots[i].atom].name) +
+                strlen(store->slots[i].value) + 2;
+      }
+   }
+   result = p = (char *)malloc(len);
+   if (result == NULL) {
+      return NULL;
+   }
+   for (i = 0; i < store->capacity; i++) {
+      const struct param_entry *entry = &store->slots[i];
+      size_t n;
+
+      if (entry->atom < 0) {
+         continue;
+      }
+      if (p != result) {
+         *p++ = ';';
+      }
+      n = strlen(atoms[entry->atom].name);
+      memcpy(p, atoms[entry->atom].name, n);
+      p += n;
+      *p++ = '=';
+      n = strlen(entry->value);
+      memcpy(p, entry->value, n);
+      p += n;
+   }
+   *p = '\0';
+   return result;
+}
+
+int
+param_store_diff(const struct param_store *from, const struct param_store *to,
+                 void (*fn)(int atom, void *arg), void *arg)
+{
+   unsigned int i;
+   int          count = 0;
+
+   for (i = 0; i < to->capacity; i++) {
+      const struct param_entry *entry = &to->slots[i];
+      const char               *old;
+
+      if (entry->atom < 0) {
+         continue;
+      }
+      old = param_store_get_atom(from, entry->atom);
+      if (old == NULL || strcmp(old, entry->value) != 0) {
+         fn(entry->atom, arg);
+         count++;
+      }
+   }
+   for (i = 0; i < from->capacity; i++) {
+      if (from->slots[i].atom >= 0 &&
+          param_store_find(to, from->slots[i].atom) == NULL) {
+         fn(from->slots[i].atom, arg);
+         count++;
+      }
+   }
+   return count;
+}
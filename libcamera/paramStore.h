@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAMERA_HAL_PARAM_STORE_H
+#define CAMERA_HAL_PARAM_STORE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Parameter keys are interned once into small integer atoms that are shared
+ * by every store in the process, so a store compares keys as integers and
+ * never hashes a key string twice.
+ */
+#define PARAM_ATOM_MAX 1024
+
+int param_atom_intern(const char *key, size_t len);
+int param_atom_lookup(const char *key);
+const char *param_atom_name(int atom);
+
+struct param_entry {
+   int   atom;    /* -1 for an empty slot */
+   char *value;
+};
+
+/*
+ * Open-addressed (linear probing) table of atom -> value. The capacity is a
+ * power of two kept at most half full; removal leaves no tombstones since
+ * the probe chain is repaired in place.
+ */
+struct param_store {
+   struct param_entry *slots;
+   unsigned int        capacity;
+   unsigned int        count;
+};
+
+void param_store_init(struct param_store *store);
+void param_store_free(struct param_store *store);
+void param_store_clear(struct param_store *store);
+
+const char *param_store_get(const struct param_store *store, const char *key);
+const char *param_store_get_atom(const struct param_store *store, int atom);
+int param_store_set(struct param_store *store, const char *key,
+                    const char *value);
+int param_store_set_atom(struct param_store *store, int atom,
+                         const char *value, size_t len);
+void param_store_remove(struct param_store *store, const char *key);
+
+/* Conversion from and to the "key1=value1;key2=value2" form used by
+ * CameraParameters. flatten returns a malloc'd string. */
+int param_store_unflatten(struct param_store *store, const char *params);
+char *param_store_flatten(const struct param_store *store);
+
+/* Calls fn for every key that is only in one of the stores or whose value
+ * differs, and returns the number of such keys. */
+int param_store_diff(const struct param_store *from,
+                     const struct param_store *to,
+                     void (*fn)(int atom, void *arg), void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
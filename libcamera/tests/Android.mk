@@ -0,0 +1,134 @@
+LOCAL_PATH := $(call my-dir)
+
+# Each test checks a NEON kernel against its C reference and exits non-zero
+# on a mismatch. On the device both run natively. The host build compiles
+# the NEON code against neon/arm_neon.h, a scalar model of the intrinsics,
+# so the NEON paths are also checked on a build machine. paramStore_test
+# checks the parameter store, which has no NEON code, the same way.
+#
+# camerahal_cameraHal_test is host only. It links the wrapper with a mock
+# vendor camera (mockCameraHardware), a fake preview window (fakeWindow) and
+# a fake fb0 (fakeFb) that CAMERA_HAL_FB_DEVICE points the wrapper at, then
+# benchmarks the frame pipeline. host/ stands in for the framework headers
+# and libraries that only build for the device.
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS    := tests
+LOCAL_MODULE         := camerahal_yuvConvert_test
+LOCAL_SRC_FILES      := yuvConvert_test.c ../yuvConvert.c
+LOCAL_C_INCLUDES     := $(LOCAL_PATH)/..
+LOCAL_CFLAGS         := -std=gnu99
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS    := tests
+LOCAL_MODULE         := camerahal_yuvConvert_test
+LOCAL_SRC_FILES      := yuvConvert_test.c ../yuvConvert.c
+LOCAL_C_INCLUDES     := $(LOCAL_PATH)/neon $(LOCAL_PATH)/..
+LOCAL_CFLAGS         := -std=gnu99 -D__ARM_NEON__
+LOCAL_LDLIBS         := -lrt
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS      := tests
+LOCAL_MODULE           := camerahal_jpegEncode_test
+LOCAL_SRC_FILES        := jpegEncode_test.c ../jpegEncode.c
+LOCAL_C_INCLUDES       := $(LOCAL_PATH)/..
+LOCAL_CFLAGS           := -std=gnu99
+LOCAL_SHARED_LIBRARIES := liblog
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS      := tests
+LOCAL_MODULE           := camerahal_jpegEncode_test
+LOCAL_SRC_FILES        := jpegEncode_test.c ../jpegEncode.c
+LOCAL_C_INCLUDES       := $(LOCAL_PATH)/neon $(LOCAL_PATH)/..
+LOCAL_CFLAGS           := -std=gnu99 -D__ARM_NEON__
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS           := -lrt -lm
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS    := tests
+LOCAL_MODULE         := camerahal_lumaStats_test
+LOCAL_SRC_FILES      := lumaStats_test.c ../lumaStats.c
+LOCAL_C_INCLUDES     := $(LOCAL_PATH)/..
+LOCAL_CFLAGS         := -std=gnu99
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS    := tests
+LOCAL_MODULE         := camerahal_lumaStats_test
+LOCAL_SRC_FILES      := lumaStats_test.c ../lumaStats.c
+LOCAL_C_INCLUDES     := $(LOCAL_PATH)/neon $(LOCAL_PATH)/..
+LOCAL_CFLAGS         := -std=gnu99 -D__ARM_NEON__
+LOCAL_LDLIBS         := -lrt
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS      := tests
+LOCAL_MODULE           := camerahal_paramStore_test
+LOCAL_SRC_FILES        := paramStore_test.c ../paramStore.c
+LOCAL_C_INCLUDES       := $(LOCAL_PATH)/..
+LOCAL_CFLAGS           := -std=gnu99
+LOCAL_SHARED_LIBRARIES := liblog
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS      := tests
+LOCAL_MODULE           := camerahal_paramStore_test
+LOCAL_SRC_FILES        := paramStore_test.c ../paramStore.c
+LOCAL_C_INCLUDES       := $(LOCAL_PATH)/..
+LOCAL_CFLAGS           := -std=gnu99
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS           := -lpthread -lrt
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS    := tests
+LOCAL_MODULE         := libcamerahal_test_c
+LOCAL_SRC_FILES      := ../yuvConvert.c ../frameStats.c ../paramStore.c \
+                        ../jpegEncode.c ../lumaStats.c fakeFb.c
+LOCAL_C_INCLUDES     := $(LOCAL_PATH)/.. $(TARGET_SPECIFIC_HEADER_PATH)
+LOCAL_CFLAGS         := -std=gnu99 \
+                        -DCAMERA_HAL_FB_DEVICE=\"/tmp/camerahal_test_fb0\"
+
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS      := tests
+LOCAL_MODULE           := camerahal_cameraHal_test
+LOCAL_SRC_FILES        := cameraHal_test.cpp mockCameraHardware.cpp \
+                          fakeWindow.cpp host/CameraParameters.cpp \
+                          host/Memory.cpp host/GraphicBufferMapper.cpp \
+                          ../cameraHal.cpp
+LOCAL_C_INCLUDES       := $(LOCAL_PATH)/host $(LOCAL_PATH)/.. \
+                          $(TARGET_SPECIFIC_HEADER_PATH) \
+                          frameworks/base/include \
+                          hardware/libhardware/include \
+                          hardware/libhardware/modules/gralloc
+LOCAL_CFLAGS           := -DQCOM_HARDWARE -DVENDOR_CAMERA_LIBRARY=NULL \
+                          -DCAMERA_HAL_FB_DEVICE=\"/tmp/camerahal_test_fb0\"
+LOCAL_STATIC_LIBRARIES := libcamerahal_test_c libutils libcutils liblog
+LOCAL_LDFLAGS          := -rdynamic
+LOCAL_LDLIBS           := -ldl -lpthread -lrt -lm
+
+include $(BUILD_HOST_EXECUTABLE)
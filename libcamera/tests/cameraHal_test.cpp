@@ -0,0 +1,1029 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the wrapper on the host against mockCameraHardware, the preview
+ * window in fakeWindow and the MDP in fakeFb, standing in for the parts of
+ * CameraService, SurfaceFlinger and the encoder it talks to. Checks that
+ * preview frames reach the window and the client intact along each path,
+ * turned into portrait when the preview is pre-rotated, that every recording frame goes back to the vendor library and that a
+ * frame costs the wrapper no allocations, then reports the frame rate, time
+ * and allocations per frame of the pipeline in each mode.
+ *
+ * The fake MDP runs on the CPU, so blit times here say nothing about the
+ * device; they only keep the HAL's own overhead comparable between modes.
+ */
+
+#define LOG_TAG "CameraHAL_test"
+
+/* Linked with the wrapper, so it leaves out the blob symbols
+ * CameraParameters.h defines. */
+#define THE_WRAPPER
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <camera/CameraParameters.h>
+#include <hardware/camera.h>
+#include <cutils/ashmem.h>
+#include <cutils/atomic.h>
+#include <cutils/native_handle.h>
+#include <cutils/properties.h>
+#include <media/stagefright/MetadataBufferType.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include "fakeFb.h"
+#include "fakeWindow.h"
+#include "mockCameraHardware.h"
+#include "yuvConvert.h"
+
+extern camera_module_t HAL_MODULE_INFO_SYM;
+
+/* The screen of the phone this wrapper is for, in portrait. */
+#define WINDOW_WIDTH     240
+#define WINDOW_HEIGHT    320
+
+/* Frames the encoder keeps before giving the oldest back. */
+#define RECORDER_HOLD    3
+
+#define FRAME_TIMEOUT    2000000000LL
+
+static int checks, failures;
+
+#define EXPECT(cond, ...)                                               \
+   do {                                                                 \
+      checks++;                                                         \
+      if (!(cond)) {                                                    \
+         failures++;                                                    \
+         fprintf(stderr, "FAIL %s: ", __func__);                        \
+         fprintf(stderr, __VA_ARGS__);                                  \
+         fprintf(stderr, "\n");                                         \
+      }                                                                 \
+   } while (0)
+
+/* Properties, which the host has none of. */
+
+#define MAX_PROPERTIES 16
+
+static android::Mutex gPropertyLock;
+static char           gPropertyKeys[MAX_PROPERTIES][PROPERTY_KEY_MAX];
+static char           gPropertyValues[MAX_PROPERTIES][PROPERTY_VALUE_MAX];
+static int            gNumProperties;
+
+extern "C" int
+property_get(const char *key, char *value, const char *default_value)
+{
+   android::Mutex::Autolock lock(gPropertyLock);
+
+   for (int i = 0; i < gNumProperties; i++) {
+      if (strcmp(gPropertyKeys[i], key) == 0) {
+         strcpy(value, gPropertyValues[i]);
+         return strlen(value);
+      }
+   }
+   strcpy(value, default_value != NULL ? default_value : "");
+   return strlen(value);
+}
+
+static void
+set_property(const char *key, const char *value)
+{
+   android::Mutex::Autolock lock(gPropertyLock);
+   int i;
+
+   for (i = 0; i < gNumProperties; i++) {
+      if (strcmp(gPropertyKeys[i], key) == 0) {
+         break;
+      }
+   }
+   if (i == gNumProperties) {
+      if (gNumProperties == MAX_PROPERTIES) {
+         fprintf(stderr, "too many properties\n");
+         exit(1);
+      }
+      gNumProperties++;
+   }
+   strncpy(gPropertyKeys[i], key, PROPERTY_KEY_MAX - 1);
+   strncpy(gPropertyValues[i], value, PROPERTY_VALUE_MAX - 1);
+}
+
+static void
+clear_properties()
+{
+   android::Mutex::Autolock lock(gPropertyLock);
+
+   gNumProperties = 0;
+}
+
+/* Client memory, as CameraService's CameraHeapMemory hands it out: an fd
+ * given by the HAL is mapped again, otherwise a new region is made. */
+
+struct test_memory {
+   camera_memory_t mem;     /* first, the HAL only sees this */
+   int             fd;
+   size_t          bufSize;
+};
+
+/* requestMemory calls, which CameraService allocates for. */
+static int32_t gMemoryRequests;
+
+static void
+release_memory(camera_memory_t *mem)
+{
+   struct test_memory *memory  = (struct test_memory *)mem;
+   bool                counting = MockCamera_CountAllocations(false);
+
+   if (mem->data != MAP_FAILED) {
+      munmap(mem->data, mem->size);
+   }
+   close(memory->fd);
+   delete memory;
+   MockCamera_CountAllocations(counting);
+}
+
+static camera_memory_t *
+request_memory(int fd, size_t buf_size, unsigned int num_bufs, void *user)
+{
+   bool                counting = MockCamera_CountAllocations(false);
+   struct test_memory *memory   = new test_memory();
+   size_t              size     = buf_size * num_bufs;
+
+   android_atomic_inc(&gMemoryRequests);
+   memory->fd = fd >= 0 ? dup(fd) : ashmem_create_region("camera-client",
+                                                         size);
+   if (memory->fd < 0) {
+      delete memory;
+      MockCamera_CountAllocations(counting);
+      return NULL;
+   }
+   memory->bufSize     = buf_size;
+   memory->mem.size    = size;
+   memory->mem.handle  = memory;
+   memory->mem.release = release_memory;
+   memory->mem.data    = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                              memory->fd, 0);
+   MockCamera_CountAllocations(counting);
+   return &memory->mem;
+}
+
+/* What the encoder reads from a metadata buffer. */
+struct encoder_metadata {
+   int32_t                type;
+   const native_handle_t *handle;
+};
+
+struct test_client {
+   camera_device_t  *device;
+   android::Mutex    lock;
+   int               previewWidth;
+   int               previewHeight;
+   int               videoWidth;
+   int               videoHeight;
+   bool              rotated;      /* frames come turned into portrait */
+   unsigned int      previewFrames;
+   unsigned int      badPreviewFrames;
+   unsigned int      recordingFrames;
+   unsigned int      badRecordingFrames;
+   unsigned int      pictures;
+   unsigned int      shutters;
+   const void       *held[RECORDER_HOLD + 1];
+   int               numHeld;
+};
+
+/* Whether frame is some frame n of the mock's stream, or with rotated, such
+ * a frame of height x width turned clockwise by 90 degrees. */
+static bool
+is_mock_frame(const uint8_t *frame, int width, int height, bool rotated)
+{
+   static uint8_t *expected, *source;
+   static size_t   expectedSize;
+   size_t          size = width * height * 3 / 2;
+
+   if (size > expectedSize) {
+      free(expected);
+      free(source);
+      expected     = (uint8_t *)malloc(size);
+      source       = (uint8_t *)malloc(size);
+      expectedSize = size;
+   }
+   if (!rotated) {
+      MockCamera_FillFrame(expected, width, height, frame[0]);
+   } else {
+      /* The first pixel is the one from the source's bottom left corner. */
+      MockCamera_FillFrame(source, height, width, frame[0] - 3 * (width - 1));
+      yuv420sp_rotate90(source, expected, height, width);
+   }
+   return memcmp(expected, frame, size) == 0;
+}
+
+static bool
+is_mock_metadata(const struct encoder_metadata *meta, int width, int height)
+{
+   size_t   page = getpagesize(), size = width * height * 3 / 2;
+   off_t    start;
+   uint8_t *base;
+   bool     match;
+
+   if (meta->type != android::kMetadataBufferTypeCameraSource ||
+       meta->handle == NULL || meta->handle->numFds != 1 ||
+       meta->handle->numInts != 2 || meta->handle->data[2] != (int)size) {
+      return false;
+   }
+   start = meta->handle->data[1] & ~(page - 1);
+   base  = (uint8_t *)mmap(NULL, meta->handle->data[1] - start + size,
+                           PROT_READ, MAP_SHARED, meta->handle->data[0],
+                           start);
+   if (base == MAP_FAILED) {
+      return false;
+   }
+   match = is_mock_frame(base + meta->handle->data[1] - start, width, height,
+                         false);
+   munmap(base, meta->handle->data[1] - start + size);
+   return match;
+}
+
+static void
+notify_cb(int32_t msg_type, int32_t ext1, int32_t ext2, void *user)
+{
+   struct test_client *client   = (struct test_client *)user;
+   bool                counting = MockCamera_CountAllocations(false);
+
+   if (msg_type == CAMERA_MSG_SHUTTER) {
+      android::Mutex::Autolock lock(client->lock);
+      client->shutters++;
+   }
+   MockCamera_CountAllocations(counting);
+}
+
+static void
+data_cb(int32_t msg_type, const camera_memory_t *data, unsigned int index,
+        camera_frame_metadata_t *metadata, void *user)
+{
+   struct test_client       *client = (struct test_client *)user;
+   struct test_memory       *memory = (struct test_memory *)data->handle;
+   const uint8_t            *frame  = (const uint8_t *)data->data +
+                                      index * memory->bufSize;
+   bool                      counting = MockCamera_CountAllocations(false);
+
+   {
+      android::Mutex::Autolock lock(client->lock);
+      if (msg_type == CAMERA_MSG_PREVIEW_FRAME) {
+         client->previewFrames++;
+         if (!is_mock_frame(frame, client->previewWidth,
+                            client->previewHeight, client->rotated)) {
+            client->badPreviewFrames++;
+         }
+      } else if (msg_type == CAMERA_MSG_COMPRESSED_IMAGE) {
+         if (data->size > 4 && frame[0] == 0xff && frame[1] == 0xd8) {
+            client->pictures++;
+         }
+      }
+   }
+   MockCamera_CountAllocations(counting);
+}
+
+/* The encoder: checks a frame and holds it a while, as CameraSource does
+ * while it is being encoded. */
+static void
+data_cb_timestamp(nsecs_t timestamp, int32_t msg_type,
+                  const camera_memory_t *data, unsigned int index, void *user)
+{
+   struct test_client *client = (struct test_client *)user;
+   struct test_memory *memory = (struct test_memory *)data->handle;
+   const void         *opaque = (const uint8_t *)data->data +
+                                index * memory->bufSize;
+   const void         *release = NULL;
+   bool                counting = MockCamera_CountAllocations(false);
+   bool                valid;
+
+   valid = memory->bufSize == sizeof(struct encoder_metadata) ?
+              is_mock_metadata((const struct encoder_metadata *)opaque,
+                               client->videoWidth, client->videoHeight) :
+              is_mock_frame((const uint8_t *)opaque, client->videoWidth,
+                            client->videoHeight, client->rotated);
+   {
+      android::Mutex::Autolock lock(client->lock);
+      client->recordingFrames++;
+      if (!valid) {
+         client->badRecordingFrames++;
+      }
+      client->held[client->numHeld++] = opaque;
+      if (client->numHeld > RECORDER_HOLD) {
+         release = client->held[0];
+         memmove(client->held, client->held + 1,
+                 --client->numHeld * sizeof(client->held[0]));
+      }
+   }
+   /* The release runs in the wrapper, so it counts. */
+   MockCamera_CountAllocations(counting);
+   if (release != NULL) {
+      client->device->ops->release_recording_frame(client->device, release);
+   }
+}
+
+/* Gives back what the encoder holds. */
+static void
+release_held_frames(struct test_client *client)
+{
+   for (;;) {
+      const void *opaque;
+      {
+         android::Mutex::Autolock lock(client->lock);
+         if (client->numHeld == 0) {
+            return;
+         }
+         opaque = client->held[--client->numHeld];
+      }
+      client->device->ops->release_recording_frame(client->device, opaque);
+   }
+}
+
+/* An open camera with its window. */
+
+struct test_session {
+   camera_device_t    *device;
+   struct fake_window *window;
+   struct test_client  client;
+};
+
+static bool
+set_sizes(camera_device_t *device, int previewWidth, int previewHeight,
+          int videoWidth, int videoHeight, const char *extra)
+{
+   char                     *flat = device->ops->get_parameters(device);
+   android::CameraParameters params;
+   int                       rc;
+
+   params.unflatten(android::String8(flat));
+   device->ops->put_parameters(device, flat);
+   params.setPreviewSize(previewWidth, previewHeight);
+   params.setVideoSize(videoWidth, videoHeight);
+   android::String8 result = params.flatten();
+   if (extra != NULL) {
+      result.append(";");
+      result.append(extra);
+   }
+   rc = device->ops->set_parameters(device, result.string());
+   return rc == 0;
+}
+
+static bool
+open_session(struct test_session *session, int width, int height,
+             const char *extra)
+{
+   hw_device_t *device = NULL;
+
+   if (HAL_MODULE_INFO_SYM.common.methods->open(&HAL_MODULE_INFO_SYM.common,
+                                                "0", &device) != 0) {
+      return false;
+   }
+   session->device = (camera_device_t *)device;
+   session->window = fake_window_create(WINDOW_WIDTH, WINDOW_HEIGHT);
+   session->client.previewFrames      = 0;
+   session->client.badPreviewFrames   = 0;
+   session->client.recordingFrames    = 0;
+   session->client.badRecordingFrames = 0;
+   session->client.pictures           = 0;
+   session->client.shutters           = 0;
+   session->client.numHeld            = 0;
+   session->client.rotated            = false;
+   session->client.device        = session->device;
+   session->client.previewWidth  = width;
+   session->client.previewHeight = height;
+   session->client.videoWidth    = width;
+   session->client.videoHeight   = height;
+   session->device->ops->set_callbacks(session->device, notify_cb, data_cb,
+                                       data_cb_timestamp, request_memory,
+                                       &session->client);
+   session->device->ops->set_preview_window(session->device,
+                                            fake_window_ops(session->window));
+   return set_sizes(session->device, width, height, width, height, extra);
+}
+
+static void
+close_session(struct test_session *session)
+{
+   session->device->ops->release(session->device);
+   session->device->common.close(&session->device->common);
+   fake_window_destroy(session->window);
+}
+
+static bool
+run_preview(struct test_session *session, unsigned int frames)
+{
+   bool delivered;
+
+   MockCamera_ResetStats();
+   if (session->device->ops->start_preview(session->device) != 0) {
+      return false;
+   }
+   delivered = MockCamera_WaitPreviewFrames(frames, FRAME_TIMEOUT);
+   session->device->ops->stop_preview(session->device);
+   return delivered;
+}
+
+/* Whether the window shows some frame of the mock's stream, converted the
+ * way the CPU path converts it. With rotated, the window is width x height
+ * and shows a height x width frame turned clockwise by 90 degrees. */
+static bool
+window_shows_mock_frame(struct fake_window *window, int width, int height,
+                        bool rotated)
+{
+   struct fake_window_frame frame;
+   uint8_t                 *source, *turned, *expected;
+   bool                     match = false;
+
+   if (!fake_window_get_frame(window, &frame) || frame.width != width ||
+       frame.height != height) {
+      return false;
+   }
+   if (frame.format == HAL_PIXEL_FORMAT_YCrCb_420_SP) {
+      if (frame.stride != width) {
+         return false;
+      }
+      return is_mock_frame(frame.data, width, height, rotated);
+   }
+
+   source   = (uint8_t *)malloc(width * height * 3 / 2);
+   turned   = (uint8_t *)malloc(width * height * 3 / 2);
+   expected = (uint8_t *)malloc(frame.stride * height * 4);
+   for (int n = 0; n < 256 && !match; n++) {
+      if (rotated) {
+         MockCamera_FillFrame(source, height, width, n);
+         yuv420sp_rotate90(source, turned, height, width);
+      } else {
+         MockCamera_FillFrame(turned, width, height, n);
+      }
+      yuv420sp_to_rgbx_ref(turned, expected, width, height, frame.stride,
+                           YUV420SP_NV21);
+      match = true;
+      for (int y = 0; y < height && match; y++) {
+         match = memcmp(expected + y * frame.stride * 4,
+                        frame.data + y * frame.stride * 4, width * 4) == 0;
+      }
+   }
+   free(source);
+   free(turned);
+   free(expected);
+   return match;
+}
+
+/* Checks. */
+
+static void
+check_camera_info()
+{
+   struct camera_info info;
+
+   clear_properties();
+   EXPECT(HAL_MODULE_INFO_SYM.get_number_of_cameras() == 1,
+          "%d cameras", HAL_MODULE_INFO_SYM.get_number_of_cameras());
+   EXPECT(HAL_MODULE_INFO_SYM.get_camera_info(0, &info) == 0 &&
+          info.facing == CAMERA_FACING_BACK && info.orientation == 90,
+          "facing %d orientation %d", info.facing, info.orientation);
+}
+
+static void
+check_preview(const char *name, int width, int height, bool failBlit)
+{
+   struct test_session      session;
+   struct fake_window_stats stats;
+
+   fake_fb_set_failing(failBlit);
+   if (!open_session(&session, width, height, NULL)) {
+      EXPECT(false, "%s: could not open the camera", name);
+      return;
+   }
+   EXPECT(run_preview(&session, 20), "%s: no preview frames", name);
+   fake_window_get_stats(session.window, &stats);
+   EXPECT(stats.enqueued > 0, "%s: nothing reached the window", name);
+   EXPECT(window_shows_mock_frame(session.window, width, height, false),
+          "%s: the window does not show a camera frame", name);
+   close_session(&session);
+   fake_fb_set_failing(0);
+}
+
+/* The blit session opens fb0 once per preview and closes it on stop and on
+ * release, whatever the number of frames. */
+static void
+check_blit_session()
+{
+   struct test_session      session;
+   struct fake_window_stats windowStats;
+   struct fake_fb_stats     stats;
+
+   clear_properties();
+   fake_fb_reset_stats();
+   if (!open_session(&session, 320, 240, NULL)) {
+      EXPECT(false, "could not open the camera");
+      return;
+   }
+   camera_device_t *device = session.device;
+   for (int preview = 0; preview < 2; preview++) {
+      fake_window_reset_stats(session.window);
+      MockCamera_ResetStats();
+      device->ops->start_preview(device);
+      MockCamera_WaitPreviewFrames(50, FRAME_TIMEOUT);
+      fake_fb_get_stats(&stats);
+      EXPECT(stats.opens == 1 && stats.openNow == 1,
+             "preview %d: %u opens, %u open now", preview, stats.opens,
+             stats.openNow);
+      device->ops->stop_preview(device);
+      fake_fb_get_stats(&stats);
+      fake_window_get_stats(session.window, &windowStats);
+      EXPECT(stats.closes == stats.opens && stats.openNow == 0,
+             "preview %d: %u opens, %u closes, %u open after stop", preview,
+             stats.opens, stats.closes, stats.openNow);
+      EXPECT(windowStats.enqueued >= 50 && stats.blits == windowStats.enqueued,
+             "preview %d: %u blits for %u frames shown", preview, stats.blits,
+             windowStats.enqueued);
+      fake_fb_reset_stats();
+   }
+
+   /* Released without stop_preview, as when the client dies. */
+   MockCamera_ResetStats();
+   device->ops->start_preview(device);
+   MockCamera_WaitPreviewFrames(10, FRAME_TIMEOUT);
+   close_session(&session);
+   fake_fb_get_stats(&stats);
+   EXPECT(stats.opens == 1 && stats.closes == 1 && stats.openNow == 0,
+          "release: %u opens, %u closes, %u open after release", stats.opens,
+          stats.closes, stats.openNow);
+}
+
+/* Once the first frames have set up the window and the client's memory,
+ * a frame costs the wrapper no allocations, whatever it is sent to. */
+static void
+check_frame_allocations()
+{
+   struct test_session      session;
+   struct mock_camera_stats stats;
+
+   clear_properties();
+   if (!open_session(&session, 320, 240, NULL)) {
+      EXPECT(false, "could not open the camera");
+      return;
+   }
+   camera_device_t *device = session.device;
+   device->ops->enable_msg_type(device, CAMERA_MSG_PREVIEW_FRAME);
+   device->ops->store_meta_data_in_buffers(device, false);
+   MockCamera_ResetStats();
+   device->ops->start_preview(device);
+   device->ops->enable_msg_type(device, CAMERA_MSG_VIDEO_FRAME);
+   device->ops->start_recording(device);
+   MockCamera_WaitPreviewFrames(10, FRAME_TIMEOUT);
+   MockCamera_ResetStats();
+   MockCamera_WaitPreviewFrames(30, FRAME_TIMEOUT);
+   MockCamera_GetStats(&stats);
+   release_held_frames(&session.client);
+   device->ops->disable_msg_type(device, CAMERA_MSG_VIDEO_FRAME);
+   device->ops->stop_recording(device);
+   device->ops->stop_preview(device);
+   close_session(&session);
+
+   EXPECT(stats.previewAllocations == 0 && stats.recordingAllocations == 0,
+          "%u allocations in %u preview frames, %u in %u recording frames",
+          stats.previewAllocations, stats.previewFrames,
+          stats.recordingAllocations, stats.recordingFrames);
+}
+
+/* The window is configured once per stream: when a preview starts and
+ * when it is resized, not for every frame. */
+static void
+check_window_configuration()
+{
+   struct test_session      session;
+   struct fake_window_stats stats;
+
+   clear_properties();
+   if (!open_session(&session, 320, 240, NULL)) {
+      EXPECT(false, "could not open the camera");
+      return;
+   }
+   camera_device_t *device = session.device;
+   fake_window_reset_stats(session.window);
+   EXPECT(run_preview(&session, 50), "no preview frames at 320x240");
+   fake_window_get_stats(session.window, &stats);
+   EXPECT(stats.enqueued >= 50 && stats.setUsage == 1 &&
+          stats.setGeometry == 1 && stats.setCount == 1,
+          "%u frames: %u set_usage, %u set_buffers_geometry, "
+          "%u set_buffer_count", stats.enqueued, stats.setUsage,
+          stats.setGeometry, stats.setCount);
+
+   set_sizes(device, 176, 144, 176, 144, NULL);
+   session.client.previewWidth  = 176;
+   session.client.previewHeight = 144;
+   fake_window_reset_stats(session.window);
+   EXPECT(run_preview(&session, 50), "no preview frames at 176x144");
+   fake_window_get_stats(session.window, &stats);
+   EXPECT(stats.enqueued >= 50 && stats.setUsage == 1 &&
+          stats.setGeometry == 1 && stats.setCount == 1,
+          "resized, %u frames: %u set_usage, %u set_buffers_geometry, "
+          "%u set_buffer_count", stats.enqueued, stats.setUsage,
+          stats.setGeometry, stats.setCount);
+   EXPECT(window_shows_mock_frame(session.window, 176, 144, false),
+          "resized, the window does not show a camera frame");
+   close_session(&session);
+}
+
+static void
+check_preview_callbacks()
+{
+   struct test_session session;
+
+   clear_properties();
+   if (!open_session(&session, 320, 240, NULL)) {
+      EXPECT(false, "could not open the camera");
+      return;
+   }
+   session.device->ops->enable_msg_type(session.device,
+                                        CAMERA_MSG_PREVIEW_FRAME);
+   EXPECT(run_preview(&session, 20), "no preview frames");
+   EXPECT(session.client.previewFrames > 0 &&
+          session.client.badPreviewFrames == 0,
+          "%u preview callbacks, %u not camera frames",
+          session.client.previewFrames, session.client.badPreviewFrames);
+   close_session(&session);
+}
+
+static void
+check_recording(const char *name, bool metadata, bool releaseLate)
+{
+   struct test_session      session;
+   struct mock_camera_stats stats;
+
+   clear_properties();
+   if (metadata) {
+      set_property("persist.camera.record.metadata", "1");
+   }
+   if (!open_session(&session, 320, 240, NULL)) {
+      EXPECT(false, "%s: could not open the camera", name);
+      return;
+   }
+   camera_device_t *device = session.device;
+   EXPECT(device->ops->store_meta_data_in_buffers(device, metadata) == 0,
+          "%s: store_meta_data_in_buffers refused", name);
+   MockCamera_ResetStats();
+   device->ops->start_preview(device);
+   device->ops->enable_msg_type(device, CAMERA_MSG_VIDEO_FRAME);
+   EXPECT(device->ops->start_recording(device) == 0,
+          "%s: start_recording failed", name);
+   MockCamera_WaitPreviewFrames(30, FRAME_TIMEOUT);
+   if (!releaseLate) {
+      /* CameraSource gives its frames back before it stops. */
+      release_held_frames(&session.client);
+   }
+   device->ops->disable_msg_type(device, CAMERA_MSG_VIDEO_FRAME);
+   device->ops->stop_recording(device);
+   if (releaseLate) {
+      release_held_frames(&session.client);
+   }
+   device->ops->stop_preview(device);
+
+   MockCamera_GetStats(&stats);
+   EXPECT(session.client.recordingFrames > 0 &&
+          session.client.badRecordingFrames == 0,
+          "%s: %u recording frames, %u not camera frames", name,
+          session.client.recordingFrames, session.client.badRecordingFrames);
+   EXPECT(stats.recordingHeld == 0 && stats.badReleases == 0,
+          "%s: %u frames never returned to the vendor, %u bad releases",
+          name, stats.recordingHeld, stats.badReleases);
+   close_session(&session);
+}
+
+static bool
+param_is(const android::CameraParameters &params, const char *key,
+         const char *value)
+{
+   return params.get(key) != NULL && strcmp(params.get(key), value) == 0;
+}
+
+/* With the preview pre-rotated, the camera must look like a portrait
+ * sensor everywhere: upright in the window, in preview callbacks and in
+ * recorded frames, and in the parameters. */
+static void
+check_portrait(const char *name, bool failBlit)
+{
+   struct test_session       session;
+   struct camera_info        info;
+   struct fake_fb_stats      fbStats;
+   android::CameraParameters params;
+   char                     *flat;
+   int                       width, height;
+
+   clear_properties();
+   set_property("persist.camera.preview.rotate", "1");
+   /* Metadata would hand the encoder the vendor's landscape frames. */
+   set_property("persist.camera.record.metadata", "1");
+   EXPECT(HAL_MODULE_INFO_SYM.get_camera_info(0, &info) == 0 &&
+          info.orientation == 0, "%s: orientation %d", name,
+          info.orientation);
+
+   fake_fb_set_failing(failBlit);
+   if (!open_session(&session, 240, 320,
+                     "rotation=0;focus-areas=(-1000,-1000,0,-500,1)")) {
+      EXPECT(false, "%s: could not open the camera", name);
+      fake_fb_set_failing(0);
+      return;
+   }
+   camera_device_t *device = session.device;
+   session.client.rotated = true;
+
+   flat = device->ops->get_parameters(device);
+   params.unflatten(android::String8(flat));
+   device->ops->put_parameters(device, flat);
+   params.getPreviewSize(&width, &height);
+   EXPECT(width == 240 && height == 320, "%s: preview size %dx%d", name,
+          width, height);
+   EXPECT(param_is(params,
+                   android::CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES,
+                   "480x640,320x480,288x352,240x320,144x176"),
+          "%s: preview sizes %s", name,
+          params.get(android::CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES));
+   EXPECT(param_is(params, android::CameraParameters::KEY_ROTATION, "0") &&
+          param_is(params,
+                   android::CameraParameters::KEY_HORIZONTAL_VIEW_ANGLE,
+                   "42.5") &&
+          param_is(params, android::CameraParameters::KEY_FOCUS_AREAS,
+                   "(-1000,-1000,0,-500,1)"),
+          "%s: rotation %s, horizontal view angle %s, focus areas %s", name,
+          params.get(android::CameraParameters::KEY_ROTATION),
+          params.get(android::CameraParameters::KEY_HORIZONTAL_VIEW_ANGLE),
+          params.get(android::CameraParameters::KEY_FOCUS_AREAS));
+
+   EXPECT(device->ops->store_meta_data_in_buffers(device, 1) != 0,
+          "%s: store_meta_data_in_buffers accepted", name);
+   fake_fb_reset_stats();
+   MockCamera_ResetStats();
+   device->ops->enable_msg_type(device, CAMERA_MSG_PREVIEW_FRAME);
+   device->ops->start_preview(device);
+   device->ops->enable_msg_type(device, CAMERA_MSG_VIDEO_FRAME);
+   EXPECT(device->ops->start_recording(device) == 0,
+          "%s: start_recording failed", name);
+   MockCamera_WaitPreviewFrames(30, FRAME_TIMEOUT);
+   release_held_frames(&session.client);
+   device->ops->disable_msg_type(device, CAMERA_MSG_VIDEO_FRAME);
+   device->ops->stop_recording(device);
+   device->ops->stop_preview(device);
+
+   EXPECT(session.client.previewFrames > 0 &&
+          session.client.badPreviewFrames == 0,
+          "%s: %u preview callbacks, %u not portrait camera frames", name,
+          session.client.previewFrames, session.client.badPreviewFrames);
+   EXPECT(session.client.recordingFrames > 0 &&
+          session.client.badRecordingFrames == 0,
+          "%s: %u recording frames, %u not portrait camera frames", name,
+          session.client.recordingFrames, session.client.badRecordingFrames);
+   EXPECT(window_shows_mock_frame(session.window, 240, 320, true),
+          "%s: the window does not show a portrait camera frame", name);
+   fake_fb_get_stats(&fbStats);
+   if (failBlit) {
+      EXPECT(fbStats.blits == 0, "%s: %u blits", name, fbStats.blits);
+   } else {
+      /* A rotated blit gives its destination rect before rotation. */
+      EXPECT(fbStats.rotated > 0 && (fbStats.last.flags & MDP_ROT_90) &&
+             fbStats.last.dst_rect.w == 320 &&
+             fbStats.last.dst_rect.h == 240,
+             "%s: %u of %u blits rotated, last to %ux%u flags 0x%x", name,
+             fbStats.rotated, fbStats.blits, fbStats.last.dst_rect.w,
+             fbStats.last.dst_rect.h, fbStats.last.flags);
+   }
+   close_session(&session);
+   fake_fb_set_failing(0);
+   clear_properties();
+}
+
+static void
+check_picture(const char *name, const char *extra, unsigned int vendorShots)
+{
+   struct test_session      session;
+   struct mock_camera_stats stats;
+
+   clear_properties();
+   if (!open_session(&session, 320, 240, extra)) {
+      EXPECT(false, "%s: could not open the camera", name);
+      return;
+   }
+   camera_device_t *device = session.device;
+   device->ops->enable_msg_type(device, CAMERA_MSG_SHUTTER |
+                                CAMERA_MSG_COMPRESSED_IMAGE);
+   MockCamera_ResetStats();
+   device->ops->start_preview(device);
+   MockCamera_WaitPreviewFrames(10, FRAME_TIMEOUT);
+   EXPECT(device->ops->take_picture(device) == 0, "%s: take_picture failed",
+          name);
+   for (int i = 0; i < 200; i++) {
+      {
+         android::Mutex::Autolock lock(session.client.lock);
+         if (session.client.pictures > 0) {
+            break;
+         }
+      }
+      usleep(10000);
+   }
+   device->ops->stop_preview(device);
+   MockCamera_GetStats(&stats);
+   EXPECT(session.client.pictures == 1, "%s: %u pictures", name,
+          session.client.pictures);
+   EXPECT(stats.pictures == vendorShots, "%s: %u vendor pictures", name,
+          stats.pictures);
+   close_session(&session);
+}
+
+/* Benchmark. */
+
+enum {
+   MODE_BLIT,
+   MODE_CPU,
+   MODE_YUV,
+   MODE_ASYNC,
+   MODE_CALLBACKS,
+   MODE_RECORDING,
+   MODE_METADATA,
+   MODE_COUNT
+};
+
+static const char *modeNames[MODE_COUNT] = {
+   "blit", "cpu copy", "yuv window", "async", "callbacks", "recording",
+   "metadata",
+};
+
+/* Prints how the recent preview callback times spread, in microseconds. */
+static void
+print_histogram(const struct frame_stage_stats *times)
+{
+   static const int32_t limits[] = {
+      250, 500, 1000, 2000, 4000, 8000, 16000
+   };
+   static const int     numLimits = sizeof(limits) / sizeof(limits[0]);
+   unsigned int         buckets[numLimits + 1];
+   int                  count = times->next;
+
+   if (count > FRAME_STATS_SAMPLES) {
+      count = FRAME_STATS_SAMPLES;
+   }
+   memset(buckets, 0, sizeof(buckets));
+   for (int i = 0; i < count; i++) {
+      int b = 0;
+      while (b < numLimits && times->samples[i] >= limits[b]) {
+         b++;
+      }
+      buckets[b]++;
+   }
+   printf("          ");
+   for (int b = 0; b < numLimits; b++) {
+      printf(" <%d:%u", limits[b], buckets[b]);
+   }
+   printf(" >=%d:%u\n", limits[numLimits - 1], buckets[numLimits]);
+}
+
+static void
+benchmark(int width, int height, int mode, bool histogram)
+{
+   static const unsigned int frames = 200;
+   struct test_session      session;
+   struct mock_camera_stats stats;
+   struct fake_window_stats windowStats;
+   struct frame_stats_summary times;
+   nsecs_t                  start, elapsed;
+   int32_t                  requests;
+
+   clear_properties();
+   if (mode == MODE_YUV) {
+      set_property("persist.camera.preview.yuv", "1");
+   } else if (mode == MODE_ASYNC) {
+      set_property("persist.camera.preview.async", "1");
+   } else if (mode == MODE_METADATA) {
+      set_property("persist.camera.record.metadata", "1");
+   }
+   fake_fb_set_failing(mode == MODE_CPU);
+   if (!open_session(&session, width, height, NULL)) {
+      EXPECT(false, "could not open the camera");
+      return;
+   }
+   camera_device_t *device = session.device;
+   if (mode == MODE_CALLBACKS) {
+      device->ops->enable_msg_type(device, CAMERA_MSG_PREVIEW_FRAME);
+   }
+   if (mode == MODE_RECORDING || mode == MODE_METADATA) {
+      device->ops->store_meta_data_in_buffers(device, mode == MODE_METADATA);
+   }
+
+   MockCamera_ResetStats();
+   device->ops->start_preview(device);
+   if (mode == MODE_RECORDING || mode == MODE_METADATA) {
+      device->ops->enable_msg_type(device, CAMERA_MSG_VIDEO_FRAME);
+      device->ops->start_recording(device);
+   }
+   MockCamera_WaitPreviewFrames(10, FRAME_TIMEOUT);
+   MockCamera_ResetStats();
+   fake_window_reset_stats(session.window);
+   requests = android_atomic_acquire_load(&gMemoryRequests);
+   start = systemTime();
+   MockCamera_WaitPreviewFrames(frames, FRAME_TIMEOUT * 5);
+   elapsed = systemTime() - start;
+   MockCamera_GetStats(&stats);
+   fake_window_get_stats(session.window, &windowStats);
+   requests = android_atomic_acquire_load(&gMemoryRequests) - requests;
+
+   if (mode == MODE_RECORDING || mode == MODE_METADATA) {
+      release_held_frames(&session.client);
+      device->ops->disable_msg_type(device, CAMERA_MSG_VIDEO_FRAME);
+      device->ops->stop_recording(device);
+   }
+   device->ops->stop_preview(device);
+   close_session(&session);
+   fake_fb_set_failing(0);
+
+   /* Times are of the vendor's preview callback, in microseconds.
+    * Allocations are the wrapper's own per vendor frame; requestMemory
+    * calls are allocations it has CameraService make. */
+   frame_stats_summarize(&stats.previewCallbackTimes, &times);
+   printf("%4dx%-4d %-10s %7.1f fps %6d p50 %6d p99 %6d max %4u shown "
+          "%5.2f allocs %5.2f requests/frame\n", width, height,
+          modeNames[mode], stats.previewFrames * 1000000000.0 / elapsed,
+          times.p50, times.p99, times.max, windowStats.enqueued,
+          stats.previewFrames ?
+             (double)(stats.previewAllocations + stats.recordingAllocations) /
+             stats.previewFrames : 0.0,
+          stats.previewFrames ? (double)requests / stats.previewFrames : 0.0);
+   if (histogram) {
+      print_histogram(&stats.previewCallbackTimes);
+   }
+}
+
+int
+main()
+{
+   static const int sizes[][2] = {
+      { 640, 480 }, { 352, 288 }, { 176, 144 }
+   };
+   struct mock_camera_config config;
+
+   if (fake_fb_init() < 0) {
+      fprintf(stderr, "can't create %s: %s\n", CAMERA_HAL_FB_DEVICE,
+              strerror(errno));
+      return 1;
+   }
+
+   /* The checks run at the sensor's rate: the async renderer reads the
+    * vendor's buffer after the callback returns, as on the device, and an
+    * unpaced vendor would overwrite it under the renderer. */
+   config.fps              = 30;
+   config.previewBuffers   = 4;
+   config.recordingBuffers = 8;
+   MockCamera_Configure(&config);
+
+   check_camera_info();
+   clear_properties();
+   check_preview("blit", 320, 240, false);
+   check_preview("cpu copy", 320, 240, true);
+   set_property("persist.camera.preview.yuv", "1");
+   check_preview("yuv window", 320, 240, false);
+   clear_properties();
+   set_property("persist.camera.preview.async", "1");
+   check_preview("async", 320, 240, false);
+   clear_properties();
+   check_blit_session();
+   check_frame_allocations();
+   check_window_configuration();
+   check_preview_callbacks();
+   check_recording("copy", false, false);
+   check_recording("metadata", true, false);
+   check_recording("metadata, released late", true, true);
+   check_portrait("portrait", false);
+   check_portrait("portrait, cpu copy", true);
+   check_picture("vendor", NULL, 1);
+   /* The ring only serves pictures the size of the preview. */
+   check_picture("zsl", "zsl=on;picture-size=320x240", 0);
+   printf("cameraHal: %d of %d checks pass\n", checks - failures, checks);
+
+   /* The benchmark runs the vendor flat out. */
+   config.fps = 0;
+   MockCamera_Configure(&config);
+
+   for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      for (int mode = 0; mode < MODE_COUNT; mode++) {
+         benchmark(sizes[s][0], sizes[s][1], mode, s == 0);
+      }
+   }
+
+   fake_fb_cleanup();
+   return failures != 0;
+}
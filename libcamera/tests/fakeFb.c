@@ -0,0 +1,402 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/ioctl.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "fakeFb.h"
+
+/* The MDP scales by up to 4 in either direction. */
+#define FAKE_FB_MAX_SCALE 4
+
+struct fake_fb_image {
+   void          *map;
+   size_t         length;
+   uint8_t       *data;
+};
+
+static pthread_mutex_t      fb_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fake_fb_stats fb_stats;
+static int                  fb_watch = -1;
+static int                  fb_ready;
+static int                  fb_failing;
+static dev_t                fb_dev;
+static ino_t                fb_ino;
+
+int
+fake_fb_init(void)
+{
+   struct stat st;
+   int         fd;
+
+   fd = open(CAMERA_HAL_FB_DEVICE, O_RDWR | O_CREAT | O_TRUNC, 0600);
+   if (fd < 0) {
+      return -1;
+   }
+   if (fstat(fd, &st) < 0) {
+      close(fd);
+      return -1;
+   }
+   close(fd);
+
+   /* Opens and closes are counted from inotify, so the HAL is built
+    * without any hooks of its own. */
+   fb_watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (fb_watch < 0) {
+      return -1;
+   }
+   if (inotify_add_watch(fb_watch, CAMERA_HAL_FB_DEVICE,
+                         IN_OPEN | IN_CLOSE) < 0) {
+      close(fb_watch);
+      fb_watch = -1;
+      return -1;
+   }
+
+   pthread_mutex_lock(&fb_lock);
+   memset(&fb_stats, 0, sizeof(fb_stats));
+   fb_dev     = st.st_dev;
+   fb_ino     = st.st_ino;
+   fb_failing = 0;
+   fb_ready   = 1;
+   pthread_mutex_unlock(&fb_lock);
+   return 0;
+}
+
+void
+fake_fb_cleanup(void)
+{
+   pthread_mutex_lock(&fb_lock);
+   fb_ready = 0;
+   pthread_mutex_unlock(&fb_lock);
+   if (fb_watch >= 0) {
+      close(fb_watch);
+      fb_watch = -1;
+   }
+   unlink(CAMERA_HAL_FB_DEVICE);
+}
+
+/* Called with fb_lock held. */
+static void
+fake_fb_read_events(void)
+{
+   char    buf[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+   ssize_t length;
+
+   while ((length = read(fb_watch, buf, sizeof(buf))) > 0) {
+      const char *p = buf;
+
+      while (p < buf + length) {
+         const struct inotify_event *event = (const struct inotify_event *)p;
+
+         if (event->mask & IN_OPEN) {
+            fb_stats.opens++;
+         }
+         if (event->mask & IN_CLOSE) {
+            fb_stats.closes++;
+         }
+         p += sizeof(*event) + event->len;
+      }
+   }
+}
+
+/* inotify folds an event into an identical one still unread, so two opens
+ * with no close between them count once. Whatever is left open is found
+ * here instead. */
+static unsigned int
+fake_fb_count_open(void)
+{
+   DIR           *dir = opendir("/proc/self/fd");
+   struct dirent *entry;
+   unsigned int   count = 0;
+
+   if (dir == NULL) {
+      return 0;
+   }
+   while ((entry = readdir(dir)) != NULL) {
+      struct stat st;
+      int         fd = atoi(entry->d_name);
+
+      if (entry->d_name[0] != '.' && fd != dirfd(dir) &&
+          fstat(fd, &st) == 0 && st.st_dev == fb_dev &&
+          st.st_ino == fb_ino) {
+         count++;
+      }
+   }
+   closedir(dir);
+   return count;
+}
+
+void
+fake_fb_get_stats(struct fake_fb_stats *stats)
+{
+   pthread_mutex_lock(&fb_lock);
+   fake_fb_read_events();
+   fb_stats.openNow = fake_fb_count_open();
+   *stats = fb_stats;
+   pthread_mutex_unlock(&fb_lock);
+}
+
+void
+fake_fb_reset_stats(void)
+{
+   pthread_mutex_lock(&fb_lock);
+   fake_fb_read_events();
+   memset(&fb_stats, 0, sizeof(fb_stats));
+   pthread_mutex_unlock(&fb_lock);
+}
+
+void
+fake_fb_set_failing(int failing)
+{
+   pthread_mutex_lock(&fb_lock);
+   fb_failing = failing;
+   pthread_mutex_unlock(&fb_lock);
+}
+
+static int
+fake_fb_is_yuv(uint32_t format)
+{
+   return format == MDP_Y_CBCR_H2V2 || format == MDP_Y_CRCB_H2V2;
+}
+
+static int
+fake_fb_is_rgbx(uint32_t format)
+{
+   return format == MDP_BGRA_8888 || format == MDP_RGBA_8888 ||
+          format == MDP_RGBX_8888;
+}
+
+static size_t
+fake_fb_image_size(const struct mdp_img *img)
+{
+   return fake_fb_is_yuv(img->format) ?
+             (size_t)img->width * img->height * 3 / 2 :
+             (size_t)img->width * img->height * 4;
+}
+
+/* Maps what img describes of its memory_id, which has to be big enough. */
+static int
+fake_fb_map_image(const struct mdp_img *img, int prot,
+                  struct fake_fb_image *image)
+{
+   size_t      page  = getpagesize();
+   size_t      bytes = fake_fb_image_size(img);
+   off_t       start = img->offset & ~(page - 1);
+   struct stat st;
+
+   if (fstat(img->memory_id, &st) < 0 ||
+       (off_t)(img->offset + bytes) > st.st_size) {
+      return -1;
+   }
+   image->length = img->offset - start + bytes;
+   image->map    = mmap(NULL, image->length, prot, MAP_SHARED,
+                        img->memory_id, start);
+   if (image->map == MAP_FAILED) {
+      return -1;
+   }
+   image->data = (uint8_t *)image->map + (img->offset - start);
+   return 0;
+}
+
+static int
+fake_fb_scale_ok(uint32_t src, uint32_t dst)
+{
+   return dst <= src * FAKE_FB_MAX_SCALE && src <= dst * FAKE_FB_MAX_SCALE;
+}
+
+/* The checks msm_fb makes before queueing a blit. */
+static int
+fake_fb_check(const struct mdp_blit_req *req)
+{
+   int      rotate = (req->flags & MDP_ROT_90) != 0;
+   uint32_t outW   = rotate ? req->dst_rect.h : req->dst_rect.w;
+   uint32_t outH   = rotate ? req->dst_rect.w : req->dst_rect.h;
+
+   if (!fake_fb_is_yuv(req->src.format) ||
+       (!fake_fb_is_yuv(req->dst.format) &&
+        !fake_fb_is_rgbx(req->dst.format))) {
+      return 0;
+   }
+   if (req->src_rect.w == 0 || req->src_rect.h == 0 ||
+       req->dst_rect.w == 0 || req->dst_rect.h == 0) {
+      return 0;
+   }
+   if (req->src_rect.x + req->src_rect.w > req->src.width ||
+       req->src_rect.y + req->src_rect.h > req->src.height) {
+      return 0;
+   }
+   /* A rotated blit gives its destination rect before rotation. */
+   if (req->dst_rect.x + outW > req->dst.width ||
+       req->dst_rect.y + outH > req->dst.height) {
+      return 0;
+   }
+   if (!fake_fb_scale_ok(req->src_rect.w, req->dst_rect.w) ||
+       !fake_fb_scale_ok(req->src_rect.h, req->dst_rect.h)) {
+      return 0;
+   }
+   if (fake_fb_is_yuv(req->dst.format) &&
+       ((req->dst.width | req->dst.height | outW | outH |
+         req->dst_rect.x | req->dst_rect.y) & 1)) {
+      return 0;
+   }
+   return 1;
+}
+
+static uint8_t
+fake_fb_clamp(int value)
+{
+   return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+/*
+ * Carries a checked request out. MDP_Y_CBCR_H2V2 keeps Cb in the high byte
+ * of each chroma pair, so in memory it is NV21, the camera's own layout.
+ * RGBX output is written in the byte order the HAL's CPU path writes.
+ */
+static void
+fake_fb_blit_image(const struct mdp_blit_req *req, const uint8_t *src,
+                   uint8_t *dst)
+{
+   int      rotate  = (req->flags & MDP_ROT_90) != 0;
+   uint32_t outW    = rotate ? req->dst_rect.h : req->dst_rect.w;
+   uint32_t outH    = rotate ? req->dst_rect.w : req->dst_rect.h;
+   int      swapUV  = req->src.format != req->dst.format;
+   const uint8_t *srcChroma = src + req->src.width * req->src.height;
+   uint8_t       *dstChroma = dst + req->dst.width * req->dst.height;
+   uint32_t ox, oy;
+
+   for (oy = 0; oy < outH; oy++) {
+      for (ox = 0; ox < outW; ox++) {
+         /* Back to the unrotated destination, clockwise, then scale. */
+         uint32_t px = rotate ? oy : ox;
+         uint32_t py = rotate ? outW - 1 - ox : oy;
+         uint32_t sx = req->src_rect.x + px * req->src_rect.w / req->dst_rect.w;
+         uint32_t sy = req->src_rect.y + py * req->src_rect.h / req->dst_rect.h;
+         uint32_t dx = req->dst_rect.x + ox;
+         uint32_t dy = req->dst_rect.y + oy;
+         const uint8_t *uv = srcChroma + (sy / 2) * req->src.width +
+                             (sx & ~1);
+         int y = src[sy * req->src.width + sx];
+
+         if (fake_fb_is_yuv(req->dst.format)) {
+            dst[dy * req->dst.width + dx] = y;
+            if (((dx | dy) & 1) == 0) {
+               uint8_t *out = dstChroma + (dy / 2) * req->dst.width + dx;
+               out[0] = uv[swapUV ? 1 : 0];
+               out[1] = uv[swapUV ? 0 : 1];
+            }
+         } else {
+            int      v   = (req->src.format == MDP_Y_CBCR_H2V2 ? uv[0] : uv[1])
+                           - 128;
+            int      u   = (req->src.format == MDP_Y_CBCR_H2V2 ? uv[1] : uv[0])
+                           - 128;
+            int      c   = (y - 16) * 298;
+            uint8_t *out = dst + (dy * req->dst.width + dx) * 4;
+
+            out[0] = fake_fb_clamp((c + 409 * v + 128) >> 8);
+            out[1] = fake_fb_clamp((c - 100 * u - 208 * v + 128) >> 8);
+            out[2] = fake_fb_clamp((c + 516 * u + 128) >> 8);
+            out[3] = 0xff;
+         }
+      }
+   }
+}
+
+/* Called with fb_lock held. */
+static int
+fake_fb_blit(const struct mdp_blit_req_list *list)
+{
+   unsigned int i;
+
+   if (fb_failing) {
+      fb_stats.rejected++;
+      errno = ENODEV;
+      return -1;
+   }
+   if (list->count == 0) {
+      fb_stats.rejected++;
+      errno = EINVAL;
+      return -1;
+   }
+   for (i = 0; i < list->count; i++) {
+      const struct mdp_blit_req *req = &list->req[i];
+      struct fake_fb_image       src, dst;
+
+      if (!fake_fb_check(req) ||
+          fake_fb_map_image(&req->src, PROT_READ, &src) < 0) {
+         fb_stats.rejected++;
+         errno = EINVAL;
+         return -1;
+      }
+      if (fake_fb_map_image(&req->dst, PROT_READ | PROT_WRITE, &dst) < 0) {
+         munmap(src.map, src.length);
+         fb_stats.rejected++;
+         errno = EINVAL;
+         return -1;
+      }
+      fake_fb_blit_image(req, src.data, dst.data);
+      munmap(src.map, src.length);
+      munmap(dst.map, dst.length);
+
+      fb_stats.blits++;
+      if (req->flags & MDP_ROT_90) {
+         fb_stats.rotated++;
+      }
+      if (req->src_rect.w != req->dst_rect.w ||
+          req->src_rect.h != req->dst_rect.h) {
+         fb_stats.scaled++;
+      }
+      fb_stats.last = *req;
+   }
+   return 0;
+}
+
+/* Takes over ioctl for the whole test executable; only MSMFB_BLIT on the
+ * fake device is handled here. */
+int
+ioctl(int fd, unsigned long request, ...)
+{
+   struct stat st;
+   va_list     ap;
+   void       *arg;
+   int         rc;
+
+   va_start(ap, request);
+   arg = va_arg(ap, void *);
+   va_end(ap);
+
+   if (request == MSMFB_BLIT && fstat(fd, &st) == 0) {
+      pthread_mutex_lock(&fb_lock);
+      if (fb_ready && st.st_dev == fb_dev && st.st_ino == fb_ino) {
+         rc = fake_fb_blit((const struct mdp_blit_req_list *)arg);
+         pthread_mutex_unlock(&fb_lock);
+         return rc;
+      }
+      pthread_mutex_unlock(&fb_lock);
+   }
+   return syscall(SYS_ioctl, fd, request, arg);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A stand-in for the MDP framebuffer, /dev/graphics/fb0, for the host test
+ * harness. The harness builds the HAL with CAMERA_HAL_FB_DEVICE pointing at
+ * a plain file; fake_fb_init creates it and from then on an MSMFB_BLIT ioctl
+ * on that file is checked the way the MDP driver checks it and carried out
+ * with nearest neighbour sampling. Other ioctls go to the kernel.
+ */
+
+#ifndef CAMERA_HAL_FAKE_FB_H
+#define CAMERA_HAL_FAKE_FB_H
+
+#include <linux/msm_mdp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct fake_fb_stats {
+   unsigned int opens;       /* opens of the device */
+   unsigned int closes;      /* closes of the device */
+   unsigned int openNow;     /* descriptors still open on it */
+   unsigned int blits;       /* blits carried out */
+   unsigned int rotated;     /* of those, with MDP_ROT_90 */
+   unsigned int scaled;      /* of those, with a scale factor */
+   unsigned int rejected;    /* requests failed */
+   struct mdp_blit_req last; /* the last request carried out */
+};
+
+/* Creates the device file. Returns 0, or -1 with errno set. */
+int fake_fb_init(void);
+void fake_fb_cleanup(void);
+
+void fake_fb_get_stats(struct fake_fb_stats *stats);
+void fake_fb_reset_stats(void);
+
+/* Makes every blit fail with ENODEV, to drive the HAL's CPU fallback. */
+void fake_fb_set_failing(int failing);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
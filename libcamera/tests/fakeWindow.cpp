@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FakeWindow"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <cutils/ashmem.h>
+#include <cutils/log.h>
+#include <gralloc_priv.h>
+#include <ui/GraphicBufferMapper.h>
+#include <utils/threads.h>
+#include "fakeWindow.h"
+
+#define FAKE_WINDOW_MAX_BUFFERS  8
+
+/* Buffers the compositor keeps, one on screen and one being composed. */
+#define FAKE_WINDOW_MIN_UNDEQUEUED 2
+
+#define ALIGN(x, a) (((x) + (a) - 1) & ~((a) - 1))
+
+enum {
+   BUFFER_FREE,
+   BUFFER_DEQUEUED,
+   BUFFER_ON_SCREEN,
+};
+
+struct fake_window_buffer {
+   buffer_handle_t   handle;    /* dequeue_buffer hands out its address */
+   private_handle_t *priv;
+   int               stride;
+   int               state;
+};
+
+struct fake_window {
+   /* First, so that the ops the HAL is given lead back to the window. */
+   preview_stream_ops_t      ops;
+   android::Mutex            lock;
+   int                       defaultWidth;
+   int                       defaultHeight;
+   int                       width;     /* 0 for the default size */
+   int                       height;
+   int                       format;
+   int                       count;
+   int                       dequeued;
+   struct fake_window_buffer buffers[FAKE_WINDOW_MAX_BUFFERS];
+   struct fake_window_stats  stats;
+};
+
+static struct fake_window *
+FakeWindow_Get(const preview_stream_ops_t *ops)
+{
+   return reinterpret_cast<struct fake_window *>(
+             const_cast<preview_stream_ops_t *>(ops));
+}
+
+static void
+FakeWindow_FreeBuffer(struct fake_window_buffer *buffer)
+{
+   if (buffer->priv == NULL) {
+      return;
+   }
+   android::GraphicBufferMapper::get().unregisterBuffer(buffer->handle);
+   close(buffer->priv->fd);
+   delete buffer->priv;
+   buffer->priv   = NULL;
+   buffer->handle = NULL;
+   buffer->state  = BUFFER_FREE;
+}
+
+/* Called with window->lock held. */
+static bool
+FakeWindow_AllocBuffer(struct fake_window *window,
+                       struct fake_window_buffer *buffer)
+{
+   int width  = window->width ? window->width : window->defaultWidth;
+   int height = window->width ? window->height : window->defaultHeight;
+   bool yuv   = window->format == HAL_PIXEL_FORMAT_YCrCb_420_SP;
+   int stride = yuv ? ALIGN(width, 16) : ALIGN(width, 32);
+   int size   = yuv ? stride * height * 3 / 2 : stride * height * 4;
+   int fd;
+
+   fd = ashmem_create_region("fake-window", size);
+   if (fd < 0) {
+      LOGE("FakeWindow_AllocBuffer: ERROR creating %d bytes\n", size);
+      return false;
+   }
+   buffer->priv = new private_handle_t(fd, size,
+                                       private_handle_t::PRIV_FLAGS_USES_ASHMEM,
+                                       BUFFER_TYPE_UI, window->format,
+                                       width, height);
+   buffer->handle = buffer->priv;
+   buffer->stride = stride;
+   if (android::GraphicBufferMapper::get().registerBuffer(buffer->handle) !=
+       android::NO_ERROR) {
+      LOGE("FakeWindow_AllocBuffer: ERROR mapping fd:%d\n", fd);
+      close(fd);
+      delete buffer->priv;
+      buffer->priv   = NULL;
+      buffer->handle = NULL;
+      return false;
+   }
+   window->stats.allocated++;
+   return true;
+}
+
+/* Whether buffer was allocated for the window's current geometry. */
+static bool
+FakeWindow_Matches(struct fake_window *window,
+                   struct fake_window_buffer *buffer)
+{
+   int width  = window->width ? window->width : window->defaultWidth;
+   int height = window->width ? window->height : window->defaultHeight;
+
+   return buffer->priv != NULL && buffer->priv->width == width &&
+          buffer->priv->height == height &&
+          buffer->priv->format == window->format;
+}
+
+static struct fake_window_buffer *
+FakeWindow_FindBuffer(struct fake_window *window, buffer_handle_t *handle)
+{
+   for (int i = 0; i < FAKE_WINDOW_MAX_BUFFERS; i++) {
+      if (&window->buffers[i].handle == handle &&
+          window->buffers[i].priv != NULL) {
+         return &window->buffers[i];
+      }
+   }
+   return NULL;
+}
+
+static int
+FakeWindow_Dequeue(preview_stream_ops_t *ops, buffer_handle_t **handle,
+                   int *stride)
+{
+   struct fake_window        *window = FakeWindow_Get(ops);
+   struct fake_window_buffer *buffer = NULL;
+   android::Mutex::Autolock   lock(window->lock);
+
+   if (window->dequeued >= window->count - FAKE_WINDOW_MIN_UNDEQUEUED) {
+      window->stats.busy++;
+      return -EBUSY;
+   }
+   for (int i = 0; i < window->count && buffer == NULL; i++) {
+      if (window->buffers[i].state == BUFFER_FREE) {
+         buffer = &window->buffers[i];
+      }
+   }
+   if (buffer == NULL) {
+      window->stats.busy++;
+      return -EBUSY;
+   }
+   if (!FakeWindow_Matches(window, buffer)) {
+      FakeWindow_FreeBuffer(buffer);
+      if (!FakeWindow_AllocBuffer(window, buffer)) {
+         return -ENOMEM;
+      }
+   }
+   buffer->state = BUFFER_DEQUEUED;
+   window->dequeued++;
+   window->stats.dequeued++;
+   *handle = &buffer->handle;
+   *stride = buffer->stride;
+   return 0;
+}
+
+static int
+FakeWindow_Enqueue(preview_stream_ops_t *ops, buffer_handle_t *handle)
+{
+   struct fake_window        *window = FakeWindow_Get(ops);
+   android::Mutex::Autolock   lock(window->lock);
+   struct fake_window_buffer *buffer = FakeWindow_FindBuffer(window, handle);
+
+   if (buffer == NULL || buffer->state != BUFFER_DEQUEUED) {
+      LOGE("FakeWindow_Enqueue: %p was not dequeued\n", handle);
+      return -EINVAL;
+   }
+   for (int i = 0; i < FAKE_WINDOW_MAX_BUFFERS; i++) {
+      if (window->buffers[i].state == BUFFER_ON_SCREEN) {
+         window->buffers[i].state = BUFFER_FREE;
+      }
+   }
+   buffer->state = BUFFER_ON_SCREEN;
+   window->dequeued--;
+   window->stats.enqueued++;
+   return 0;
+}
+
+static int
+FakeWindow_Cancel(preview_stream_ops_t *ops, buffer_handle_t *handle)
+{
+   struct fake_window        *window = FakeWindow_Get(ops);
+   android::Mutex::Autolock   lock(window->lock);
+   struct fake_window_buffer *buffer = FakeWindow_FindBuffer(window, handle);
+
+   if (buffer == NULL || buffer->state != BUFFER_DEQUEUED) {
+      LOGE("FakeWindow_Cancel: %p was not dequeued\n", handle);
+      return -EINVAL;
+   }
+   buffer->state = BUFFER_FREE;
+   window->dequeued--;
+   window->stats.cancelled++;
+   return 0;
+}
+
+static int
+FakeWindow_SetBufferCount(preview_stream_ops_t *ops, int count)
+{
+   struct fake_window       *window = FakeWindow_Get(ops);
+   android::Mutex::Autolock  lock(window->lock);
+
+   window->stats.setCount++;
+   if (count <= FAKE_WINDOW_MIN_UNDEQUEUED || count > FAKE_WINDOW_MAX_BUFFERS ||
+       window->dequeued > 0) {
+      return -EINVAL;
+   }
+   if (count != window->count) {
+      for (int i = 0; i < FAKE_WINDOW_MAX_BUFFERS; i++) {
+         FakeWindow_FreeBuffer(&window->buffers[i]);
+      }
+      window->count = count;
+   }
+   return 0;
+}
+
+static int
+FakeWindow_SetGeometry(preview_stream_ops_t *ops, int width, int height,
+                       int format)
+{
+   struct fake_window       *window = FakeWindow_Get(ops);
+   android::Mutex::Autolock  lock(window->lock);
+
+   window->stats.setGeometry++;
+   if (width < 0 || height < 0 || (width == 0) != (height == 0) ||
+       (format != HAL_PIXEL_FORMAT_RGBX_8888 &&
+        format != HAL_PIXEL_FORMAT_YCrCb_420_SP)) {
+      return -EINVAL;
+   }
+   window->width  = width;
+   window->height = height;
+   window->format = format;
+   return 0;
+}
+
+static int
+FakeWindow_SetCrop(preview_stream_ops_t *ops, int left, int top, int right,
+                   int bottom)
+{
+   return 0;
+}
+
+static int
+FakeWindow_SetUsage(preview_stream_ops_t *ops, int usage)
+{
+   struct fake_window       *window = FakeWindow_Get(ops);
+   android::Mutex::Autolock  lock(window->lock);
+
+   window->stats.setUsage++;
+   return 0;
+}
+
+static int
+FakeWindow_SetSwapInterval(preview_stream_ops_t *ops, int interval)
+{
+   return 0;
+}
+
+static int
+FakeWindow_GetMinUndequeued(const preview_stream_ops_t *ops, int *count)
+{
+   *count = FAKE_WINDOW_MIN_UNDEQUEUED;
+   return 0;
+}
+
+static int
+FakeWindow_Lock(preview_stream_ops_t *ops, buffer_handle_t *handle)
+{
+   struct fake_window        *window = FakeWindow_Get(ops);
+   android::Mutex::Autolock   lock(window->lock);
+   struct fake_window_buffer *buffer = FakeWindow_FindBuffer(window, handle);
+
+   return buffer != NULL && buffer->state == BUFFER_DEQUEUED ? 0 : -EINVAL;
+}
+
+struct fake_window *
+fake_window_create(int defaultWidth, int defaultHeight)
+{
+   struct fake_window *window = new fake_window();
+
+   window->ops.dequeue_buffer       = FakeWindow_Dequeue;
+   window->ops.enqueue_buffer       = FakeWindow_Enqueue;
+   window->ops.cancel_buffer        = FakeWindow_Cancel;
+   window->ops.set_buffer_count     = FakeWindow_SetBufferCount;
+   window->ops.set_buffers_geometry = FakeWindow_SetGeometry;
+   window->ops.set_crop             = FakeWindow_SetCrop;
+   window->ops.set_usage            = FakeWindow_SetUsage;
+   window->ops.set_swap_interval    = FakeWindow_SetSwapInterval;
+   window->ops.get_min_undequeued_buffer_count = FakeWindow_GetMinUndequeued;
+   window->ops.lock_buffer          = FakeWindow_Lock;
+   window->defaultWidth  = defaultWidth;
+   window->defaultHeight = defaultHeight;
+   window->format        = HAL_PIXEL_FORMAT_RGBX_8888;
+   window->count         = FAKE_WINDOW_MIN_UNDEQUEUED + 2;
+   return window;
+}
+
+void
+fake_window_destroy(struct fake_window *window)
+{
+   for (int i = 0; i < FAKE_WINDOW_MAX_BUFFERS; i++) {
+      FakeWindow_FreeBuffer(&window->buffers[i]);
+   }
+   delete window;
+}
+
+preview_stream_ops_t *
+fake_window_ops(struct fake_window *window)
+{
+   return &window->ops;
+}
+
+void
+fake_window_get_stats(struct fake_window *window,
+                      struct fake_window_stats *stats)
+{
+   android::Mutex::Autolock lock(window->lock);
+
+   *stats = window->stats;
+}
+
+void
+fake_window_reset_stats(struct fake_window *window)
+{
+   android::Mutex::Autolock lock(window->lock);
+
+   memset(&window->stats, 0, sizeof(window->stats));
+}
+
+bool
+fake_window_get_frame(struct fake_window *window,
+                      struct fake_window_frame *frame)
+{
+   android::Mutex::Autolock lock(window->lock);
+
+   for (int i = 0; i < FAKE_WINDOW_MAX_BUFFERS; i++) {
+      struct fake_window_buffer *buffer = &window->buffers[i];
+      void                      *vaddr  = NULL;
+
+      if (buffer->state != BUFFER_ON_SCREEN) {
+         continue;
+      }
+      if (android::GraphicBufferMapper::get().lock(buffer->handle,
+             GRALLOC_USAGE_SW_READ_OFTEN,
+             android::Rect(buffer->priv->width, buffer->priv->height),
+             &vaddr) != android::NO_ERROR) {
+         return false;
+      }
+      android::GraphicBufferMapper::get().unlock(buffer->handle);
+      frame->data   = (const uint8_t *)vaddr;
+      frame->width  = buffer->priv->width;
+      frame->height = buffer->priv->height;
+      frame->stride = buffer->stride;
+      frame->format = buffer->priv->format;
+      return true;
+   }
+   return false;
+}
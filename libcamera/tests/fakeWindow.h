@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A preview window for the host test harness. It hands out gralloc style
+ * buffers backed by ashmem through preview_stream_ops the way the
+ * framework's native window does: buffers are allocated on dequeue once the
+ * geometry or count changed, two stay with the compositor, and the last one
+ * queued stays on screen until the next is queued.
+ */
+
+#ifndef CAMERA_HAL_FAKE_WINDOW_H
+#define CAMERA_HAL_FAKE_WINDOW_H
+
+#include <stdint.h>
+#include <hardware/camera.h>
+
+struct fake_window;
+
+struct fake_window_stats {
+   unsigned int setUsage;       /* set_usage calls */
+   unsigned int setGeometry;    /* set_buffers_geometry calls */
+   unsigned int setCount;       /* set_buffer_count calls */
+   unsigned int dequeued;       /* buffers dequeued */
+   unsigned int enqueued;       /* buffers queued for display */
+   unsigned int cancelled;      /* buffers cancelled */
+   unsigned int busy;           /* dequeues refused, too many held */
+   unsigned int allocated;      /* buffers (re)allocated */
+};
+
+/* The buffer on screen, valid until the window is destroyed. */
+struct fake_window_frame {
+   const uint8_t *data;
+   int            width;
+   int            height;
+   int            stride;       /* in pixels */
+   int            format;
+};
+
+struct fake_window *fake_window_create(int defaultWidth, int defaultHeight);
+void fake_window_destroy(struct fake_window *window);
+
+preview_stream_ops_t *fake_window_ops(struct fake_window *window);
+
+void fake_window_get_stats(struct fake_window *window,
+                           struct fake_window_stats *stats);
+void fake_window_reset_stats(struct fake_window *window);
+
+/* Returns false if nothing was queued yet. */
+bool fake_window_get_frame(struct fake_window *window,
+                           struct fake_window_frame *frame);
+
+#endif
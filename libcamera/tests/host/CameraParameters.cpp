@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host build of the parts of CameraParameters the wrapper and the mock
+ * vendor use. libcamera_client, which has the device build, only builds for
+ * the device. The format is the framework's: key=value pairs joined by ';'.
+ */
+
+/* Leaves out the blob symbols the header defines, as the wrapper does. */
+#define THE_WRAPPER
+
+#include <camera/CameraParameters.h>
+#include <cutils/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+const char CameraParameters::KEY_PREVIEW_SIZE[] = "preview-size";
+const char CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES[] =
+   "preview-size-values";
+const char CameraParameters::KEY_PREVIEW_FPS_RANGE[] = "preview-fps-range";
+const char CameraParameters::KEY_PREVIEW_FORMAT[] = "preview-format";
+const char CameraParameters::KEY_PREVIEW_FRAME_RATE[] = "preview-frame-rate";
+const char CameraParameters::KEY_SUPPORTED_PREVIEW_FRAME_RATES[] =
+   "preview-frame-rate-values";
+const char CameraParameters::KEY_PICTURE_SIZE[] = "picture-size";
+const char CameraParameters::KEY_SUPPORTED_PICTURE_SIZES[] =
+   "picture-size-values";
+const char CameraParameters::KEY_PICTURE_FORMAT[] = "picture-format";
+const char CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH[] =
+   "jpeg-thumbnail-width";
+const char CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT[] =
+   "jpeg-thumbnail-height";
+const char CameraParameters::KEY_SUPPORTED_JPEG_THUMBNAIL_SIZES[] =
+   "jpeg-thumbnail-size-values";
+const char CameraParameters::KEY_JPEG_QUALITY[] = "jpeg-quality";
+const char CameraParameters::KEY_ROTATION[] = "rotation";
+const char CameraParameters::KEY_FOCUS_AREAS[] = "focus-areas";
+const char CameraParameters::KEY_HORIZONTAL_VIEW_ANGLE[] =
+   "horizontal-view-angle";
+const char CameraParameters::KEY_VERTICAL_VIEW_ANGLE[] = "vertical-view-angle";
+const char CameraParameters::KEY_METERING_AREAS[] = "metering-areas";
+const char CameraParameters::KEY_VIDEO_SIZE[] = "video-size";
+const char CameraParameters::KEY_SUPPORTED_VIDEO_SIZES[] = "video-size-values";
+const char CameraParameters::KEY_PREFERRED_PREVIEW_SIZE_FOR_VIDEO[] =
+   "preferred-preview-size-for-video";
+const char CameraParameters::KEY_VIDEO_FRAME_FORMAT[] = "video-frame-format";
+const char CameraParameters::KEY_VIDEO_SNAPSHOT_SUPPORTED[] =
+   "video-snapshot-supported";
+const char CameraParameters::TRUE[] = "true";
+const char CameraParameters::PIXEL_FORMAT_YUV420SP[] = "yuv420sp";
+const char CameraParameters::PIXEL_FORMAT_JPEG[] = "jpeg";
+
+CameraParameters::CameraParameters()
+   : mMap()
+{
+}
+
+CameraParameters::~CameraParameters()
+{
+}
+
+String8
+CameraParameters::flatten() const
+{
+   String8 flattened("");
+   size_t  size = mMap.size();
+
+   for (size_t i = 0; i < size; i++) {
+      flattened += mMap.keyAt(i);
+      flattened += "=";
+      flattened += mMap.valueAt(i);
+      if (i != size - 1) {
+         flattened += ";";
+      }
+   }
+   return flattened;
+}
+
+void
+CameraParameters::unflatten(const String8 &params)
+{
+   const char *a = params.string();
+   const char *b;
+
+   mMap.clear();
+   for (;;) {
+      /* Find the bounds of the key name. */
+      b = strchr(a, '=');
+      if (b == NULL) {
+         break;
+      }
+      String8 key(a, (size_t)(b - a));
+
+      /* Find the value. */
+      a = b + 1;
+      b = strchr(a, ';');
+      if (b == NULL) {
+         /* If there's no semicolon, this is the last item. */
+         String8 value(a);
+         mMap.add(key, value);
+         break;
+      }
+      String8 value(a, (size_t)(b - a));
+      mMap.add(key, value);
+      a = b + 1;
+   }
+}
+
+void
+CameraParameters::set(const char *key, const char *value)
+{
+   if (strchr(key, '=') || strchr(key, ';')) {
+      LOGE("Key \"%s\" contains invalid character (= or ;)\n", key);
+      return;
+   }
+   if (strchr(value, '=') || strchr(value, ';')) {
+      LOGE("Value \"%s\" contains invalid character (= or ;)\n", value);
+      return;
+   }
+   mMap.replaceValueFor(String8(key), String8(value));
+}
+
+void
+CameraParameters::set(const char *key, int value)
+{
+   char str[16];
+
+   snprintf(str, sizeof(str), "%d", value);
+   set(key, str);
+}
+
+const char *
+CameraParameters::get(const char *key) const
+{
+   String8 v = mMap.valueFor(String8(key));
+
+   if (v.length() == 0) {
+      return 0;
+   }
+   return mMap.valueFor(String8(key)).string();
+}
+
+int
+CameraParameters::getInt(const char *key) const
+{
+   const char *v = get(key);
+
+   return v != 0 ? strtol(v, 0, 0) : -1;
+}
+
+void
+CameraParameters::remove(const char *key)
+{
+   mMap.removeItem(String8(key));
+}
+
+/* Parses a "WxH" size at the start of str. */
+static int
+parse_pair(const char *str, int *first, int *second, char delim)
+{
+   char *end;
+   int   w, h;
+
+   w = (int)strtol(str, &end, 10);
+   if (*end != delim) {
+      return -1;
+   }
+   h = (int)strtol(end + 1, &end, 10);
+   *first  = w;
+   *second = h;
+   return 0;
+}
+
+static void
+get_size(const CameraParameters *params, const char *key, int *width,
+         int *height)
+{
+   const char *p = params->get(key);
+
+   *width = *height = -1;
+   if (p != 0) {
+      parse_pair(p, width, height, 'x');
+   }
+}
+
+void
+CameraParameters::setPreviewSize(int width, int height)
+{
+   char str[32];
+
+   snprintf(str, sizeof(str), "%dx%d", width, height);
+   set(KEY_PREVIEW_SIZE, str);
+}
+
+void
+CameraParameters::getPreviewSize(int *width, int *height) const
+{
+   get_size(this, KEY_PREVIEW_SIZE, width, height);
+}
+
+void
+CameraParameters::setVideoSize(int width, int height)
+{
+   char str[32];
+
+   snprintf(str, sizeof(str), "%dx%d", width, height);
+   set(KEY_VIDEO_SIZE, str);
+}
+
+void
+CameraParameters::getVideoSize(int *width, int *height) const
+{
+   get_size(this, KEY_VIDEO_SIZE, width, height);
+}
+
+void
+CameraParameters::setPictureSize(int width, int height)
+{
+   char str[32];
+
+   snprintf(str, sizeof(str), "%dx%d", width, height);
+   set(KEY_PICTURE_SIZE, str);
+}
+
+void
+CameraParameters::getPictureSize(int *width, int *height) const
+{
+   get_size(this, KEY_PICTURE_SIZE, width, height);
+}
+
+}; // namespace android
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ui/GraphicBufferMapper.h>
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
+#include <cutils/log.h>
+#include <gralloc_priv.h>
+#include <sys/mman.h>
+
+namespace android {
+
+static Mutex                                  gLock;
+static KeyedVector<buffer_handle_t, void *>   gMappings;
+
+GraphicBufferMapper &
+GraphicBufferMapper::get()
+{
+   static GraphicBufferMapper mapper;
+
+   return mapper;
+}
+
+status_t
+GraphicBufferMapper::registerBuffer(buffer_handle_t handle)
+{
+   private_handle_t const *hnd = private_handle_t::dynamicCast(handle);
+   void                   *base;
+
+   if (hnd == NULL) {
+      return BAD_VALUE;
+   }
+   base = mmap(NULL, hnd->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               hnd->fd, hnd->offset);
+   if (base == MAP_FAILED) {
+      return -errno;
+   }
+   Mutex::Autolock lock(gLock);
+   gMappings.add(handle, base);
+   return NO_ERROR;
+}
+
+status_t
+GraphicBufferMapper::unregisterBuffer(buffer_handle_t handle)
+{
+   private_handle_t const *hnd = private_handle_t::dynamicCast(handle);
+   Mutex::Autolock         lock(gLock);
+   ssize_t                 index = gMappings.indexOfKey(handle);
+
+   if (hnd == NULL || index < 0) {
+      return BAD_VALUE;
+   }
+   munmap(gMappings.valueAt(index), hnd->size);
+   gMappings.removeItemsAt(index);
+   return NO_ERROR;
+}
+
+status_t
+GraphicBufferMapper::lock(buffer_handle_t handle, int usage,
+                          const Rect &bounds, void **vaddr)
+{
+   private_handle_t const *hnd = private_handle_t::dynamicCast(handle);
+   Mutex::Autolock         lock(gLock);
+   ssize_t                 index = gMappings.indexOfKey(handle);
+
+   if (hnd == NULL || index < 0) {
+      return BAD_VALUE;
+   }
+   if (bounds.left < 0 || bounds.top < 0 ||
+       bounds.right > hnd->width || bounds.bottom > hnd->height) {
+      LOGE("GraphicBufferMapper::lock: %dx%d is outside the %dx%d buffer\n",
+           bounds.right, bounds.bottom, hnd->width, hnd->height);
+      return BAD_VALUE;
+   }
+   *vaddr = gMappings.valueAt(index);
+   return NO_ERROR;
+}
+
+status_t
+GraphicBufferMapper::unlock(buffer_handle_t handle)
+{
+   Mutex::Autolock lock(gLock);
+
+   return gMappings.indexOfKey(handle) >= 0 ? NO_ERROR : BAD_VALUE;
+}
+
+}; // namespace android
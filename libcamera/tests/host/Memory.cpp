@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <binder/MemoryBase.h>
+#include <binder/MemoryHeapBase.h>
+#include <cutils/ashmem.h>
+#include <cutils/log.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace android {
+
+void *
+IMemory::pointer() const
+{
+   ssize_t         offset;
+   sp<IMemoryHeap> heap = getMemory(&offset);
+
+   return heap != NULL ? (char *)heap->base() + offset : NULL;
+}
+
+size_t
+IMemory::size() const
+{
+   size_t size;
+
+   getMemory(NULL, &size);
+   return size;
+}
+
+ssize_t
+IMemory::offset() const
+{
+   ssize_t offset;
+
+   getMemory(&offset);
+   return offset;
+}
+
+MemoryHeapBase::MemoryHeapBase(size_t size, uint32_t flags, char const *name)
+   : mFD(-1), mSize(0), mBase(MAP_FAILED), mFlags(flags)
+{
+   const size_t pagesize = getpagesize();
+
+   size = (size + pagesize - 1) & ~(pagesize - 1);
+   mFD  = ashmem_create_region(name == NULL ? "MemoryHeapBase" : name, size);
+   if (mFD < 0) {
+      LOGE("MemoryHeapBase: ERROR creating a %u byte region\n", size);
+      return;
+   }
+   mBase = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFD, 0);
+   if (mBase == MAP_FAILED) {
+      LOGE("MemoryHeapBase: ERROR mapping fd:%d %s\n", mFD, strerror(errno));
+      close(mFD);
+      mFD = -1;
+      return;
+   }
+   mSize = size;
+}
+
+MemoryHeapBase::~MemoryHeapBase()
+{
+   if (mBase != MAP_FAILED) {
+      munmap(mBase, mSize);
+   }
+   if (mFD >= 0) {
+      close(mFD);
+   }
+}
+
+int
+MemoryHeapBase::getHeapID() const
+{
+   return mFD;
+}
+
+void *
+MemoryHeapBase::getBase() const
+{
+   return mBase;
+}
+
+size_t
+MemoryHeapBase::getSize() const
+{
+   return mSize;
+}
+
+uint32_t
+MemoryHeapBase::getFlags() const
+{
+   return mFlags;
+}
+
+uint32_t
+MemoryHeapBase::getOffset() const
+{
+   return 0;
+}
+
+MemoryBase::MemoryBase(const sp<IMemoryHeap> &heap, ssize_t offset,
+                       size_t size)
+   : mSize(size), mOffset(offset), mHeap(heap)
+{
+}
+
+MemoryBase::~MemoryBase()
+{
+}
+
+sp<IMemoryHeap>
+MemoryBase::getMemory(ssize_t *offset, size_t *size) const
+{
+   if (offset != NULL) {
+      *offset = mOffset;
+   }
+   if (size != NULL) {
+      *size = mSize;
+   }
+   return mHeap;
+}
+
+}; // namespace android
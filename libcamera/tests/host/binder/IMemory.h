@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for libbinder's IMemoryHeap and IMemory, which only build
+ * for the device. It keeps the calls the HAL and the mock vendor make, with
+ * no binder transport behind them.
+ */
+
+#ifndef ANDROID_IMEMORY_H
+#define ANDROID_IMEMORY_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/RefBase.h>
+#include <utils/Errors.h>
+/* The real header gets String16 through IInterface, and qcamera_dump
+ * relies on that. */
+#include <utils/String16.h>
+
+namespace android {
+
+class IMemoryHeap : public virtual RefBase
+{
+public:
+   enum {
+      READ_ONLY = 0x00000001
+   };
+
+   virtual int      getHeapID() const = 0;
+   virtual void    *getBase() const = 0;
+   virtual size_t   getSize() const = 0;
+   virtual uint32_t getFlags() const = 0;
+   virtual uint32_t getOffset() const = 0;
+
+   void   *base() const        { return getBase(); }
+   int     heapID() const      { return getHeapID(); }
+   size_t  virtualSize() const { return getSize(); }
+};
+
+class IMemory : public virtual RefBase
+{
+public:
+   virtual sp<IMemoryHeap> getMemory(ssize_t *offset = 0,
+                                     size_t *size = 0) const = 0;
+
+   void   *pointer() const;
+   size_t  size() const;
+   ssize_t offset() const;
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host stand-in for libbinder's MemoryBase, a piece of a heap. */
+
+#ifndef ANDROID_MEMORY_BASE_H
+#define ANDROID_MEMORY_BASE_H
+
+#include <binder/IMemory.h>
+
+namespace android {
+
+class MemoryBase : public IMemory
+{
+public:
+   MemoryBase(const sp<IMemoryHeap> &heap, ssize_t offset, size_t size);
+   virtual ~MemoryBase();
+
+   virtual sp<IMemoryHeap> getMemory(ssize_t *offset = 0,
+                                     size_t *size = 0) const;
+
+private:
+   size_t          mSize;
+   ssize_t         mOffset;
+   sp<IMemoryHeap> mHeap;
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for libbinder's MemoryHeapBase. Like the device one it is
+ * backed by an ashmem region, which libcutils emulates on the host with an
+ * unlinked file, so the heap has an fd that can be mapped again.
+ */
+
+#ifndef ANDROID_MEMORY_HEAP_BASE_H
+#define ANDROID_MEMORY_HEAP_BASE_H
+
+#include <binder/IMemory.h>
+
+namespace android {
+
+class MemoryHeapBase : public virtual IMemoryHeap
+{
+public:
+   MemoryHeapBase(size_t size, uint32_t flags = 0, char const *name = NULL);
+   virtual ~MemoryHeapBase();
+
+   virtual int      getHeapID() const;
+   virtual void    *getBase() const;
+   virtual size_t   getSize() const;
+   virtual uint32_t getFlags() const;
+   virtual uint32_t getOffset() const;
+
+private:
+   int      mFD;
+   size_t   mSize;
+   void    *mBase;
+   uint32_t mFlags;
+};
+
+}; // namespace android
+
+#endif
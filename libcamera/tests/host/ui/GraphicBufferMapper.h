@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for libui's GraphicBufferMapper. Buffers are the fake
+ * window's gralloc handles: registering one maps its fd, and lock hands out
+ * that mapping.
+ */
+
+#ifndef ANDROID_UI_BUFFER_MAPPER_H
+#define ANDROID_UI_BUFFER_MAPPER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <system/window.h>
+#include <ui/Rect.h>
+#include <utils/Errors.h>
+
+namespace android {
+
+class GraphicBufferMapper
+{
+public:
+   static GraphicBufferMapper &get();
+
+   status_t registerBuffer(buffer_handle_t handle);
+   status_t unregisterBuffer(buffer_handle_t handle);
+   status_t lock(buffer_handle_t handle, int usage, const Rect &bounds,
+                 void **vaddr);
+   status_t unlock(buffer_handle_t handle);
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,608 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks jpeg_fdct, the NEON transform on ARM, against jpeg_fdct_ref, then
+ * decodes what jpeg_encode_nv21 writes with the small baseline decoder
+ * below and compares it with the source frame. The decoder knows only
+ * what the encoder emits: 8 bit baseline, three components, 2x2 luma
+ * sampling, no restart markers.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "jpegEncode.h"
+
+/* Largest difference allowed between the two transforms. They differ
+ * only in how the products of the butterflies are rounded; the measured
+ * worst case is 3. */
+#define FDCT_TOLERANCE  4
+
+enum {
+   PATTERN_RANDOM,
+   PATTERN_EXTREMES,    /* 0 and 255 only */
+   PATTERN_SMOOTH,      /* gradients with a little noise, like a photo */
+   PATTERN_COUNT
+};
+
+static const uint8_t zigzag[64] = {
+    0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+   12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+   35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+   58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static uint32_t seed = 1;
+
+static uint8_t
+next_byte(int pattern, int x, int y)
+{
+   seed = seed * 1103515245 + 12345;
+   if (pattern == PATTERN_EXTREMES) {
+      return (seed >> 30) & 1 ? 255 : 0;
+   }
+   if (pattern == PATTERN_SMOOTH) {
+      int v = 128 + (int)(80 * sin(x / 23.0) * cos(y / 17.0)) +
+              (int)(seed >> 29) - 4;
+
+      return v < 0 ? 0 : (v > 255 ? 255 : v);
+   }
+   return seed >> 24;
+}
+
+static int
+check_fdct(int pattern)
+{
+   static const int blocks = 10000;
+   uint8_t block[64];
+   int16_t out[64], ref[64];
+   int     n, k;
+
+   for (n = 0; n < blocks; n++) {
+      for (k = 0; k < 64; k++) {
+         block[k] = next_byte(pattern, n * 8 + (k & 7), k >> 3);
+      }
+      jpeg_fdct(block, out);
+      jpeg_fdct_ref(block, ref);
+      for (k = 0; k < 64; k++) {
+         if (abs(out[k] - ref[k]) > FDCT_TOLERANCE) {
+            fprintf(stderr, "FAIL fdct pattern:%d block %d: coefficient "
+                    "(%d,%d) is %d, expected %d\n", pattern, n, k >> 3,
+                    k & 7, out[k], ref[k]);
+            return 1;
+         }
+      }
+   }
+   return 0;
+}
+
+struct huff_decoder {
+   uint16_t firstCode[17];
+   uint8_t  count[17];
+   uint8_t  offset[17];
+   uint8_t  values[256];
+};
+
+struct decoder {
+   const uint8_t      *data;
+   size_t              size;
+   size_t              pos;
+   uint32_t            bits;
+   int                 numBits;
+   int                 width;
+   int                 height;
+   int                 orientation;    /* EXIF, 0 if there is none */
+   int                 jfif;
+   uint16_t            quant[4][64];   /* zigzag order */
+   int                 quantId[3];
+   struct huff_decoder huff[2][4];     /* [DC/AC][id] */
+   int                 dcId[3];
+   int                 acId[3];
+   int                 lastDc[3];
+   uint8_t            *planes[3];      /* Y, Cb, Cr */
+};
+
+static int
+read_word(const uint8_t *p)
+{
+   return p[0] << 8 | p[1];
+}
+
+/* Finds Orientation in a big endian EXIF APP1 body. */
+static void
+parse_exif(struct decoder *d, const uint8_t *p, int len)
+{
+   int ifd, entries, i;
+
+   if (len < 14 || memcmp(p, "Exif\0\0MM", 8) != 0) {
+      return;
+   }
+   p += 6;
+   len -= 6;
+   ifd = (int)(p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7]);
+   if (ifd + 2 > len) {
+      return;
+   }
+   entries = read_word(p + ifd);
+   for (i = 0; i < entries && ifd + 2 + (i + 1) * 12 <= len; i++) {
+      const uint8_t *e = p + ifd + 2 + i * 12;
+
+      if (read_word(e) == 0x0112 && read_word(e + 2) == 3) {
+         d->orientation = read_word(e + 8);
+      }
+   }
+}
+
+static int
+parse_huff(struct decoder *d, const uint8_t *p, int len)
+{
+   while (len >= 17) {
+      struct huff_decoder *h;
+      int                  total = 0, code = 0, l;
+
+      if ((p[0] >> 4) > 1 || (p[0] & 15) > 3) {
+         return -1;
+      }
+      h = &d->huff[p[0] >> 4][p[0] & 15];
+      for (l = 1; l <= 16; l++) {
+         h->count[l]     = p[l];
+         h->firstCode[l] = code;
+         h->offset[l]    = total;
+         total += p[l];
+         code   = (code + p[l]) << 1;
+      }
+      if (total > 256 || 17 + total > len) {
+         return -1;
+      }
+      memcpy(h->values, p + 17, total);
+      p   += 17 + total;
+      len -= 17 + total;
+   }
+   return len == 0 ? 0 : -1;
+}
+
+/* Next bit of entropy coded data; past the end, or at a marker, zeros. */
+static int
+get_bit(struct decoder *d)
+{
+   if (d->numBits == 0) {
+      int byte = 0;
+
+      if (d->pos < d->size && d->data[d->pos] != 0xff) {
+         byte = d->data[d->pos++];
+      } else if (d->pos + 1 < d->size && d->data[d->pos + 1] == 0) {
+         byte = 0xff;
+         d->pos += 2;
+      }
+      d->bits    = byte;
+      d->numBits = 8;
+   }
+   d->numBits--;
+   return (d->bits >> d->numBits) & 1;
+}
+
+static int
+get_bits(struct decoder *d, int n)
+{
+   int v = 0;
+
+   while (n-- > 0) {
+      v = (v << 1) | get_bit(d);
+   }
+   return v;
+}
+
+static int
+decode_huff(struct decoder *d, const struct huff_decoder *h)
+{
+   int code = 0, l;
+
+   for (l = 1; l <= 16; l++) {
+      code = (code << 1) | get_bit(d);
+      if (code - h->firstCode[l] < h->count[l]) {
+         return h->values[h->offset[l] + code - h->firstCode[l]];
+      }
+   }
+   return -1;
+}
+
+static int
+extend(int v, int bits)
+{
+   return bits == 0 ? 0 : (v < 1 << (bits - 1) ? v - (1 << bits) + 1 : v);
+}
+
+/* Straight from the definition of the inverse DCT in ITU T.81 A.3.3. */
+static void
+idct(const int *coef, uint8_t *out, int stride)
+{
+   static double table[8][8];
+   static int    ready;
+   int           x, y, u, v;
+
+   if (!ready) {
+      for (x = 0; x < 8; x++) {
+         for (u = 0; u < 8; u++) {
+            table[x][u] = (u == 0 ? sqrt(0.5) : 1.0) *
+                          cos((2 * x + 1) * u * M_PI / 16);
+         }
+      }
+      ready = 1;
+   }
+   for (y = 0; y < 8; y++) {
+      for (x = 0; x < 8; x++) {
+         double sum = 0;
+         int    s;
+
+         for (v = 0; v < 8; v++) {
+            for (u = 0; u < 8; u++) {
+               sum += table[y][v] * table[x][u] * coef[v * 8 + u];
+            }
+         }
+         s = (int)floor(sum / 4 + 128.5);
+         out[y * stride + x] = s < 0 ? 0 : (s > 255 ? 255 : s);
+      }
+   }
+}
+
+static int
+decode_block(struct decoder *d, int c, uint8_t *out, int stride)
+{
+   const struct huff_decoder *dc = &d->huff[0][d->dcId[c]];
+   const struct huff_decoder *ac = &d->huff[1][d->acId[c]];
+   const uint16_t            *q  = d->quant[d->quantId[c]];
+   int                        coef[64];
+   int                        s, k;
+
+   memset(coef, 0, sizeof(coef));
+   if ((s = decode_huff(d, dc)) < 0 || s > 11) {
+      return -1;
+   }
+   d->lastDc[c] += extend(get_bits(d, s), s);
+   coef[0] = d->lastDc[c] * q[0];
+   for (k = 1; k < 64; k++) {
+      int rs = decode_huff(d, ac);
+
+      if (rs < 0) {
+         return -1;
+      }
+      if ((rs & 15) == 0) {
+         if (rs != 0xf0) {
+            break;
+         }
+         k += 15;
+         continue;
+      }
+      k += rs >> 4;
+      if (k > 63) {
+         return -1;
+      }
+      coef[zigzag[k]] = extend(get_bits(d, rs & 15), rs & 15) * q[k];
+   }
+   idct(coef, out, stride);
+   return 0;
+}
+
+/* Entropy decodes into planes padded to whole MCUs. */
+static int
+decode_scan(struct decoder *d)
+{
+   int mcusX = (d->width + 15) / 16, mcusY = (d->height + 15) / 16;
+   int stride = mcusX * 16, x, y, i;
+
+   d->planes[0] = malloc(stride * mcusY * 16);
+   d->planes[1] = malloc(stride / 2 * mcusY * 8);
+   d->planes[2] = malloc(stride / 2 * mcusY * 8);
+   if (d->planes[0] == NULL || d->planes[1] == NULL || d->planes[2] == NULL) {
+      return -1;
+   }
+   for (y = 0; y < mcusY; y++) {
+      for (x = 0; x < mcusX; x++) {
+         for (i = 0; i < 4; i++) {
+            if (decode_block(d, 0, d->planes[0] +
+                             (y * 16 + (i >> 1) * 8) * stride +
+                             x * 16 + (i & 1) * 8, stride) < 0) {
+               return -1;
+            }
+         }
+         for (i = 1; i <= 2; i++) {
+            if (decode_block(d, i, d->planes[i] + y * 8 * stride / 2 + x * 8,
+                             stride / 2) < 0) {
+               return -1;
+            }
+         }
+      }
+   }
+   return 0;
+}
+
+static int
+decode(struct decoder *d, const uint8_t *data, size_t size)
+{
+   memset(d, 0, sizeof(*d));
+   d->data = data;
+   d->size = size;
+   if (size < 4 || read_word(data) != 0xffd8) {
+      return -1;
+   }
+   d->pos = 2;
+   while (d->pos + 4 <= size) {
+      int            marker = read_word(data + d->pos);
+      int            len    = read_word(data + d->pos + 2);
+      const uint8_t *p      = data + d->pos + 4;
+      int            i;
+
+      if ((marker & 0xff00) != 0xff00 || len < 2 || d->pos + 2 + len > size) {
+         return -1;
+      }
+      len -= 2;
+      d->pos += 4 + len;
+      switch (marker) {
+      case 0xffe0:
+         d->jfif = len >= 5 && memcmp(p, "JFIF", 5) == 0;
+         break;
+      case 0xffe1:
+         parse_exif(d, p, len);
+         break;
+      case 0xffdb:
+         for (; len >= 65; len -= 65, p += 65) {
+            if (p[0] > 3) {
+               return -1;
+            }
+            for (i = 0; i < 64; i++) {
+               d->quant[p[0]][i] = p[1 + i];
+            }
+         }
+         break;
+      case 0xffc0:
+         if (len != 15 || p[0] != 8 || p[5] != 3 || p[7] != 0x22 ||
+             p[10] != 0x11 || p[13] != 0x11) {
+            return -1;
+         }
+         d->height = read_word(p + 1);
+         d->width  = read_word(p + 3);
+         for (i = 0; i < 3; i++) {
+            d->quantId[i] = p[8 + i * 3] & 3;
+         }
+         break;
+      case 0xffc4:
+         if (parse_huff(d, p, len) < 0) {
+            return -1;
+         }
+         break;
+      case 0xffda:
+         if (len != 10 || p[0] != 3 || d->width == 0) {
+            return -1;
+         }
+         for (i = 0; i < 3; i++) {
+            d->dcId[i] = (p[2 + i * 2] >> 4) & 3;
+            d->acId[i] = p[2 + i * 2] & 3;
+         }
+         if (decode_scan(d) < 0) {
+            return -1;
+         }
+         /* Bits left in the last byte are padding; then comes EOI. */
+         d->numBits = 0;
+         return d->pos + 2 <= size && read_word(data + d->pos) == 0xffd9 ?
+                   0 : -1;
+      default:
+         /* Other APPn and COM. */
+         if (marker < 0xffe0) {
+            return -1;
+         }
+         break;
+      }
+   }
+   return -1;
+}
+
+static void
+decoder_free(struct decoder *d)
+{
+   free(d->planes[0]);
+   free(d->planes[1]);
+   free(d->planes[2]);
+}
+
+/* PSNR of a decoded plane against samples step bytes apart in src. */
+static double
+psnr(const uint8_t *plane, int planeStride, const uint8_t *src,
+     int srcStride, int step, int width, int height)
+{
+   double sum = 0;
+   int    x, y;
+
+   for (y = 0; y < height; y++) {
+      for (x = 0; x < width; x++) {
+         int diff = plane[y * planeStride + x] - src[y * srcStride + x * step];
+
+         sum += diff * diff;
+      }
+   }
+   if (sum == 0) {
+      return 99.0;
+   }
+   return 10 * log10(255.0 * 255.0 * width * height / sum);
+}
+
+static int
+check_encode(int width, int height, int quality, int pattern, double minPsnr)
+{
+   size_t         size = width * height * 3 / 2;
+   uint8_t       *src = malloc(size);
+   const uint8_t *chroma = src + width * height;
+   uint8_t       *jpeg = NULL;
+   size_t         jpegSize = 0;
+   struct decoder d;
+   int            stride = (width + 15) / 16 * 16;
+   double         y, cb, cr;
+   int            i, failed = 0;
+
+   if (src == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+   for (i = 0; i < (int)size; i++) {
+      int row = i < width * height ? i / width : (i - width * height) / width;
+
+      src[i] = next_byte(pattern, i % width, row);
+   }
+   if (jpeg_encode_nv21(src, width, height, quality, 0, &jpeg,
+                        &jpegSize) != 0) {
+      fprintf(stderr, "FAIL encode %dx%d q:%d pattern:%d\n", width, height,
+              quality, pattern);
+      free(src);
+      return 1;
+   }
+   if (decode(&d, jpeg, jpegSize) != 0 || d.width != width ||
+       d.height != height || !d.jfif) {
+      fprintf(stderr, "FAIL decode %dx%d q:%d pattern:%d\n", width, height,
+              quality, pattern);
+      failed = 1;
+   } else {
+      /* NV21 chroma is Cr, Cb pairs. */
+      y  = psnr(d.planes[0], stride, src, width, 1, width, height);
+      cb = psnr(d.planes[1], stride / 2, chroma + 1, width, 2, width / 2,
+                height / 2);
+      cr = psnr(d.planes[2], stride / 2, chroma, width, 2, width / 2,
+                height / 2);
+      if (y < minPsnr || cb < minPsnr || cr < minPsnr) {
+         fprintf(stderr, "FAIL %dx%d q:%d pattern:%d: PSNR Y %.1f Cb %.1f "
+                 "Cr %.1f dB, expected at least %.1f\n", width, height,
+                 quality, pattern, y, cb, cr, minPsnr);
+         failed = 1;
+      }
+   }
+   decoder_free(&d);
+   free(jpeg);
+   free(src);
+   return failed;
+}
+
+static int
+check_orientation(int rotation, int expected)
+{
+   static const int width = 32, height = 16;
+   uint8_t       *src = calloc(width * height * 3 / 2, 1);
+   uint8_t       *jpeg = NULL;
+   size_t         jpegSize = 0;
+   struct decoder d;
+   int            failed = 0;
+
+   if (src == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+   memset(&d, 0, sizeof(d));
+   if (jpeg_encode_nv21(src, width, height, 85, rotation, &jpeg,
+                        &jpegSize) != 0 ||
+       decode(&d, jpeg, jpegSize) != 0) {
+      fprintf(stderr, "FAIL rotation %d: no picture\n", rotation);
+      failed = 1;
+   } else if (d.orientation != expected || d.jfif != (expected == 0)) {
+      fprintf(stderr, "FAIL rotation %d: orientation %d jfif %d, "
+              "expected %d\n", rotation, d.orientation, d.jfif, expected);
+      failed = 1;
+   }
+   decoder_free(&d);
+   free(jpeg);
+   free(src);
+   return failed;
+}
+
+static double
+now_ms()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void
+benchmark(int width, int height, int quality)
+{
+   static const int iterations = 5;
+   uint8_t *src = malloc(width * height * 3 / 2);
+   uint8_t *jpeg;
+   size_t   jpegSize;
+   double   start;
+   int      i;
+
+   if (src == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+   for (i = 0; i < width * height * 3 / 2; i++) {
+      src[i] = next_byte(PATTERN_SMOOTH, i % width, i / width);
+   }
+   start = now_ms();
+   for (i = 0; i < iterations; i++) {
+      if (jpeg_encode_nv21(src, width, height, quality, 0, &jpeg,
+                           &jpegSize) == 0) {
+         free(jpeg);
+      }
+   }
+   printf("%4dx%-4d q%-3d jpeg_encode_nv21 %7.2f ms\n", width, height,
+          quality, (now_ms() - start) / iterations);
+   free(src);
+}
+
+int
+main()
+{
+   /* Whole and partial MCUs. */
+   static const int sizes[][2] = {
+      { 2, 2 }, { 16, 16 }, { 18, 34 }, { 64, 48 }, { 176, 144 }, { 322, 242 }
+   };
+   static const int rotations[][2] = {
+      { 0, 0 }, { 90, 6 }, { 180, 3 }, { 270, 8 }, { 45, 0 }
+   };
+   /* The ImageEncoding levels in configs/media_profiles.xml. */
+   static const int qualities[] = { 95, 80, 70 };
+   unsigned int s, q;
+   int          pattern, failures = 0, checks = 0;
+
+   for (pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+      failures += check_fdct(pattern);
+      checks++;
+   }
+   for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      /* Smooth content at a typical quality, and noise at 100, which
+       * makes the largest MCUs. */
+      failures += check_encode(sizes[s][0], sizes[s][1], 85, PATTERN_SMOOTH,
+                               38.0);
+      failures += check_encode(sizes[s][0], sizes[s][1], 100,
+                               PATTERN_RANDOM, 50.0);
+      failures += check_encode(sizes[s][0], sizes[s][1], 100,
+                               PATTERN_EXTREMES, 50.0);
+      checks += 3;
+   }
+   for (s = 0; s < sizeof(rotations) / sizeof(rotations[0]); s++) {
+      failures += check_orientation(rotations[s][0], rotations[s][1]);
+      checks++;
+   }
+   printf("jpegEncode: %d of %d checks passed\n", checks - failures, checks);
+
+   for (q = 0; q < sizeof(qualities) / sizeof(qualities[0]); q++) {
+      benchmark(640, 480, qualities[q]);
+      benchmark(2048, 1536, qualities[q]);
+   }
+   return failures != 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks that luma_stats_compute, NEON on ARM, gives exactly what
+ * luma_stats_compute_ref gives, then reports the speed of both for the
+ * preview sizes the HAL advertises.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lumaStats.h"
+
+enum {
+   PATTERN_RANDOM,
+   PATTERN_EXTREMES,    /* 0 and 255 only, for the largest gradients */
+   PATTERN_RAMP,        /* walks every histogram bin */
+   PATTERN_COUNT
+};
+
+static uint32_t seed = 1;
+
+static uint8_t
+next_byte(int pattern, int i)
+{
+   seed = seed * 1103515245 + 12345;
+   if (pattern == PATTERN_EXTREMES) {
+      return (seed >> 30) & 1 ? 255 : 0;
+   }
+   if (pattern == PATTERN_RAMP) {
+      return i * 3;
+   }
+   return seed >> 24;
+}
+
+static int
+check(int width, int height, int pattern)
+{
+   uint8_t          *luma = malloc(width * height);
+   struct luma_stats out, ref;
+   uint32_t          total = 0;
+   int               i, failed = 0;
+
+   if (luma == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+   for (i = 0; i < width * height; i++) {
+      luma[i] = next_byte(pattern, i);
+   }
+   memset(&out, 0x5a, sizeof(out));
+   memset(&ref, 0xa5, sizeof(ref));
+   luma_stats_compute(luma, width, height, &out);
+   luma_stats_compute_ref(luma, width, height, &ref);
+
+   for (i = 0; i < LUMA_HIST_BINS; i++) {
+      total += ref.histogram[i];
+      if (out.histogram[i] != ref.histogram[i]) {
+         fprintf(stderr, "FAIL %dx%d pattern:%d: bin %d is %u, expected "
+                 "%u\n", width, height, pattern, i, out.histogram[i],
+                 ref.histogram[i]);
+         failed = 1;
+         break;
+      }
+   }
+   if (!failed && (out.samples != ref.samples || out.mean != ref.mean ||
+                   out.focus != ref.focus)) {
+      fprintf(stderr, "FAIL %dx%d pattern:%d: samples %u mean %u focus %u, "
+              "expected %u %u %u\n", width, height, pattern, out.samples,
+              out.mean, out.focus, ref.samples, ref.mean, ref.focus);
+      failed = 1;
+   }
+   if (!failed && total != ref.samples) {
+      fprintf(stderr, "FAIL %dx%d pattern:%d: histogram holds %u of %u "
+              "samples\n", width, height, pattern, total, ref.samples);
+      failed = 1;
+   }
+   free(luma);
+   return failed;
+}
+
+static double
+now_ms()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void
+benchmark(int width, int height)
+{
+   static const int  iterations = 50;
+   uint8_t          *luma = malloc(width * height);
+   struct luma_stats stats;
+   double            start, neon, ref;
+   int               i;
+
+   if (luma == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+   for (i = 0; i < width * height; i++) {
+      luma[i] = next_byte(PATTERN_RANDOM, i);
+   }
+   start = now_ms();
+   for (i = 0; i < iterations; i++) {
+      luma_stats_compute(luma, width, height, &stats);
+   }
+   neon = (now_ms() - start) / iterations;
+   start = now_ms();
+   for (i = 0; i < iterations; i++) {
+      luma_stats_compute_ref(luma, width, height, &stats);
+   }
+   ref = (now_ms() - start) / iterations;
+   printf("%4dx%-4d luma_stats_compute %6.3f ms, ref %6.3f ms\n", width,
+          height, neon, ref);
+   free(luma);
+}
+
+int
+main()
+{
+   /* The NEON loop takes 64 pixels and needs 4 more for the right
+    * neighbours, so widths around 68 and its multiples matter. */
+   static const int sizes[][2] = {
+      { 1, 1 }, { 4, 4 }, { 5, 5 }, { 63, 3 }, { 67, 4 }, { 68, 5 },
+      { 69, 8 }, { 131, 9 }, { 132, 4 }, { 133, 13 }, { 176, 144 },
+      { 641, 17 }
+   };
+   /* The preview sizes from CameraHAL_FixupParams. */
+   static const int previewSizes[][2] = {
+      { 640, 480 }, { 576, 432 }, { 480, 320 }, { 384, 288 },
+      { 352, 288 }, { 320, 240 }, { 240, 160 }, { 176, 144 }
+   };
+   unsigned int s;
+   int          pattern, failures = 0, checks = 0;
+
+   for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      for (pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+         failures += check(sizes[s][0], sizes[s][1], pattern);
+         checks++;
+      }
+   }
+   printf("lumaStats: %d of %d frames match the reference\n",
+          checks - failures, checks);
+
+   for (s = 0; s < sizeof(previewSizes) / sizeof(previewSizes[0]); s++) {
+      benchmark(previewSizes[s][0], previewSizes[s][1]);
+   }
+   return failures != 0;
+}
@@ -0,0 +1,745 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "MockCameraHardware"
+
+/* Linked into one executable with the wrapper, so it leaves out the blob
+ * symbols CameraParameters.h defines just as the wrapper does. */
+#define THE_WRAPPER
+
+#include <string.h>
+#include <unistd.h>
+#include <CameraHardwareInterface.h>
+#include <binder/MemoryBase.h>
+#include <binder/MemoryHeapBase.h>
+#include <camera/Camera.h>
+#include <cutils/log.h>
+#include <utils/threads.h>
+#include "mockCameraHardware.h"
+
+#define MOCK_MAX_BUFFERS 8
+
+/* Size of the picture handed back for takePicture. */
+#define MOCK_JPEG_SIZE   4096
+
+namespace android {
+
+static Mutex                     gStatsLock;
+static Condition                 gStatsCond;
+static struct mock_camera_stats  gStats;
+static struct mock_camera_config gConfig = { 30, 4, 4 };
+
+/* Allocations made on the frame thread while the wrapper handles a frame. */
+static __thread bool         tCounting;
+static __thread unsigned int tAllocations;
+
+}; // namespace android
+
+/* Every allocation the wrapper makes, operator new included, comes through
+ * one of these. glibc's own entry points do the work. */
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+extern "C" void *
+malloc(size_t size)
+{
+   if (android::tCounting) {
+      android::tAllocations++;
+   }
+   return __libc_malloc(size);
+}
+
+extern "C" void *
+calloc(size_t count, size_t size)
+{
+   if (android::tCounting) {
+      android::tAllocations++;
+   }
+   return __libc_calloc(count, size);
+}
+
+extern "C" void *
+realloc(void *ptr, size_t size)
+{
+   if (android::tCounting) {
+      android::tAllocations++;
+   }
+   return __libc_realloc(ptr, size);
+}
+
+namespace android {
+
+class MockCameraHardware : public CameraHardwareInterface {
+public:
+   MockCameraHardware();
+   virtual ~MockCameraHardware();
+
+   virtual sp<IMemoryHeap> getPreviewHeap() const;
+   virtual sp<IMemoryHeap> getRawHeap() const;
+   virtual void setCallbacks(notify_callback notify_cb, data_callback data_cb,
+                             data_callback_timestamp data_cb_timestamp,
+                             void *user);
+   virtual void enableMsgType(int32_t msgType);
+   virtual void disableMsgType(int32_t msgType);
+   virtual bool msgTypeEnabled(int32_t msgType);
+   virtual status_t startPreview();
+   virtual status_t getBufferInfo(sp<IMemory> &Frame, size_t *alignedSize);
+   virtual void stopPreview();
+   virtual bool previewEnabled();
+   virtual status_t startRecording();
+   virtual void stopRecording();
+   virtual bool recordingEnabled();
+   virtual void releaseRecordingFrame(const sp<IMemory> &mem);
+   virtual status_t autoFocus();
+   virtual status_t cancelAutoFocus();
+   virtual status_t takePicture();
+   virtual status_t cancelPicture();
+   virtual status_t setParameters(const CameraParameters &params);
+   virtual CameraParameters getParameters() const;
+   virtual status_t sendCommand(int32_t cmd, int32_t arg1, int32_t arg2);
+   virtual void release();
+   virtual status_t dump(int fd, const Vector<String16> &args) const;
+
+private:
+   class FrameThread : public Thread {
+   public:
+      FrameThread(MockCameraHardware *hw) : Thread(false), mHw(hw) { }
+   private:
+      MockCameraHardware *mHw;
+      virtual bool threadLoop() { return mHw->deliverFrame(); }
+   };
+
+   bool deliverFrame();
+   void stopThread();
+   bool allocFrames(sp<MemoryHeapBase> *heap, sp<MemoryBase> *frames,
+                    int count, int width, int height);
+
+   mutable Mutex           mLock;
+   Condition               mCond;
+   struct mock_camera_config mConfig;
+   CameraParameters        mParameters;
+   notify_callback         mNotifyCb;
+   data_callback           mDataCb;
+   data_callback_timestamp mDataCbTimestamp;
+   void                   *mUser;
+   int32_t                 mMsgEnabled;
+   bool                    mPreviewing;
+   bool                    mRecording;
+   bool                    mDelivering;
+   bool                    mExiting;
+   bool                    mFocusPending;
+   int                     mPicturesPending;
+   unsigned int            mFrameNumber;
+   nsecs_t                 mNextFrame;
+   int                     mPreviewWidth;
+   int                     mPreviewHeight;
+   int                     mVideoWidth;
+   int                     mVideoHeight;
+   sp<MemoryHeapBase>      mPreviewHeap;
+   sp<MemoryBase>          mPreviewFrames[MOCK_MAX_BUFFERS];
+   sp<MemoryHeapBase>      mRecordingHeap;
+   sp<MemoryBase>          mRecordingFrames[MOCK_MAX_BUFFERS];
+   bool                    mRecordingHeld[MOCK_MAX_BUFFERS];
+   sp<MemoryHeapBase>      mJpegHeap;
+   sp<MemoryBase>          mJpeg;
+   sp<Thread>              mThread;
+};
+
+MockCameraHardware::MockCameraHardware()
+   : mNotifyCb(NULL), mDataCb(NULL), mDataCbTimestamp(NULL), mUser(NULL),
+     mMsgEnabled(0), mPreviewing(false), mRecording(false),
+     mDelivering(false), mExiting(false), mFocusPending(false),
+     mPicturesPending(0), mFrameNumber(0), mNextFrame(0),
+     mPreviewWidth(0), mPreviewHeight(0), mVideoWidth(0), mVideoHeight(0)
+{
+   {
+      Mutex::Autolock lock(gStatsLock);
+      mConfig = gConfig;
+   }
+   if (mConfig.previewBuffers > MOCK_MAX_BUFFERS) {
+      mConfig.previewBuffers = MOCK_MAX_BUFFERS;
+   }
+   if (mConfig.recordingBuffers > MOCK_MAX_BUFFERS) {
+      mConfig.recordingBuffers = MOCK_MAX_BUFFERS;
+   }
+   memset(mRecordingHeld, 0, sizeof(mRecordingHeld));
+
+   mParameters.set(CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES,
+                   "640x480,480x320,352x288,320x240,176x144");
+   mParameters.setPreviewSize(640, 480);
+   mParameters.set(CameraParameters::KEY_PREVIEW_FORMAT,
+                   CameraParameters::PIXEL_FORMAT_YUV420SP);
+   mParameters.set(CameraParameters::KEY_PREVIEW_FRAME_RATE, 30);
+   mParameters.set(CameraParameters::KEY_SUPPORTED_PICTURE_SIZES,
+                   "2048x1536,1600x1200,1024x768,640x480");
+   mParameters.setPictureSize(2048, 1536);
+   mParameters.set(CameraParameters::KEY_PICTURE_FORMAT,
+                   CameraParameters::PIXEL_FORMAT_JPEG);
+   mParameters.set(CameraParameters::KEY_JPEG_QUALITY, 85);
+   mParameters.setVideoSize(640, 480);
+   mParameters.set(CameraParameters::KEY_HORIZONTAL_VIEW_ANGLE, "54.8");
+   mParameters.set(CameraParameters::KEY_VERTICAL_VIEW_ANGLE, "42.5");
+
+   mJpegHeap = new MemoryHeapBase(MOCK_JPEG_SIZE);
+   mJpeg     = new MemoryBase(mJpegHeap, 0, MOCK_JPEG_SIZE);
+   memset(mJpegHeap->base(), 0, MOCK_JPEG_SIZE);
+   ((uint8_t *)mJpegHeap->base())[0] = 0xff;
+   ((uint8_t *)mJpegHeap->base())[1] = 0xd8;
+   ((uint8_t *)mJpegHeap->base())[MOCK_JPEG_SIZE - 2] = 0xff;
+   ((uint8_t *)mJpegHeap->base())[MOCK_JPEG_SIZE - 1] = 0xd9;
+}
+
+MockCameraHardware::~MockCameraHardware()
+{
+   stopThread();
+}
+
+sp<IMemoryHeap>
+MockCameraHardware::getPreviewHeap() const
+{
+   Mutex::Autolock lock(mLock);
+
+   return mPreviewHeap;
+}
+
+sp<IMemoryHeap>
+MockCameraHardware::getRawHeap() const
+{
+   return NULL;
+}
+
+void
+MockCameraHardware::setCallbacks(notify_callback notify_cb,
+                                 data_callback data_cb,
+                                 data_callback_timestamp data_cb_timestamp,
+                                 void *user)
+{
+   Mutex::Autolock lock(mLock);
+
+   mNotifyCb        = notify_cb;
+   mDataCb          = data_cb;
+   mDataCbTimestamp = data_cb_timestamp;
+   mUser            = user;
+}
+
+void
+MockCameraHardware::enableMsgType(int32_t msgType)
+{
+   Mutex::Autolock lock(mLock);
+
+   mMsgEnabled |= msgType;
+}
+
+void
+MockCameraHardware::disableMsgType(int32_t msgType)
+{
+   Mutex::Autolock lock(mLock);
+
+   mMsgEnabled &= ~msgType;
+}
+
+bool
+MockCameraHardware::msgTypeEnabled(int32_t msgType)
+{
+   Mutex::Autolock lock(mLock);
+
+   return (mMsgEnabled & msgType) != 0;
+}
+
+bool
+MockCameraHardware::allocFrames(sp<MemoryHeapBase> *heap,
+                                sp<MemoryBase> *frames, int count,
+                                int width, int height)
+{
+   size_t size = width * height * 3 / 2;
+
+   *heap = new MemoryHeapBase(size * count);
+   if ((*heap)->getHeapID() < 0) {
+      heap->clear();
+      return false;
+   }
+   for (int i = 0; i < count; i++) {
+      frames[i] = new MemoryBase(*heap, i * size, size);
+   }
+   return true;
+}
+
+status_t
+MockCameraHardware::startPreview()
+{
+   Mutex::Autolock lock(mLock);
+
+   if (mPreviewing) {
+      return NO_ERROR;
+   }
+   mParameters.getPreviewSize(&mPreviewWidth, &mPreviewHeight);
+   if (mPreviewHeap == NULL || mPreviewHeap->getSize() <
+          (size_t)mPreviewWidth * mPreviewHeight * 3 / 2 *
+          mConfig.previewBuffers) {
+      if (!allocFrames(&mPreviewHeap, mPreviewFrames, mConfig.previewBuffers,
+                       mPreviewWidth, mPreviewHeight)) {
+         return NO_MEMORY;
+      }
+   } else {
+      /* A smaller size reuses the heap, as the vendor's pmem pool does. */
+      size_t size = mPreviewWidth * mPreviewHeight * 3 / 2;
+      for (int i = 0; i < mConfig.previewBuffers; i++) {
+         mPreviewFrames[i] = new MemoryBase(mPreviewHeap, i * size, size);
+      }
+   }
+   if (mThread == NULL) {
+      mExiting = false;
+      mThread  = new FrameThread(this);
+      if (mThread->run("MockCameraFrames") != NO_ERROR) {
+         mThread.clear();
+         return UNKNOWN_ERROR;
+      }
+   }
+   mPreviewing = true;
+   mNextFrame  = 0;
+   mCond.broadcast();
+   return NO_ERROR;
+}
+
+status_t
+MockCameraHardware::getBufferInfo(sp<IMemory> &Frame, size_t *alignedSize)
+{
+   return INVALID_OPERATION;
+}
+
+void
+MockCameraHardware::stopPreview()
+{
+   Mutex::Autolock lock(mLock);
+
+   mPreviewing = false;
+   mRecording  = false;
+   /* Like the vendor library, no callback is made once this returns. */
+   while (mDelivering) {
+      mCond.wait(mLock);
+   }
+}
+
+bool
+MockCameraHardware::previewEnabled()
+{
+   Mutex::Autolock lock(mLock);
+
+   return mPreviewing;
+}
+
+status_t
+MockCameraHardware::startRecording()
+{
+   Mutex::Autolock lock(mLock);
+
+   if (!mPreviewing) {
+      return INVALID_OPERATION;
+   }
+   mParameters.getVideoSize(&mVideoWidth, &mVideoHeight);
+   if (mVideoWidth <= 0 || mVideoHeight <= 0) {
+      mVideoWidth  = mPreviewWidth;
+      mVideoHeight = mPreviewHeight;
+   }
+   for (int i = 0; i < mConfig.recordingBuffers; i++) {
+      if (mRecordingHeld[i]) {
+         LOGE("startRecording: frame %d is still held\n", i);
+      }
+   }
+   if (!allocFrames(&mRecordingHeap, mRecordingFrames,
+                    mConfig.recordingBuffers, mVideoWidth, mVideoHeight)) {
+      return NO_MEMORY;
+   }
+   memset(mRecordingHeld, 0, sizeof(mRecordingHeld));
+   mRecording = true;
+   return NO_ERROR;
+}
+
+void
+MockCameraHardware::stopRecording()
+{
+   Mutex::Autolock lock(mLock);
+
+   mRecording = false;
+   while (mDelivering) {
+      mCond.wait(mLock);
+   }
+}
+
+bool
+MockCameraHardware::recordingEnabled()
+{
+   Mutex::Autolock lock(mLock);
+
+   return mRecording;
+}
+
+void
+MockCameraHardware::releaseRecordingFrame(const sp<IMemory> &mem)
+{
+   Mutex::Autolock lock(mLock);
+   Mutex::Autolock statsLock(gStatsLock);
+
+   for (int i = 0; i < mConfig.recordingBuffers; i++) {
+      if (mRecordingFrames[i] != NULL && mRecordingFrames[i].get() == mem.get()) {
+         if (mRecordingHeld[i]) {
+            mRecordingHeld[i] = false;
+            gStats.recordingHeld--;
+            gStats.recordingReleased++;
+         } else {
+            LOGE("releaseRecordingFrame: frame %d was not held\n", i);
+            gStats.badReleases++;
+         }
+         return;
+      }
+   }
+   LOGE("releaseRecordingFrame: unknown frame %p\n", mem.get());
+   gStats.badReleases++;
+}
+
+status_t
+MockCameraHardware::autoFocus()
+{
+   Mutex::Autolock lock(mLock);
+
+   mFocusPending = true;
+   mCond.broadcast();
+   return NO_ERROR;
+}
+
+status_t
+MockCameraHardware::cancelAutoFocus()
+{
+   Mutex::Autolock lock(mLock);
+
+   mFocusPending = false;
+   return NO_ERROR;
+}
+
+status_t
+MockCameraHardware::takePicture()
+{
+   Mutex::Autolock lock(mLock);
+
+   if (mThread == NULL) {
+      return INVALID_OPERATION;
+   }
+   /* The vendor library stops the preview to take a picture. */
+   mPreviewing = false;
+   mPicturesPending++;
+   mCond.broadcast();
+   Mutex::Autolock statsLock(gStatsLock);
+   gStats.pictures++;
+   return NO_ERROR;
+}
+
+status_t
+MockCameraHardware::cancelPicture()
+{
+   Mutex::Autolock lock(mLock);
+
+   mPicturesPending = 0;
+   return NO_ERROR;
+}
+
+status_t
+MockCameraHardware::setParameters(const CameraParameters &params)
+{
+   Mutex::Autolock lock(mLock);
+   int width, height;
+
+   params.getPreviewSize(&width, &height);
+   if (width <= 0 || height <= 0 || (width | height) & 1) {
+      LOGE("setParameters: bad preview size %dx%d\n", width, height);
+      return BAD_VALUE;
+   }
+   mParameters = params;
+   return NO_ERROR;
+}
+
+CameraParameters
+MockCameraHardware::getParameters() const
+{
+   Mutex::Autolock lock(mLock);
+
+   return mParameters;
+}
+
+status_t
+MockCameraHardware::sendCommand(int32_t cmd, int32_t arg1, int32_t arg2)
+{
+   return NO_ERROR;
+}
+
+void
+MockCameraHardware::stopThread()
+{
+   sp<Thread> thread;
+
+   {
+      Mutex::Autolock lock(mLock);
+      mExiting = true;
+      mCond.broadcast();
+      thread = mThread;
+      mThread.clear();
+   }
+   if (thread != NULL) {
+      thread->requestExitAndWait();
+   }
+}
+
+void
+MockCameraHardware::release()
+{
+   stopThread();
+   Mutex::Autolock lock(mLock);
+   mPreviewing = false;
+   mRecording  = false;
+}
+
+status_t
+MockCameraHardware::dump(int fd, const Vector<String16> &args) const
+{
+   String8 result;
+
+   result.appendFormat("MockCameraHardware: %dx%d preview, %dx%d video\n",
+                       mPreviewWidth, mPreviewHeight, mVideoWidth,
+                       mVideoHeight);
+   write(fd, result.string(), result.size());
+   return NO_ERROR;
+}
+
+/*
+ * One round of the frame thread: a preview frame and, while recording, a
+ * recording frame, then any picture or focus result. The callbacks are made
+ * without mLock, since the wrapper calls back in from them.
+ */
+bool
+MockCameraHardware::deliverFrame()
+{
+   sp<MemoryBase>          preview, recording, jpeg;
+   notify_callback         notifyCb;
+   data_callback           dataCb;
+   data_callback_timestamp dataCbTimestamp;
+   void                   *user;
+   bool                    shutter = false, focus = false;
+   nsecs_t                 interval = 0;
+
+   {
+      Mutex::Autolock lock(mLock);
+
+      while (!mExiting && !mPreviewing && mPicturesPending == 0 &&
+             !mFocusPending) {
+         mCond.wait(mLock);
+      }
+      if (mExiting) {
+         return false;
+      }
+
+      if (mPreviewing && (mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME)) {
+         preview = mPreviewFrames[mFrameNumber % mConfig.previewBuffers];
+         MockCamera_FillFrame((uint8_t *)preview->pointer(), mPreviewWidth,
+                              mPreviewHeight, mFrameNumber);
+      }
+      if (mRecording && (mMsgEnabled & CAMERA_MSG_VIDEO_FRAME)) {
+         Mutex::Autolock statsLock(gStatsLock);
+         for (int i = 0; i < mConfig.recordingBuffers; i++) {
+            int slot = (mFrameNumber + i) % mConfig.recordingBuffers;
+            if (!mRecordingHeld[slot]) {
+               recording            = mRecordingFrames[slot];
+               mRecordingHeld[slot] = true;
+               break;
+            }
+         }
+         if (recording != NULL) {
+            MockCamera_FillFrame((uint8_t *)recording->pointer(), mVideoWidth,
+                                 mVideoHeight, mFrameNumber);
+            gStats.recordingHeld++;
+            gStats.recordingFrames++;
+         } else {
+            gStats.recordingDropped++;
+         }
+      }
+      if (mPicturesPending > 0) {
+         mPicturesPending--;
+         shutter = (mMsgEnabled & CAMERA_MSG_SHUTTER) != 0;
+         if (mMsgEnabled & CAMERA_MSG_COMPRESSED_IMAGE) {
+            jpeg = mJpeg;
+         }
+      }
+      if (mFocusPending) {
+         mFocusPending = false;
+         focus = (mMsgEnabled & CAMERA_MSG_FOCUS) != 0;
+      }
+      if (mPreviewing && mConfig.fps > 0) {
+         interval = 1000000000LL / mConfig.fps;
+      }
+      notifyCb        = mNotifyCb;
+      dataCb          = mDataCb;
+      dataCbTimestamp = mDataCbTimestamp;
+      user            = mUser;
+      mFrameNumber++;
+      mDelivering = true;
+   }
+
+   nsecs_t timestamp = systemTime();
+
+   if (focus && notifyCb != NULL) {
+      notifyCb(CAMERA_MSG_FOCUS, 1, 0, user);
+   }
+   if (shutter && notifyCb != NULL) {
+      notifyCb(CAMERA_MSG_SHUTTER, 0, 0, user);
+   }
+   if (jpeg != NULL && dataCb != NULL) {
+      dataCb(CAMERA_MSG_COMPRESSED_IMAGE, jpeg, user);
+   }
+   if (preview != NULL && dataCb != NULL) {
+      nsecs_t start = systemTime();
+      tAllocations = 0;
+      tCounting    = true;
+      dataCb(CAMERA_MSG_PREVIEW_FRAME, preview, user);
+      tCounting    = false;
+      nsecs_t elapsed = systemTime() - start;
+
+      Mutex::Autolock statsLock(gStatsLock);
+      gStats.previewFrames++;
+      frame_stats_record(&gStats.previewCallbackTimes, elapsed);
+      gStats.previewAllocations  += tAllocations;
+      gStatsCond.broadcast();
+   }
+   if (recording != NULL && dataCbTimestamp != NULL) {
+      tAllocations = 0;
+      tCounting    = true;
+      dataCbTimestamp(timestamp, CAMERA_MSG_VIDEO_FRAME, recording, user);
+      tCounting    = false;
+
+      Mutex::Autolock statsLock(gStatsLock);
+      gStats.recordingAllocations += tAllocations;
+   }
+
+   Mutex::Autolock lock(mLock);
+   mDelivering = false;
+   mCond.broadcast();
+   if (interval > 0) {
+      /* Keeps to the sensor's clock, however long the callbacks took. */
+      nsecs_t now = systemTime();
+      if (mNextFrame == 0 || now - mNextFrame > interval) {
+         mNextFrame = now;
+      }
+      mNextFrame += interval;
+      mCond.waitRelative(mLock, mNextFrame - now);
+   }
+   return true;
+}
+
+}; // namespace android
+
+using namespace android;
+
+void
+MockCamera_Configure(const struct mock_camera_config *config)
+{
+   Mutex::Autolock lock(gStatsLock);
+
+   gConfig = *config;
+}
+
+void
+MockCamera_GetStats(struct mock_camera_stats *stats)
+{
+   Mutex::Autolock lock(gStatsLock);
+
+   *stats = gStats;
+}
+
+void
+MockCamera_ResetStats(void)
+{
+   Mutex::Autolock lock(gStatsLock);
+   unsigned int    held = gStats.recordingHeld;
+
+   memset(&gStats, 0, sizeof(gStats));
+   gStats.recordingHeld = held;
+}
+
+bool
+MockCamera_CountAllocations(bool counting)
+{
+   bool previous = tCounting;
+
+   tCounting = counting;
+   return previous;
+}
+
+bool
+MockCamera_WaitPreviewFrames(unsigned int count, int64_t timeout)
+{
+   Mutex::Autolock lock(gStatsLock);
+   nsecs_t         deadline = systemTime() + timeout;
+
+   while (gStats.previewFrames < count) {
+      nsecs_t now = systemTime();
+      if (now >= deadline) {
+         return false;
+      }
+      gStatsCond.waitRelative(gStatsLock, deadline - now);
+   }
+   return true;
+}
+
+void
+MockCamera_FillFrame(uint8_t *frame, int width, int height, unsigned int n)
+{
+   uint8_t *chroma = frame + width * height;
+
+   for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+         frame[y * width + x] = (x + 3 * y + n) & 0xff;
+      }
+   }
+   for (int y = 0; y < height / 2; y++) {
+      for (int x = 0; x < width / 2; x++) {
+         chroma[y * width + 2 * x]     = (0x80 + x - y) & 0xff;   /* Cr */
+         chroma[y * width + 2 * x + 1] = (0x80 + y - x) & 0xff;   /* Cb */
+      }
+   }
+}
+
+/* The vendor library's entry points, found with dlsym. The wrapper passes
+ * HAL_openCameraHardware a second argument, the QCOM mode, which this one
+ * has no use for. */
+
+extern "C" int
+HAL_getNumberOfCameras()
+{
+   return 1;
+}
+
+extern "C" void
+HAL_getCameraInfo(int cameraId, struct CameraInfo *cameraInfo)
+{
+   cameraInfo->facing      = CAMERA_FACING_BACK;
+   cameraInfo->orientation = 90;
+}
+
+extern "C" sp<CameraHardwareInterface>
+HAL_openCameraHardware(int cameraId)
+{
+   LOGD("HAL_openCameraHardware: camera %d\n", cameraId);
+   return new MockCameraHardware();
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A vendor camera library for the host test harness. It exports the
+ * HAL_openCameraHardware family the wrapper looks up, and its camera
+ * delivers synthetic NV21 preview and recording frames from a thread of
+ * its own, out of MemoryHeapBase heaps, like the QCOM library does.
+ */
+
+#ifndef CAMERA_HAL_MOCK_CAMERA_HARDWARE_H
+#define CAMERA_HAL_MOCK_CAMERA_HARDWARE_H
+
+#include <stdint.h>
+#include "frameStats.h"
+
+struct mock_camera_config {
+   int fps;                 /* frame rate, 0 for back to back */
+   int previewBuffers;      /* frames in the preview heap */
+   int recordingBuffers;    /* frames in the recording heap */
+};
+
+struct mock_camera_stats {
+   unsigned int previewFrames;     /* preview frames delivered */
+   unsigned int recordingFrames;   /* recording frames delivered */
+   unsigned int recordingDropped;  /* not delivered, all were held */
+   unsigned int recordingHeld;     /* delivered and not yet released */
+   unsigned int recordingReleased; /* released back */
+   unsigned int badReleases;       /* releases of frames not held */
+   unsigned int pictures;          /* takePicture calls */
+   unsigned int previewAllocations;  /* mallocs made in preview callbacks */
+   unsigned int recordingAllocations; /* and in recording callbacks */
+   struct frame_stage_stats previewCallbackTimes; /* each, recent ones */
+};
+
+/* Applies to cameras opened afterwards. */
+void MockCamera_Configure(const struct mock_camera_config *config);
+
+void MockCamera_GetStats(struct mock_camera_stats *stats);
+void MockCamera_ResetStats(void);
+
+/* Stops or resumes counting allocations on this thread, for the client's
+ * callbacks that the wrapper makes from within the vendor's. Returns the
+ * previous setting. */
+bool MockCamera_CountAllocations(bool counting);
+
+/* Waits until at least count preview frames were delivered since the last
+ * reset. Returns false on timeout. */
+bool MockCamera_WaitPreviewFrames(unsigned int count, int64_t timeout);
+
+/*
+ * Fills frame n of a width x height NV21 stream. Luma is
+ * (x + 3 * y + n) & 0xff, so that a frame that was rotated or flipped on
+ * its way can be told apart from one that was not.
+ */
+void MockCamera_FillFrame(uint8_t *frame, int width, int height,
+                          unsigned int n);
+
+#endif
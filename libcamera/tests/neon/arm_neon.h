@@ -0,0 +1,454 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A scalar model of the NEON intrinsics used by libcamera, so that host
+ * builds of the tests run the NEON code paths. Each one follows the lane
+ * by lane description in the ARM reference; none of it is meant to be
+ * fast.
+ */
+
+#ifndef CAMERA_HAL_TEST_ARM_NEON_H
+#define CAMERA_HAL_TEST_ARM_NEON_H
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct { uint8_t  v[8]; } uint8x8_t;
+typedef struct { uint8_t  v[16]; } uint8x16_t;
+typedef struct { uint16_t v[8]; } uint16x8_t;
+typedef struct { uint32_t v[4]; } uint32x4_t;
+typedef struct { int16_t  v[4]; } int16x4_t;
+typedef struct { int16_t  v[8]; } int16x8_t;
+typedef struct { int32_t  v[2]; } int32x2_t;
+typedef struct { int32_t  v[4]; } int32x4_t;
+
+typedef struct { uint8x8_t val[2]; } uint8x8x2_t;
+typedef struct { uint8x8_t val[4]; } uint8x8x4_t;
+typedef struct { uint8x16_t val[4]; } uint8x16x4_t;
+typedef struct { int16x8_t val[2]; } int16x8x2_t;
+typedef struct { int32x4_t val[2]; } int32x4x2_t;
+
+static inline uint8x8_t
+vdup_n_u8(uint8_t x)
+{
+   uint8x8_t r;
+   int       i;
+
+   for (i = 0; i < 8; i++) {
+      r.v[i] = x;
+   }
+   return r;
+}
+
+static inline uint32x4_t
+vdupq_n_u32(uint32_t x)
+{
+   uint32x4_t r;
+   int        i;
+
+   for (i = 0; i < 4; i++) {
+      r.v[i] = x;
+   }
+   return r;
+}
+
+static inline int16x8_t
+vdupq_n_s16(int16_t x)
+{
+   int16x8_t r;
+   int       i;
+
+   for (i = 0; i < 8; i++) {
+      r.v[i] = x;
+   }
+   return r;
+}
+
+static inline int32x4_t
+vdupq_n_s32(int32_t x)
+{
+   int32x4_t r;
+   int       i;
+
+   for (i = 0; i < 4; i++) {
+      r.v[i] = x;
+   }
+   return r;
+}
+
+static inline uint8x8_t
+vld1_u8(const uint8_t *p)
+{
+   uint8x8_t r;
+
+   memcpy(r.v, p, 8);
+   return r;
+}
+
+static inline void
+vst1q_u8(uint8_t *p, uint8x16_t a)
+{
+   memcpy(p, a.v, sizeof(a.v));
+}
+
+/* Element k of every group of four goes to val[k]. */
+static inline uint8x16x4_t
+vld4q_u8(const uint8_t *p)
+{
+   uint8x16x4_t r;
+   int          i, k;
+
+   for (i = 0; i < 16; i++) {
+      for (k = 0; k < 4; k++) {
+         r.val[k].v[i] = p[4 * i + k];
+      }
+   }
+   return r;
+}
+
+static inline void
+vst4_u8(uint8_t *p, uint8x8x4_t a)
+{
+   int i, k;
+
+   for (i = 0; i < 8; i++) {
+      for (k = 0; k < 4; k++) {
+         p[4 * i + k] = a.val[k].v[i];
+      }
+   }
+}
+
+/* Even elements of a:b in val[0], odd ones in val[1]. */
+static inline uint8x8x2_t
+vuzp_u8(uint8x8_t a, uint8x8_t b)
+{
+   uint8x8x2_t r;
+   int         i;
+
+   for (i = 0; i < 4; i++) {
+      r.val[0].v[i]     = a.v[2 * i];
+      r.val[0].v[i + 4] = b.v[2 * i];
+      r.val[1].v[i]     = a.v[2 * i + 1];
+      r.val[1].v[i + 4] = b.v[2 * i + 1];
+   }
+   return r;
+}
+
+/* a and b interleaved, low halves in val[0] and high halves in val[1]. */
+static inline uint8x8x2_t
+vzip_u8(uint8x8_t a, uint8x8_t b)
+{
+   uint8x8x2_t r;
+   int         i;
+
+   for (i = 0; i < 4; i++) {
+      r.val[0].v[2 * i]     = a.v[i];
+      r.val[0].v[2 * i + 1] = b.v[i];
+      r.val[1].v[2 * i]     = a.v[i + 4];
+      r.val[1].v[2 * i + 1] = b.v[i + 4];
+   }
+   return r;
+}
+
+/* Sums of adjacent pairs, widened. */
+static inline uint16x8_t
+vpaddlq_u8(uint8x16_t a)
+{
+   uint16x8_t r;
+   int        i;
+
+   for (i = 0; i < 8; i++) {
+      r.v[i] = a.v[2 * i] + a.v[2 * i + 1];
+   }
+   return r;
+}
+
+static inline uint32x4_t
+vpadalq_u16(uint32x4_t acc, uint16x8_t a)
+{
+   int i;
+
+   for (i = 0; i < 4; i++) {
+      acc.v[i] += a.v[2 * i] + a.v[2 * i + 1];
+   }
+   return acc;
+}
+
+static inline uint8x16_t
+vabdq_u8(uint8x16_t a, uint8x16_t b)
+{
+   uint8x16_t r;
+   int        i;
+
+   for (i = 0; i < 16; i++) {
+      r.v[i] = a.v[i] > b.v[i] ? a.v[i] - b.v[i] : b.v[i] - a.v[i];
+   }
+   return r;
+}
+
+static inline uint8x16_t
+vshrq_n_u8(uint8x16_t a, int n)
+{
+   uint8x16_t r;
+   int        i;
+
+   for (i = 0; i < 16; i++) {
+      r.v[i] = a.v[i] >> n;
+   }
+   return r;
+}
+
+static inline uint32_t
+vgetq_lane_u32(uint32x4_t a, int lane)
+{
+   return a.v[lane];
+}
+
+static inline uint16x8_t
+vmovl_u8(uint8x8_t a)
+{
+   uint16x8_t r;
+   int        i;
+
+   for (i = 0; i < 8; i++) {
+      r.v[i] = a.v[i];
+   }
+   return r;
+}
+
+/* Widening subtract; the result wraps modulo 2^16. */
+static inline uint16x8_t
+vsubl_u8(uint8x8_t a, uint8x8_t b)
+{
+   uint16x8_t r;
+   int        i;
+
+   for (i = 0; i < 8; i++) {
+      r.v[i] = (uint16_t)(a.v[i] - b.v[i]);
+   }
+   return r;
+}
+
+static inline int16x8_t
+vreinterpretq_s16_u16(uint16x8_t a)
+{
+   int16x8_t r;
+
+   memcpy(&r, &a, sizeof(r));
+   return r;
+}
+
+static inline int32x4_t
+vreinterpretq_s32_s16(int16x8_t a)
+{
+   int32x4_t r;
+
+   memcpy(&r, &a, sizeof(r));
+   return r;
+}
+
+static inline int16x8_t
+vreinterpretq_s16_s32(int32x4_t a)
+{
+   int16x8_t r;
+
+   memcpy(&r, &a, sizeof(r));
+   return r;
+}
+
+static inline int16x8_t
+vaddq_s16(int16x8_t a, int16x8_t b)
+{
+   int16x8_t r;
+   int       i;
+
+   for (i = 0; i < 8; i++) {
+      r.v[i] = (int16_t)(a.v[i] + b.v[i]);
+   }
+   return r;
+}
+
+static inline int16x8_t
+vsubq_s16(int16x8_t a, int16x8_t b)
+{
+   int16x8_t r;
+   int       i;
+
+   for (i = 0; i < 8; i++) {
+      r.v[i] = (int16_t)(a.v[i] - b.v[i]);
+   }
+   return r;
+}
+
+/* High half of 2 * a * b, rounded and saturated; only -32768 * -32768
+ * saturates. */
+static inline int16x8_t
+vqrdmulhq_n_s16(int16x8_t a, int16_t b)
+{
+   int16x8_t r;
+   int       i;
+
+   for (i = 0; i < 8; i++) {
+      int64_t p = (2 * (int64_t)a.v[i] * b + (1 << 15)) >> 16;
+
+      r.v[i] = p > 32767 ? 32767 : (int16_t)p;
+   }
+   return r;
+}
+
+/* Treats a and b as 2x2 matrices of lanes and transposes each. */
+static inline int16x8x2_t
+vtrnq_s16(int16x8_t a, int16x8_t b)
+{
+   int16x8x2_t r;
+   int         i;
+
+   for (i = 0; i < 8; i += 2) {
+      r.val[0].v[i]     = a.v[i];
+      r.val[0].v[i + 1] = b.v[i];
+      r.val[1].v[i]     = a.v[i + 1];
+      r.val[1].v[i + 1] = b.v[i + 1];
+   }
+   return r;
+}
+
+static inline int32x4x2_t
+vtrnq_s32(int32x4_t a, int32x4_t b)
+{
+   int32x4x2_t r;
+   int         i;
+
+   for (i = 0; i < 4; i += 2) {
+      r.val[0].v[i]     = a.v[i];
+      r.val[0].v[i + 1] = b.v[i];
+      r.val[1].v[i]     = a.v[i + 1];
+      r.val[1].v[i + 1] = b.v[i + 1];
+   }
+   return r;
+}
+
+static inline int32x2_t
+vget_low_s32(int32x4_t a)
+{
+   int32x2_t r;
+
+   memcpy(r.v, a.v, sizeof(r.v));
+   return r;
+}
+
+static inline int32x2_t
+vget_high_s32(int32x4_t a)
+{
+   int32x2_t r;
+
+   memcpy(r.v, a.v + 2, sizeof(r.v));
+   return r;
+}
+
+static inline int32x4_t
+vcombine_s32(int32x2_t lo, int32x2_t hi)
+{
+   int32x4_t r;
+
+   memcpy(r.v, lo.v, sizeof(lo.v));
+   memcpy(r.v + 2, hi.v, sizeof(hi.v));
+   return r;
+}
+
+static inline void
+vst1q_s16(int16_t *p, int16x8_t a)
+{
+   memcpy(p, a.v, sizeof(a.v));
+}
+
+static inline int16x4_t
+vget_low_s16(int16x8_t a)
+{
+   int16x4_t r;
+
+   memcpy(r.v, a.v, sizeof(r.v));
+   return r;
+}
+
+static inline int16x4_t
+vget_high_s16(int16x8_t a)
+{
+   int16x4_t r;
+
+   memcpy(r.v, a.v + 4, sizeof(r.v));
+   return r;
+}
+
+static inline int16x8_t
+vcombine_s16(int16x4_t lo, int16x4_t hi)
+{
+   int16x8_t r;
+
+   memcpy(r.v, lo.v, sizeof(lo.v));
+   memcpy(r.v + 4, hi.v, sizeof(hi.v));
+   return r;
+}
+
+static inline int32x4_t
+vmlal_n_s16(int32x4_t acc, int16x4_t a, int16_t b)
+{
+   int i;
+
+   for (i = 0; i < 4; i++) {
+      acc.v[i] += (int32_t)a.v[i] * b;
+   }
+   return acc;
+}
+
+static inline int32x4_t
+vmlsl_n_s16(int32x4_t acc, int16x4_t a, int16_t b)
+{
+   int i;
+
+   for (i = 0; i < 4; i++) {
+      acc.v[i] -= (int32_t)a.v[i] * b;
+   }
+   return acc;
+}
+
+/* Shift right and keep the low half of each lane. */
+static inline int16x4_t
+vshrn_n_s32(int32x4_t a, int n)
+{
+   int16x4_t r;
+   int       i;
+
+   for (i = 0; i < 4; i++) {
+      r.v[i] = (int16_t)(a.v[i] >> n);
+   }
+   return r;
+}
+
+/* Signed to unsigned with saturation. */
+static inline uint8x8_t
+vqmovun_s16(int16x8_t a)
+{
+   uint8x8_t r;
+   int       i;
+
+   for (i = 0; i < 8; i++) {
+      r.v[i] = a.v[i] < 0 ? 0 : (a.v[i] > 255 ? 255 : a.v[i]);
+   }
+   return r;
+}
+
+#endif
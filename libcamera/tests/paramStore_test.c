@@ -0,0 +1,705 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the parameter store against a plain list of what was set: set and
+ * overwrite, removal with the probe chain shifted back (across the wrap of
+ * the table too), unflatten with the CameraParameters parsing rules, diff,
+ * and the PARAM_ATOM_MAX cap. Then times lookups, unflatten and flatten of
+ * an e400 parameter string against a sorted array searched with strcmp,
+ * which is what CameraParameters' DefaultKeyedVector<String8, String8>
+ * does underneath.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "paramStore.h"
+
+/* What the vendor library hands back from getParameters, after
+ * CameraHAL_FixupParams. */
+static const char e400Params[] =
+   "preview-size=640x480;"
+   "preview-size-values=640x480,576x432,480x320,384x288,352x288,320x240,"
+      "240x160,176x144;"
+   "hfr-size-values=;"
+   "preview-fps-range=5000,30000;"
+   "preview-fps-range-values=(5000,30000);"
+   "preview-format=yuv420sp;"
+   "preview-format-values=yuv420sp,yuv420sp-adreno;"
+   "preview-frame-rate=15;"
+   "preview-frame-rate-values=30,27,24,15;"
+   "preview-frame-rate-mode=frame-rate-auto;"
+   "preview-frame-rate-modes=frame-rate-auto,frame-rate-fixed;"
+   "capture-mode=normal;"
+   "capture-mode-values=normal;"
+   "num-snaps-per-shutter=1;"
+   "picture-size=2048x1536;"
+   "picture-size-values=2048x1536,1600x1200,1280x960,1024x768,800x600,"
+      "640x480,352x288,320x240,176x144;"
+   "picture-format=jpeg;"
+   "picture-format-values=jpeg,raw;"
+   "jpeg-thumbnail-width=512;"
+   "jpeg-thumbnail-height=384;"
+   "jpeg-thumbnail-size-values=512x288,480x288,432x288,512x384,352x288,0x0;"
+   "jpeg-thumbnail-quality=90;"
+   "jpeg-quality=85;"
+   "rotation=0;"
+   "skinToneEnhancement=0;"
+   "skinToneEnhancement-values=enable,disable;"
+   "whitebalance=auto;"
+   "whitebalance-values=auto,incandescent,fluorescent,daylight,"
+      "cloudy-daylight;"
+   "effect=none;"
+   "effect-values=none,mono,negative,solarize,sepia,posterize,whiteboard,"
+      "blackboard,aqua;"
+   "touch-af-aec=touch-off;"
+   "touch-af-aec-values=touch-off,touch-on;"
+   "touch-index-aec=-1x-1;"
+   "touch-index-af=-1x-1;"
+   "antibanding=off;"
+   "antibanding-values=off,50hz,60hz,auto;"
+   "scene-mode=auto;"
+   "scene-mode-values=auto,action,portrait,landscape,night,night-portrait,"
+      "theatre,beach,snow,sunset,steadyphoto,fireworks,sports,party,"
+      "candlelight,backlight,flowers,AR;"
+   "scene-detect=off;"
+   "scene-detect-values=off,on;"
+   "flash-mode=off;"
+   "flash-mode-values=off;"
+   "focus-mode=auto;"
+   "focus-mode-values=auto,infinity,normal,macro;"
+   "max-num-focus-areas=0;"
+   "focal-length=2.93;"
+   "horizontal-view-angle=54.8;"
+   "vertical-view-angle=42.5;"
+   "exposure-compensation=0;"
+   "max-exposure-compensation=12;"
+   "min-exposure-compensation=-12;"
+   "exposure-compensation-step=0.166667;"
+   "auto-exposure-lock=false;"
+   "auto-exposure-lock-supported=true;"
+   "auto-whitebalance-lock=false;"
+   "auto-whitebalance-lock-supported=true;"
+   "max-num-metering-areas=0;"
+   "zoom=0;"
+   "max-zoom=59;"
+   "zoom-ratios=100,102,104,107,109,112,114,117,120,123,125,128,131,135,"
+      "138,141,144,148,151,155,158,162,166,170,174,178,182,186,190,195,200,"
+      "204,209,214,219,224,229,235,240,246,251,257,263,270,276,282,289,296,"
+      "303,310,317,324,332,340,348,356,364,373,381,390;"
+   "zoom-supported=true;"
+   "smooth-zoom-supported=false;"
+   "focus-distances=0.10,0.15,0.20;"
+   "video-size=640x480;"
+   "video-size-values=640x480,352x288,320x240,176x144;"
+   "record-size=640x480;"
+   "max-num-detected-faces-hw=0;"
+   "max-num-detected-faces-sw=0;"
+   "preferred-preview-size-for-video=640x480;"
+   "video-frame-format=yuv420sp;"
+   "recording-hint=false;"
+   "video-snapshot-supported=true;"
+   "full-video-snap-supported=0;"
+   "iso=auto;"
+   "iso-values=auto,ISO_HJR,ISO100,ISO200,ISO400,ISO800,ISO1600;"
+   "lensshade=enable;"
+   "lensshade-values=enable,disable;"
+   "auto-exposure=frame-average;"
+   "auto-exposure-values=frame-average,center-weighted,spot-metering;"
+   "exif-datetime=2012:05:18 10:21:47;"
+   "video-stabilization=false;"
+   "mce=enable;"
+   "mce-values=enable,disable;"
+   "zsl=off;"
+   "zsl-values=off,on;"
+   "camera-mode=0;"
+   "video-hfr=off;"
+   "video-hfr-values=off;"
+   "hdr=off;"
+   "hdr-values=off;"
+   "video-stabilization-supported=false;"
+   "ae-bracket-hdr=off;"
+   "denoise=denoise-off;"
+   "denoise-values=denoise-off,denoise-on;"
+   "selectable-zone-af=auto;"
+   "selectable-zone-af-values=auto,spot-metering,center-weighted,"
+      "frame-average;"
+   "face-detection=off;"
+   "face-detection-values=off,on;"
+   "redeye-reduction=disable;"
+   "redeye-reduction-values=enable,disable;"
+   "metering=center;"
+   "wdr=off;"
+   "continuous-af=caf-off;"
+   "continuous-af-values=caf-off;"
+   "sharpness=10;"
+   "max-sharpness=30;"
+   "min-sharpness=0;"
+   "contrast=5;"
+   "max-contrast=10;"
+   "min-contrast=0;"
+   "saturation=5;"
+   "max-saturation=10;"
+   "min-saturation=0;"
+   "shutter-sound=1;"
+   "histogram=disable;"
+   "histogram-values=enable,disable";
+
+/* The same FNV-1a as paramStore.c, to pick keys that share a home slot. */
+static unsigned int
+home_slot(const char *key, unsigned int capacity)
+{
+   unsigned int hash = 2166136261u;
+
+   while (*key != '\0') {
+      hash = (hash ^ (unsigned char)*key++) * 16777619u;
+   }
+   return hash & (capacity - 1);
+}
+
+/* Checks that the store holds exactly the first count keys/values given,
+ * with removed ones (value NULL) missing. */
+static int
+check_contents(const char *test, const struct param_store *store,
+               char keys[][16], const char **values, int count)
+{
+   unsigned int expected = 0;
+   int          i;
+
+   for (i = 0; i < count; i++) {
+      const char *value = param_store_get(store, keys[i]);
+      if (values[i] != NULL) {
+         expected++;
+      }
+      if ((value == NULL) != (values[i] == NULL) ||
+          (value != NULL && strcmp(value, values[i]) != 0)) {
+         fprintf(stderr, "FAIL %s: %s is %s, expected %s\n", test, keys[i],
+                 value != NULL ? value : "(none)",
+                 values[i] != NULL ? values[i] : "(none)");
+         return 1;
+      }
+   }
+   if (store->count != expected) {
+      fprintf(stderr, "FAIL %s: store counts %u keys, expected %u\n", test,
+              store->count, expected);
+      return 1;
+   }
+   return 0;
+}
+
+static int
+check_set_get()
+{
+   struct param_store store;
+   char               keys[200][16];
+   const char        *values[200];
+   int                i, failed = 0;
+
+   /* 200 keys take the table through two resizes. */
+   param_store_init(&store);
+   for (i = 0; i < 200; i++) {
+      snprintf(keys[i], sizeof(keys[i]), "set-%d", i);
+      values[i] = (i % 3) == 0 ? "a" : (i % 3) == 1 ? "" : "a=b,c";
+      if (param_store_set(&store, keys[i], values[i]) < 0) {
+         fprintf(stderr, "FAIL set/get: setting %s\n", keys[i]);
+         failed = 1;
+      }
+   }
+   failed |= check_contents("set/get", &store, keys, values, 200);
+   for (i = 0; i < 200; i += 7) {
+      values[i] = "overwritten";
+      param_store_set(&store, keys[i], values[i]);
+   }
+   failed |= check_contents("overwrite", &store, keys, values, 200);
+   if (param_store_get(&store, "never-set") != NULL) {
+      fprintf(stderr, "FAIL set/get: found a key never set\n");
+      failed = 1;
+   }
+   param_store_free(&store);
+   return failed;
+}
+
+/*
+ * Removes keys from the middle of probe chains, including one that runs
+ * off the end of the table, in an order that makes the shift back matter:
+ * a key left behind a hole it could move into would no longer be found.
+ */
+static int
+check_remove()
+{
+   static const unsigned int capacity = 64;   /* STORE_MIN_SLOTS */
+   struct param_store store;
+   char               keys[24][16];
+   const char        *values[24];
+   unsigned int       seed = 1;
+   int                n = 0, candidate, i, failed = 0;
+
+   /* Eight keys each at home in the last slot and in slot 1, so the two
+    * chains wrap, run into each other and interleave, then eight more
+    * anywhere: 24 keys, which keeps 64 slots less than half full. */
+   for (candidate = 0; n < 24; candidate++) {
+      char         key[16];
+      unsigned int home;
+
+      snprintf(key, sizeof(key), "rm-%d", candidate);
+      home = home_slot(key, capacity);
+      if ((n < 8 && home == capacity - 1) ||
+          (n >= 8 && n < 16 && home == 1) ||
+          (n >= 16 && home != capacity - 1 && home != 1)) {
+         memcpy(keys[n], key, sizeof(key));
+         values[n] = keys[n];
+         n++;
+      }
+   }
+
+   param_store_init(&store);
+   for (i = 0; i < n; i++) {
+      param_store_set(&store, keys[i], values[i]);
+   }
+   if (store.capacity != capacity) {
+      fprintf(stderr, "FAIL remove: table has %u slots, expected %u\n",
+              store.capacity, capacity);
+      param_store_free(&store);
+      return 1;
+   }
+   failed |= check_contents("remove (setup)", &store, keys, values, n);
+
+   /* Heads of chains first, then a shuffled rest. */
+   param_store_remove(&store, keys[0]);
+   values[0] = NULL;
+   param_store_remove(&store, keys[8]);
+   values[8] = NULL;
+   failed |= check_contents("remove chain heads", &store, keys, values, n);
+   for (i = n - 1; i > 0 && !failed; i--) {
+      int j;
+
+      seed = seed * 1103515245 + 12345;
+      j = 1 + (seed >> 16) % i;
+      if (values[j] != NULL) {
+         param_store_remove(&store, keys[j]);
+         values[j] = NULL;
+         failed |= check_contents("remove", &store, keys, values, n);
+      }
+   }
+   /* Removing what isn't there changes nothing. */
+   param_store_remove(&store, keys[0]);
+   param_store_remove(&store, "never-set");
+   failed |= check_contents("remove missing", &store, keys, values, n);
+
+   /* What is left can still be put back and found. */
+   for (i = 0; i < n; i++) {
+      values[i] = "back";
+      param_store_set(&store, keys[i], values[i]);
+   }
+   failed |= check_contents("remove then set", &store, keys, values, n);
+   param_store_free(&store);
+   return failed;
+}
+
+static void
+ignore_diff(int atom, void *arg)
+{
+   (void)atom;
+   (void)arg;
+}
+
+static int
+check_unflatten()
+{
+   /* A key without '=' ends the string, as in CameraParameters. */
+   static const char *const params = "a=1;b=;c=x=y;d=last;e;f=lost";
+   static const char *const expected[][2] = {
+      { "a", "1" }, { "b", "" }, { "c", "x=y" }, { "d", "last" },
+      { "e", NULL }, { "f", NULL }
+   };
+   struct param_store store, copy;
+   char              *flat;
+   unsigned int       i;
+   int                failed = 0;
+
+   param_store_init(&store);
+   param_store_init(&copy);
+   if (param_store_unflatten(&store, params) < 0) {
+      fprintf(stderr, "FAIL unflatten: rejected %s\n", params);
+      return 1;
+   }
+   for (i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+      const char *value = param_store_get(&store, expected[i][0]);
+      if ((value == NULL) != (expected[i][1] == NULL) ||
+          (value != NULL && strcmp(value, expected[i][1]) != 0)) {
+         fprintf(stderr, "FAIL unflatten: %s is %s, expected %s\n",
+                 expected[i][0], value != NULL ? value : "(none)",
+                 expected[i][1] != NULL ? expected[i][1] : "(none)");
+         failed = 1;
+      }
+   }
+
+   /* The e400 string survives a round trip, whatever the key order. */
+   param_store_unflatten(&store, e400Params);
+   flat = param_store_flatten(&store);
+   if (flat == NULL || param_store_unflatten(&copy, flat) < 0 ||
+       copy.count != store.count ||
+       param_store_diff(&store, &copy, ignore_diff, NULL) != 0 ||
+       strlen(flat) != strlen(e400Params)) {
+      fprintf(stderr, "FAIL unflatten: the e400 string changed in a round "
+              "trip\n");
+      failed = 1;
+   }
+   free(flat);
+
+   /* Unflatten starts from an empty store. */
+   param_store_unflatten(&store, "only=1");
+   if (store.count != 1 || param_store_get(&store, "zoom") != NULL) {
+      fprintf(stderr, "FAIL unflatten: kept keys from before\n");
+      failed = 1;
+   }
+   param_store_free(&store);
+   param_store_free(&copy);
+   return failed;
+}
+
+struct diff_result {
+   char names[256];
+   int  calls;
+};
+
+static void
+note_diff(int atom, void *arg)
+{
+   struct diff_result *result = (struct diff_result *)arg;
+
+   strcat(result->names, param_atom_name(atom));
+   strcat(result->names, " ");
+   result->calls++;
+}
+
+static int
+check_diff()
+{
+   static const struct {
+      const char *from;
+      const char *to;
+      const char *changed;    /* sorted, as note_diff sees them in any order */
+   } cases[] = {
+      { "a=1;b=2", "b=2;a=1", "" },
+      { "a=1;b=2", "a=1;b=3", "b" },
+      { "a=1;b=2", "a=1", "b" },
+      { "a=1", "a=1;c=", "c" },
+      { "a=1;b=2;c=3", "a=2;c=3;d=4", "a b d" },
+      { "", "", "" },
+   };
+   unsigned int c;
+   int          failed = 0;
+
+   for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+      struct param_store from, to;
+      struct diff_result result;
+      char               sorted[256] = "";
+      char              *names[8], *name;
+      int                n = 0, i, j, count;
+
+      param_store_init(&from);
+      param_store_init(&to);
+      param_store_unflatten(&from, cases[c].from);
+      param_store_unflatten(&to, cases[c].to);
+      memset(&result, 0, sizeof(result));
+      count = param_store_diff(&from, &to, note_diff, &result);
+
+      for (name = strtok(result.names, " "); name != NULL && n < 8;
+           name = strtok(NULL, " ")) {
+         names[n++] = name;
+      }
+      for (i = 0; i < n; i++) {
+         for (j = i + 1; j < n; j++) {
+            if (strcmp(names[j], names[i]) < 0) {
+               name = names[i];
+               names[i] = names[j];
+               names[j] = name;
+            }
+         }
+         strcat(sorted, i > 0 ? " " : "");
+         strcat(sorted, names[i]);
+      }
+      if (count != result.calls || strcmp(sorted, cases[c].changed) != 0) {
+         fprintf(stderr, "FAIL diff \"%s\" -> \"%s\": %d changed (%s), "
+                 "expected %s\n", cases[c].from, cases[c].to, count, sorted,
+                 cases[c].changed);
+         failed = 1;
+      }
+      param_store_free(&from);
+      param_store_free(&to);
+   }
+   return failed;
+}
+
+/* Runs last: the atoms it uses up are never given back. */
+static int
+check_atom_cap()
+{
+   struct param_store store;
+   char               key[32];
+   int                atom, last = -1, interned = 0, failed = 0;
+
+   param_store_init(&store);
+   param_store_set(&store, "before-cap", "1");
+   for (;;) {
+      snprintf(key, sizeof(key), "cap-%d", interned);
+      atom = param_atom_intern(key, strlen(key));
+      if (atom < 0) {
+         break;
+      }
+      if (atom <= last || atom >= PARAM_ATOM_MAX) {
+         fprintf(stderr, "FAIL atom cap: %s got atom %d after %d\n", key,
+                 atom, last);
+         failed = 1;
+         break;
+      }
+      last = atom;
+      interned++;
+   }
+   if (last != PARAM_ATOM_MAX - 1) {
+      fprintf(stderr, "FAIL atom cap: stopped at atom %d, expected %d\n",
+              last, PARAM_ATOM_MAX - 1);
+      failed = 1;
+   }
+
+   /* Known keys still work, new ones fail cleanly. */
+   if (param_atom_intern("before-cap", strlen("before-cap")) < 0 ||
+       param_store_set(&store, "before-cap", "2") < 0 ||
+       strcmp(param_store_get(&store, "before-cap"), "2") != 0) {
+      fprintf(stderr, "FAIL atom cap: a known key stopped working\n");
+      failed = 1;
+   }
+   if (param_store_set(&store, "after-cap", "1") >= 0 ||
+       param_store_get(&store, "after-cap") != NULL ||
+       param_atom_lookup("after-cap") >= 0) {
+      fprintf(stderr, "FAIL atom cap: a key past the cap was stored\n");
+      failed = 1;
+   }
+   if (param_store_unflatten(&store, "before-cap=3;after-cap=1") >= 0) {
+      fprintf(stderr, "FAIL atom cap: unflatten took a key past the cap\n");
+      failed = 1;
+   }
+   param_store_free(&store);
+   return failed;
+}
+
+/* The CameraParameters model: entries sorted by key, found by binary
+ * search with strcmp, and rebuilt from scratch by unflatten. */
+struct sorted_entry {
+   char *key;
+   char *value;
+};
+
+struct sorted_params {
+   struct sorted_entry *entries;
+   int                  count;
+};
+
+static int
+sorted_find(const struct sorted_params *params, const char *key, int *at)
+{
+   int lo = 0, hi = params->count - 1;
+
+   while (lo <= hi) {
+      int mid = (lo + hi) / 2;
+      int cmp = strcmp(params->entries[mid].key, key);
+      if (cmp == 0) {
+         *at = mid;
+         return 1;
+      }
+      if (cmp < 0) {
+         lo = mid + 1;
+      } else {
+         hi = mid - 1;
+      }
+   }
+   *at = lo;
+   return 0;
+}
+
+static void
+sorted_clear(struct sorted_params *params)
+{
+   int i;
+
+   for (i = 0; i < params->count; i++) {
+      free(params->entries[i].key);
+      free(params->entries[i].value);
+   }
+   params->count = 0;
+}
+
+static void
+sorted_unflatten(struct sorted_params *params, const char *flat)
+{
+   const char *a = flat, *b, *c;
+
+   sorted_clear(params);
+   while ((b = strchr(a, '=')) != NULL) {
+      char *key = strndup(a, b - a);
+      int   at;
+
+      a = b + 1;
+      c = strchr(a, ';');
+      if (sorted_find(params, key, &at)) {
+         free(params->entries[at].value);
+         free(key);
+      } else {
+         memmove(&params->entries[at + 1], &params->entries[at],
+                 (params->count - at) * sizeof(params->entries[0]));
+         params->entries[at].key = key;
+         params->count++;
+      }
+      params->entries[at].value = c != NULL ? strndup(a, c - a) : strdup(a);
+      if (c == NULL) {
+         break;
+      }
+      a = c + 1;
+   }
+}
+
+static char *
+sorted_flatten(const struct sorted_params *params)
+{
+   size_t len = 1;
+   char  *result;
+   int    i;
+
+   for (i = 0; i < params->count; i++) {
+      len += strlen(params->entries[i].key) +
+             strlen(params->entries[i].value) + 2;
+   }
+   result = malloc(len);
+   result[0] = '\0';
+   for (i = 0; i < params->count; i++) {
+      if (i > 0) {
+         strcat(result, ";");
+      }
+      strcat(result, params->entries[i].key);
+      strcat(result, "=");
+      strcat(result, params->entries[i].value);
+   }
+   return result;
+}
+
+static double
+now_us()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+/* The keys set_parameters and get_parameters look up per call. */
+static const char *const lookupKeys[] = {
+   "preview-size", "preview-frame-rate", "picture-size", "jpeg-quality",
+   "rotation", "zoom", "video-size", "recording-hint", "zsl", "burst-count",
+   "luma-stats", "preview-render-fps-max", "preview-callback-fps-max",
+   "focus-mode", "whitebalance", "effect"
+};
+
+static void
+benchmark()
+{
+   static const int     iterations = 2000;
+   struct param_store   store;
+   struct sorted_params sorted;
+   const unsigned int   numKeys = sizeof(lookupKeys) / sizeof(lookupKeys[0]);
+   double               start, storeTime[3], sortedTime[3];
+   volatile const char *sink;
+   char                *flat;
+   int                  i, at;
+   unsigned int         k;
+
+   param_store_init(&store);
+   sorted.entries = malloc(256 * sizeof(sorted.entries[0]));
+   sorted.count   = 0;
+
+   start = now_us();
+   for (i = 0; i < iterations; i++) {
+      param_store_unflatten(&store, e400Params);
+   }
+   storeTime[0] = (now_us() - start) / iterations;
+   start = now_us();
+   for (i = 0; i < iterations; i++) {
+      sorted_unflatten(&sorted, e400Params);
+   }
+   sortedTime[0] = (now_us() - start) / iterations;
+
+   start = now_us();
+   for (i = 0; i < iterations; i++) {
+      for (k = 0; k < numKeys; k++) {
+         sink = param_store_get(&store, lookupKeys[k]);
+      }
+   }
+   storeTime[1] = (now_us() - start) / iterations / numKeys;
+   start = now_us();
+   for (i = 0; i < iterations; i++) {
+      for (k = 0; k < numKeys; k++) {
+         sink = sorted_find(&sorted, lookupKeys[k], &at) ?
+                   sorted.entries[at].value : NULL;
+      }
+   }
+   sortedTime[1] = (now_us() - start) / iterations / numKeys;
+   (void)sink;
+
+   start = now_us();
+   for (i = 0; i < iterations; i++) {
+      free(param_store_flatten(&store));
+   }
+   storeTime[2] = (now_us() - start) / iterations;
+   start = now_us();
+   for (i = 0; i < iterations; i++) {
+      flat = sorted_flatten(&sorted);
+      free(flat);
+   }
+   sortedTime[2] = (now_us() - start) / iterations;
+
+   printf("e400 parameters: %u keys, %u bytes\n", store.count,
+          (unsigned int)strlen(e400Params));
+   printf("  unflatten  param_store %7.2f us, sorted strcmp %7.2f us\n",
+          storeTime[0], sortedTime[0]);
+   printf("  get        param_store %7.3f us, sorted strcmp %7.3f us\n",
+          storeTime[1], sortedTime[1]);
+   printf("  flatten    param_store %7.2f us, sorted strcmp %7.2f us\n",
+          storeTime[2], sortedTime[2]);
+
+   param_store_free(&store);
+   sorted_clear(&sorted);
+   free(sorted.entries);
+}
+
+int
+main()
+{
+   int failures = 0, checks = 0;
+
+   failures += check_set_get();
+   failures += check_remove();
+   failures += check_unflatten();
+   failures += check_diff();
+   checks += 4;
+   /* Timed before the cap check fills the atom table. */
+   benchmark();
+   failures += check_atom_cap();
+   checks++;
+   printf("paramStore: %d of %d checks passed\n", checks - failures, checks);
+   return failures != 0;
+}
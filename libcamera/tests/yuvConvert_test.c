@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks that yuv420sp_to_rgbx, the NEON converter on ARM, matches
+ * yuv420sp_to_rgbx_ref bit for bit, padding included, and that a frame
+ * turned by yuv420sp_rotate90 converts to what yuv420sp_to_rgbx_rot90
+ * gives, then reports the speed of the converters for the preview sizes the
+ * HAL advertises.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "yuvConvert.h"
+
+enum {
+   PATTERN_RANDOM,
+   PATTERN_EXTREMES,    /* 0 and 255 only, to hit the clamps */
+   PATTERN_COUNT
+};
+
+static uint32_t seed = 1;
+
+static uint8_t
+next_byte(int pattern)
+{
+   seed = seed * 1103515245 + 12345;
+   if (pattern == PATTERN_EXTREMES) {
+      return (seed >> 30) & 1 ? 255 : 0;
+   }
+   return seed >> 24;
+}
+
+/* NV21/NV12 with a luma stride of width, as the HAL hands them over. The
+ * reference reads one byte past the last chroma pair of an odd width. */
+static size_t
+frame_size(int width, int height)
+{
+   return width * height + (height + 1) / 2 * width + 1;
+}
+
+static int
+check(int width, int height, int dstStride, int chromaOrder, int pattern)
+{
+   size_t   srcSize = frame_size(width, height);
+   size_t   dstSize = dstStride * height * 4;
+   uint8_t *src = malloc(srcSize);
+   uint8_t *out = malloc(dstSize);
+   uint8_t *ref = malloc(dstSize);
+   size_t   i;
+   int      failed = 0;
+
+   if (src == NULL || out == NULL || ref == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+   for (i = 0; i < srcSize; i++) {
+      src[i] = next_byte(pattern);
+   }
+   /* Bytes between width and dstStride must be left alone. */
+   memset(out, 0x5a, dstSize);
+   memset(ref, 0x5a, dstSize);
+
+   yuv420sp_to_rgbx(src, out, width, height, dstStride, chromaOrder);
+   yuv420sp_to_rgbx_ref(src, ref, width, height, dstStride, chromaOrder);
+
+   for (i = 0; i < dstSize; i++) {
+      if (out[i] != ref[i]) {
+         fprintf(stderr, "FAIL %s %dx%d stride:%d pattern:%d: pixel (%d,%d) "
+                 "byte %d is %d, expected %d\n",
+                 chromaOrder == YUV420SP_NV21 ? "NV21" : "NV12", width,
+                 height, dstStride, pattern,
+                 (int)(i / 4 % dstStride), (int)(i / 4 / dstStride),
+                 (int)(i % 4), out[i], ref[i]);
+         failed = 1;
+         break;
+      }
+   }
+   free(src);
+   free(out);
+   free(ref);
+   return failed;
+}
+
+/* The HAL rotates preview callback and recording frames with
+ * yuv420sp_rotate90 and the preview itself with yuv420sp_to_rgbx_rot90, so
+ * the two must agree. */
+static int
+check_rotate(int width, int height, int pattern)
+{
+   size_t   srcSize = width * height * 3 / 2;
+   size_t   dstSize = width * height * 4;
+   uint8_t *src     = malloc(srcSize);
+   uint8_t *turned  = malloc(srcSize);
+   uint8_t *out     = malloc(dstSize);
+   uint8_t *ref     = malloc(dstSize);
+   size_t   i;
+   int      failed = 0;
+
+   if (src == NULL || turned == NULL || out == NULL || ref == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+   for (i = 0; i < srcSize; i++) {
+      src[i] = next_byte(pattern);
+   }
+   yuv420sp_rotate90(src, turned, width, height);
+   yuv420sp_to_rgbx_ref(turned, out, height, width, height, YUV420SP_NV21);
+   yuv420sp_to_rgbx_rot90(src, ref, width, height, height, YUV420SP_NV21);
+
+   for (i = 0; i < dstSize; i++) {
+      if (out[i] != ref[i]) {
+         fprintf(stderr, "FAIL rotate %dx%d pattern:%d: pixel (%d,%d) byte "
+                 "%d is %d, expected %d\n", width, height, pattern,
+                 (int)(i / 4 % height), (int)(i / 4 / height), (int)(i % 4),
+                 out[i], ref[i]);
+         failed = 1;
+         break;
+      }
+   }
+   free(src);
+   free(turned);
+   free(out);
+   free(ref);
+   return failed;
+}
+
+static double
+now_ms()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void
+benchmark(int width, int height)
+{
+   static const int iterations = 20;
+   uint8_t *src = calloc(frame_size(width, height), 1);
+   uint8_t *dst = malloc(width * height * 4);
+   double   start, neon, ref;
+   int      i;
+
+   if (src == NULL || dst == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+   start = now_ms();
+   for (i = 0; i < iterations; i++) {
+      yuv420sp_to_rgbx(src, dst, width, height, width, YUV420SP_NV21);
+   }
+   neon = (now_ms() - start) / iterations;
+   start = now_ms();
+   for (i = 0; i < iterations; i++) {
+      yuv420sp_to_rgbx_ref(src, dst, width, height, width, YUV420SP_NV21);
+   }
+   ref = (now_ms() - start) / iterations;
+   printf("%4dx%-4d yuv420sp_to_rgbx %7.2f Mpixel/s, ref %7.2f Mpixel/s\n",
+          width, height, width * height / neon / 1000.0,
+          width * height / ref / 1000.0);
+   free(src);
+   free(dst);
+}
+
+int
+main()
+{
+   /* Whole, partial and single 8 pixel NEON blocks, odd sizes included. */
+   static const int sizes[][2] = {
+      { 1, 1 }, { 2, 2 }, { 7, 3 }, { 8, 2 }, { 9, 5 }, { 16, 4 },
+      { 17, 3 }, { 23, 7 }, { 64, 2 }, { 176, 144 }, { 641, 11 }
+   };
+   /* The preview sizes from CameraHAL_FixupParams. */
+   static const int previewSizes[][2] = {
+      { 640, 480 }, { 576, 432 }, { 480, 320 }, { 384, 288 },
+      { 352, 288 }, { 320, 240 }, { 240, 160 }, { 176, 144 }
+   };
+   unsigned int s;
+   int          order, pattern, pad, failures = 0, checks = 0;
+   int          rotateFailures, rotateChecks;
+
+   for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      for (order = YUV420SP_NV21; order <= YUV420SP_NV12; order++) {
+         for (pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+            /* A destination stride equal to the width, and one past it. */
+            for (pad = 0; pad <= 5; pad += 5) {
+               failures += check(sizes[s][0], sizes[s][1],
+                                 sizes[s][0] + pad, order, pattern);
+               checks++;
+            }
+         }
+      }
+   }
+   printf("yuvConvert: %d of %d conversions match the reference\n",
+          checks - failures, checks);
+
+   rotateChecks = rotateFailures = 0;
+   for (s = 0; s < sizeof(previewSizes) / sizeof(previewSizes[0]); s++) {
+      for (pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+         rotateFailures += check_rotate(previewSizes[s][0],
+                                        previewSizes[s][1], pattern);
+         rotateChecks++;
+      }
+   }
+   rotateFailures += check_rotate(2, 2, PATTERN_RANDOM);
+   rotateChecks++;
+   printf("yuvConvert: %d of %d rotations match yuv420sp_to_rgbx_rot90\n",
+          rotateChecks - rotateFailures, rotateChecks);
+   failures += rotateFailures;
+
+   for (s = 0; s < sizeof(previewSizes) / sizeof(previewSizes[0]); s++) {
+      benchmark(previewSizes[s][0], previewSizes[s][1]);
+   }
+   return failures != 0;
+}
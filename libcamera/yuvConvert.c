@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "yuvConvert.h"
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+static inline uint8_t
+clamp8(int v)
+{
+   return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/* R = 1.164(Y-16) + 1.596(Cr-128), etc. in 8.8 fixed point. */
+static inline void
+yuv_to_rgbx_pixel(int y, int cb, int cr, uint8_t *dst)
+{
+   int c = 298 * (y - 16) + 128;
+   int d = cb - 128;
+   int e = cr - 128;
+
+   dst[0] = clamp8((c + 409 * e) >> 8);
+   dst[1] = clamp8((c - 100 * d - 208 * e) >> 8);
+   dst[2] = clamp8((c + 516 * d) >> 8);
+   dst[3] = 0xff;
+}
+
+static void
+convert_row_ref(const uint8_t *y, const uint8_t *c, uint8_t *dst,
+                int x, int width, int crFirst)
+{
+   for (; x < width; x++) {
+      const uint8_t *pair = c + (x & ~1);
+      int cr = crFirst ? pair[0] : pair[1];
+      int cb = crFirst ? pair[1] : pair[0];
+
+      yuv_to_rgbx_pixel(y[x], cb, cr, dst + 4 * x);
+   }
+}
+
+void
+yuv420sp_to_rgbx_ref(const uint8_t *src, uint8_t *dst,
+                     int width, int height, int dstStride,
+                     int chromaOrder)
+{
+   const uint8_t *chroma = src + width * height;
+   int row;
+
+   for (row = 0; row < height; row++) {
+      convert_row_ref(src + row * width, chroma + (row >> 1) * width,
+                      dst + row * dstStride * 4, 0, width,
+                      chromaOrder == YUV420SP_NV21);
+   }
+}
+
+#ifdef __ARM_NEON__
+static inline uint8x8_t
+neon_channel(int32x4_t lo, int32x4_t hi)
+{
+   /* Results are within +-1024 after the shift, so the plain narrow is
+    * exact and vqmovun does the same clamping as clamp8(). */
+   return vqmovun_s16(vcombine_s16(vshrn_n_s32(lo, 8), vshrn_n_s32(hi, 8)));
+}
+
+static void
+convert_row_neon(const uint8_t *y, const uint8_t *c, uint8_t *dst,
+                 int width, int crFirst)
+{
+   const int16x8_t  bias16  = vdupq_n_s16(16);
+   const int16x8_t  bias128 = vdupq_n_s16(128);
+   const int32x4_t  round   = vdupq_n_s32(128);
+   uint8x8x4_t      rgbx;
+   int              x;
+
+   rgbx.val[3] = vdup_n_u8(0xff);
+
+   for (x = 0; x + 8 <= width; x += 8) {
+      uint8x8_t   luma  = vld1_u8(y + x);
+      uint8x8_t   pairs = vld1_u8(c + x);
+      uint8x8x2_t split = vuzp_u8(pairs, pairs);
+      uint8x8_t   first = vzip_u8(split.val[0], split.val[0]).val[0];
+      uint8x8_t   secnd = vzip_u8(split.val[1], split.val[1]).val[0];
+
+      int16x8_t ys = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(luma)), bias16);
+      int16x8_t cb = vsubq_s16(vreinterpretq_s16_u16(
+                                  vmovl_u8(crFirst ? secnd : first)), bias128);
+      int16x8_t cr = vsubq_s16(vreinterpretq_s16_u16(
+                                  vmovl_u8(crFirst ? first : secnd)), bias128);
+
+      int32x4_t clo = vmlal_n_s16(round, vget_low_s16(ys), 298);
+      int32x4_t chi = vmlal_n_s16(round, vget_high_s16(ys), 298);
+
+      rgbx.val[0] = neon_channel(vmlal_n_s16(clo, vget_low_s16(cr), 409),
+                                 vmlal_n_s16(chi, vget_high_s16(cr), 409));
+      rgbx.val[1] = neon_channel(
+         vmlsl_n_s16(vmlsl_n_s16(clo, vget_low_s16(cb), 100),
+                     vget_low_s16(cr), 208),
+         vmlsl_n_s16(vmlsl_n_s16(chi, vget_high_s16(cb), 100),
+                     vget_high_s16(cr), 208));
+      rgbx.val[2] = neon_channel(vmlal_n_s16(clo, vget_low_s16(cb), 516),
+                                 vmlal_n_s16(chi, vget_high_s16(cb), 516));
+
+      vst4_u8(dst + 4 * x, rgbx);
+   }
+   convert_row_ref(y, c, dst, x, width, crFirst);
+}
+#endif
+
+void
+yuv420sp_to_rgbx(const uint8_t *src, uint8_t *dst,
+                 int width, int height, int dstStride,
+                 int chromaOrder)
+{
+#ifdef __ARM_NEON__
+   const uint8_t *chroma = src + width * height;
+   int row;
+
+   for (row = 0; row < height; row++) {
+      convert_row_neon(src + row * width, chroma + (row >> 1) * width,
+                       dst + row * dstStride * 4, width,
+                       chromaOrder == YUV420SP_NV21);
+   }
+#else
+   yuv420sp_to_rgbx_ref(src, dst, width, height, dstStride, chromaOrder);
+#endif
+}
+
+void
+yuv420sp_to_rgbx_rot90(const uint8_t *src, uint8_t *dst,
+                       int width, int height, int dstStride,
+                       int chromaOrder)
+{
+   const uint8_t *chroma = src + width * height;
+   int crFirst = chromaOrder == YUV420SP_NV21;
+   int row, x;
+
+   /* Source row r lands in destination column height - 1 - r. */
+   for (row = 0; row < height; row++) {
+      const uint8_t *y   = src + row * width;
+      const uint8_t *c   = chroma + (row >> 1) * width;
+      uint8_t       *out = dst + (height - 1 - row) * 4;
+
+      for (x = 0; x < width; x++, out += dstStride * 4) {
+         const uint8_t *pair = c + (x & ~1);
+         int cr = crFirst ? pair[0] : pair[1];
+         int cb = crFirst ? pair[1] : pair[0];
+
+         yuv_to_rgbx_pixel(y[x], cb, cr, out);
+      }
+   }
+}
+
+void
+yuv420sp_rotate90(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+   const uint8_t *srcChroma = src + width * height;
+   uint8_t       *dstChroma = dst + width * height;
+   int row, x;
+
+   /* Source row r lands in destination column height - 1 - r. */
+   for (row = 0; row < height; row++) {
+      const uint8_t *in  = src + row * width;
+      uint8_t       *out = dst + height - 1 - row;
+
+      for (x = 0; x < width; x++, out += height) {
+         *out = in[x];
+      }
+   }
+   /* Chroma pairs stand for 2x2 blocks, which move the same way. */
+   for (row = 0; row < height / 2; row++) {
+      const uint8_t *in  = srcChroma + row * width;
+      uint8_t       *out = dstChroma + (height / 2 - 1 - row) * 2;
+
+      for (x = 0; x < width / 2; x++, out += height) {
+         out[0] = in[2 * x];
+         out[1] = in[2 * x + 1];
+      }
+   }
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2012, Raviprasad V Mummidi.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAMERA_HAL_YUV_CONVERT_H
+#define CAMERA_HAL_YUV_CONVERT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Chroma byte order of a YUV420 semi-planar frame. */
+#define YUV420SP_NV21 0   /* Cr first, the camera preview format */
+#define YUV420SP_NV12 1   /* Cb first */
+
+/*
+ * Converts a packed YUV420 semi-planar frame (luma stride == width, chroma
+ * plane right after the luma plane) to RGBX_8888 using BT.601 video range
+ * coefficients. dstStride is in pixels.
+ *
+ * yuv420sp_to_rgbx_ref() is the plain C reference, yuv420sp_to_rgbx() uses
+ * NEON when built for it and produces bit-identical output.
+ */
+void yuv420sp_to_rgbx_ref(const uint8_t *src, uint8_t *dst,
+                          int width, int height, int dstStride,
+                          int chromaOrder);
+void yuv420sp_to_rgbx(const uint8_t *src, uint8_t *dst,
+                      int width, int height, int dstStride,
+                      int chromaOrder);
+
+/* As yuv420sp_to_rgbx_ref(), but rotates 90 degrees clockwise on the way,
+ * so dst is height pixels wide and width rows tall. */
+void yuv420sp_to_rgbx_rot90(const uint8_t *src, uint8_t *dst,
+                            int width, int height, int dstStride,
+                            int chromaOrder);
+
+/* Rotates a packed YUV420 semi-planar frame 90 degrees clockwise, as
+ * yuv420sp_to_rgbx_rot90() does, into a packed frame height pixels wide and
+ * width rows tall. Width and height must be even. */
+void yuv420sp_rotate90(const uint8_t *src, uint8_t *dst, int width,
+                       int height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif